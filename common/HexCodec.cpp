@@ -0,0 +1,319 @@
+#include "HexCodec.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define HEXCODEC_X86 1
+#include <immintrin.h>
+#endif
+
+namespace hex
+{
+
+const signed char c_digits[256] =
+{
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    0,1,2,3,4,5,6,7,8,9,-1,-1,-1,-1,-1,-1,
+    -1,0xa,0xb,0xc,0xd,0xe,0xf,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,0xa,0xb,0xc,0xd,0xe,0xf,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
+};
+
+const char c_pairs[513] =
+    "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+namespace
+{
+
+void encodeScalar(const uint8_t* data, std::size_t size, char* out)
+{
+    for (std::size_t i = 0; i < size; ++i) {
+        encodeByte(data[i], out + 2 * i);
+    }
+}
+
+void encodeReversedScalar(const uint8_t* data, std::size_t size, char* out)
+{
+    for (std::size_t i = 0; i < size; ++i) {
+        encodeByte(data[size - 1 - i], out + 2 * i);
+    }
+}
+
+bool decodeScalar(const char* in, std::size_t size, uint8_t* out)
+{
+    // Any invalid digit sets the sign bit of the or-ed values
+    signed char bad = 0;
+    for (std::size_t i = 0; i < size; ++i) {
+        signed char const hi = digit(in[2 * i]);
+        signed char const lo = digit(in[2 * i + 1]);
+        bad |= hi | lo;
+        out[i] = static_cast<uint8_t>((static_cast<uint8_t>(hi) << 4) | (lo & 0x0f));
+    }
+    return bad >= 0;
+}
+
+std::size_t scanScalar(const char* in, std::size_t size)
+{
+    std::size_t i = 0;
+    while (i < size && digit(in[i]) >= 0) {
+        ++i;
+    }
+    return i;
+}
+
+#ifdef HEXCODEC_X86
+
+// 16 bytes to 32 chars
+__attribute__((target("ssse3")))
+inline void encode16(__m128i bytes, char* out)
+{
+    __m128i const lut = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    __m128i const mask = _mm_set1_epi8(0x0f);
+    __m128i const hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+    __m128i const lo = _mm_shuffle_epi8(lut, _mm_and_si128(bytes, mask));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), _mm_unpackhi_epi8(hi, lo));
+}
+
+__attribute__((target("ssse3")))
+void encodeSSSE3(const uint8_t* data, std::size_t size, char* out)
+{
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        encode16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), out + 2 * i);
+    }
+    encodeScalar(data + i, size - i, out + 2 * i);
+}
+
+__attribute__((target("ssse3")))
+void encodeReversedSSSE3(const uint8_t* data, std::size_t size, char* out)
+{
+    __m128i const reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i const bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + size - i - 16));
+        encode16(_mm_shuffle_epi8(bytes, reverse), out + 2 * i);
+    }
+    encodeReversedScalar(data, size - i, out + 2 * i);
+}
+
+// Nibble values of 16 chars, valid is cleared on any other char than a hex digit
+__attribute__((target("ssse3")))
+inline __m128i nibbles16(__m128i chars, __m128i& valid)
+{
+    __m128i const isDigit = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)),
+                                          _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+    __m128i const lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+    __m128i const isAlpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                          _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    valid = _mm_and_si128(valid, _mm_or_si128(isDigit, isAlpha));
+    return _mm_or_si128(_mm_and_si128(isDigit, _mm_sub_epi8(chars, _mm_set1_epi8('0'))),
+                        _mm_and_si128(isAlpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+}
+
+__attribute__((target("ssse3")))
+bool decodeSSSE3(const char* in, std::size_t size, uint8_t* out)
+{
+    __m128i const weights = _mm_set1_epi16(0x0110);
+    __m128i valid = _mm_set1_epi8(-1);
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i const a = nibbles16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i)), valid);
+        __m128i const b = nibbles16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i + 16)), valid);
+        // High nibble * 16 + low nibble of each pair
+        __m128i const bytes = _mm_packus_epi16(_mm_maddubs_epi16(a, weights), _mm_maddubs_epi16(b, weights));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), bytes);
+    }
+    return _mm_movemask_epi8(valid) == 0xffff && decodeScalar(in + 2 * i, size - i, out + i);
+}
+
+__attribute__((target("sse2")))
+std::size_t scanSSE(const char* in, std::size_t size)
+{
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i const chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i const isDigit = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)),
+                                              _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+        __m128i const lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+        __m128i const isAlpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                              _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+        int const mask = _mm_movemask_epi8(_mm_or_si128(isDigit, isAlpha));
+        if (mask != 0xffff) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+    return i + scanScalar(in + i, size - i);
+}
+
+__attribute__((target("avx2")))
+void encodeAVX2(const uint8_t* data, std::size_t size, char* out)
+{
+    __m256i const lut = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+                                         '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    __m256i const mask = _mm256_set1_epi8(0x0f);
+    std::size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i const bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i const hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), mask));
+        __m256i const lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(bytes, mask));
+        // Unpacking works per 128 bit lane, put the lanes back in order
+        __m256i const first = _mm256_unpacklo_epi8(hi, lo);
+        __m256i const second = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i), _mm256_permute2x128_si256(first, second, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i + 32), _mm256_permute2x128_si256(first, second, 0x31));
+    }
+    encodeSSSE3(data + i, size - i, out + 2 * i);
+}
+
+__attribute__((target("avx2")))
+inline __m256i nibbles32(__m256i chars, __m256i& valid)
+{
+    __m256i const isDigit = _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('0' - 1)),
+                                             _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chars));
+    __m256i const lower = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+    __m256i const isAlpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                             _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lower));
+    valid = _mm256_and_si256(valid, _mm256_or_si256(isDigit, isAlpha));
+    return _mm256_or_si256(_mm256_and_si256(isDigit, _mm256_sub_epi8(chars, _mm256_set1_epi8('0'))),
+                           _mm256_and_si256(isAlpha, _mm256_sub_epi8(lower, _mm256_set1_epi8('a' - 10))));
+}
+
+__attribute__((target("avx2")))
+bool decodeAVX2(const char* in, std::size_t size, uint8_t* out)
+{
+    __m256i const weights = _mm256_set1_epi16(0x0110);
+    __m256i valid = _mm256_set1_epi8(-1);
+    std::size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i const a = nibbles32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * i)), valid);
+        __m256i const b = nibbles32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * i + 32)), valid);
+        // Packing works per 128 bit lane as well
+        __m256i const bytes = _mm256_packus_epi16(_mm256_maddubs_epi16(a, weights), _mm256_maddubs_epi16(b, weights));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_permute4x64_epi64(bytes, 0xd8));
+    }
+    return _mm256_movemask_epi8(valid) == -1 && decodeSSSE3(in + 2 * i, size - i, out + i);
+}
+
+#endif // HEXCODEC_X86
+
+Impl detect()
+{
+#ifdef HEXCODEC_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return Impl::AVX2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return Impl::SSSE3;
+    }
+#endif
+    return Impl::Scalar;
+}
+
+Impl const c_supported = detect();
+std::atomic<Impl> s_impl(c_supported);
+
+} // namespace
+
+Impl impl()
+{
+    return s_impl.load(std::memory_order_relaxed);
+}
+
+const char* implName(Impl impl)
+{
+    switch (impl) {
+    case Impl::AVX2:
+        return "avx2";
+    case Impl::SSSE3:
+        return "ssse3";
+    default:
+        return "scalar";
+    }
+}
+
+void setImpl(Impl impl)
+{
+    s_impl.store(std::min(impl, c_supported), std::memory_order_relaxed);
+}
+
+void encode(const uint8_t* data, std::size_t size, char* out)
+{
+#ifdef HEXCODEC_X86
+    switch (impl()) {
+    case Impl::AVX2:
+        return encodeAVX2(data, size, out);
+    case Impl::SSSE3:
+        return encodeSSSE3(data, size, out);
+    default:
+        break;
+    }
+#endif
+    encodeScalar(data, size, out);
+}
+
+void encodeReversed(const uint8_t* data, std::size_t size, char* out)
+{
+#ifdef HEXCODEC_X86
+    if (impl() != Impl::Scalar) {
+        return encodeReversedSSSE3(data, size, out);
+    }
+#endif
+    encodeReversedScalar(data, size, out);
+}
+
+void encodeUint32(uint32_t value, char* out)
+{
+    encodeByte(static_cast<uint8_t>(value >> 24), out);
+    encodeByte(static_cast<uint8_t>(value >> 16), out + 2);
+    encodeByte(static_cast<uint8_t>(value >> 8), out + 4);
+    encodeByte(static_cast<uint8_t>(value), out + 6);
+}
+
+bool decode(const char* in, std::size_t size, uint8_t* out)
+{
+#ifdef HEXCODEC_X86
+    switch (impl()) {
+    case Impl::AVX2:
+        return decodeAVX2(in, size, out);
+    case Impl::SSSE3:
+        return decodeSSSE3(in, size, out);
+    default:
+        break;
+    }
+#endif
+    return decodeScalar(in, size, out);
+}
+
+std::size_t scan(const char* in, std::size_t size)
+{
+#ifdef HEXCODEC_X86
+    if (impl() != Impl::Scalar) {
+        return scanSSE(in, size);
+    }
+#endif
+    return scanScalar(in, size);
+}
+
+} // namespace hex
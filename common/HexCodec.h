@@ -0,0 +1,63 @@
+/*
+ * HexCodec.h
+ *
+ *  Lowercase hex encoding and decoding into caller provided buffers.
+ */
+
+#ifndef ENERGIMINER_HEXCODEC_H_
+#define ENERGIMINER_HEXCODEC_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace hex
+{
+
+/// Values of the hex digits, -1 for any other char
+extern const signed char c_digits[256];
+/// The two chars of each byte value, at twice the value
+extern const char c_pairs[513];
+
+inline signed char digit(char c)
+{
+    return c_digits[static_cast<unsigned char>(c)];
+}
+
+inline void encodeByte(uint8_t value, char* out)
+{
+    out[0] = c_pairs[2 * value];
+    out[1] = c_pairs[2 * value + 1];
+}
+
+/**
+ * Implementations, the best one the CPU supports is picked at startup. SSSE3 and AVX2 are only
+ * built with GCC and Clang on x86, everything else uses the table driven scalar code.
+ */
+enum class Impl { Scalar, SSSE3, AVX2 };
+
+Impl impl();
+const char* implName(Impl impl);
+/// Forces an implementation, falling back to the best supported one below it
+void setImpl(Impl impl);
+
+/// Writes the 2 * size chars of [data, data + size) to out, without terminator
+void encode(const uint8_t* data, std::size_t size, char* out);
+
+/// Like encode() with the bytes taken from last to first, the way uint256 prints
+void encodeReversed(const uint8_t* data, std::size_t size, char* out);
+
+/// Writes value as 8 digits, most significant first
+void encodeUint32(uint32_t value, char* out);
+
+/**
+ * @brief Decodes the 2 * size chars at in into size bytes at out.
+ * @return false if a char is no hex digit, out is undefined then
+ */
+bool decode(const char* in, std::size_t size, uint8_t* out);
+
+/// Number of hex digits at the start of [in, in + size)
+std::size_t scan(const char* in, std::size_t size);
+
+} // namespace hex
+
+#endif // ENERGIMINER_HEXCODEC_H_
@@ -22,6 +22,11 @@
 #include "Log.h"
 #include "common.h"
 
+#include "MpscRing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <iomanip>
 #include <iostream>
 #include <mutex>
@@ -55,22 +60,285 @@ const char* NoteChannel::name()
     return EthBlue " i";
 }
 
+namespace {
+
+/// Log state of a thread, reused by all its log lines
+struct LogThreadState
+{
+    LogThreadState()
+    {
+        stream.imbue(std::locale(""));
+        flags = stream.flags();
+    }
+
+    std::ostringstream stream;
+    std::ios_base::fmtflags flags;
+    bool busy = false;
+    // Time of day of the last line, formatted once per second
+    time_t second = 0;
+    char time[24] = "";
+    // Thread name, read from the OS once
+    std::string name;
+    bool named = false;
+};
+
+LogThreadState& logThreadState()
+{
+    thread_local LogThreadState state;
+    return state;
+}
+
+const char* timeOfDay(LogThreadState& state)
+{
+    time_t const now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    if (now != state.second) {
+        state.second = now;
+        struct tm local;
+#ifdef _WIN32
+        bool const ok = localtime_s(&local, &now) == 0;
+#else
+        bool const ok = localtime_r(&now, &local) != nullptr;
+#endif
+        if (!ok || strftime(state.time, sizeof(state.time), "%X", &local) == 0)
+            state.time[0] = '\0';  // empty if case strftime fails
+    }
+    return state.time;
+}
+
+struct LogRecord
+{
+    std::string text;
+    std::size_t prefixSize = 0;
+};
+
+/**
+ * Writes the queued log lines to stderr from its own thread. A line repeating the message of
+ * the previous one is held back and summed up once another message comes or c_repeatWindow
+ * passed.
+ */
+class LogWriter
+{
+public:
+    static const std::size_t c_capacity = 4096;
+    static constexpr std::chrono::seconds c_repeatWindow{5};
+    static constexpr std::chrono::milliseconds c_idleWait{100};
+
+    LogWriter()
+        : m_ring(c_capacity)
+        , m_thread(&LogWriter::run, this)
+    {
+    }
+
+    ~LogWriter()
+    {
+        s_gone = true;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wakeup.notify_one();
+        m_thread.join();
+    }
+
+    /// Never blocks, a line is dropped if the ring is full
+    void post(LogRecord&& record)
+    {
+        if (!m_ring.tryPush(std::move(record))) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (m_sleeping.load(std::memory_order_seq_cst)) {
+            m_wakeup.notify_one();
+        }
+    }
+
+    /// Set once the writer is being destroyed, later lines are written directly
+    static std::atomic<bool> s_gone;
+
+private:
+    void run()
+    {
+        setThreadName("log");
+        std::string batch;
+        LogRecord record;
+        for (;;) {
+            batch.clear();
+            while (m_ring.tryPop(record)) {
+                write(batch, record);
+            }
+            if (uint64_t const dropped = m_dropped.exchange(0, std::memory_order_relaxed)) {
+                batch += EthRed " X" EthReset " " + std::to_string(dropped) + " log lines dropped\n";
+            }
+            if (m_repeats && std::chrono::steady_clock::now() - m_repeatStart >= c_repeatWindow) {
+                writeRepeats(batch);
+            }
+            if (!batch.empty()) {
+                output(batch);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_stop) {
+                break;
+            }
+            // A producer checks m_sleeping after pushing, the recheck catches a push before it was set
+            m_sleeping.store(true, std::memory_order_seq_cst);
+            if (!m_ring.tryPop(record)) {
+                m_wakeup.wait_for(lock, c_idleWait);
+                m_sleeping.store(false, std::memory_order_relaxed);
+                continue;
+            }
+            m_sleeping.store(false, std::memory_order_relaxed);
+            lock.unlock();
+            write(batch, record);
+            output(batch);
+        }
+
+        // Drain what came before stopping
+        batch.clear();
+        while (m_ring.tryPop(record)) {
+            write(batch, record);
+        }
+        writeRepeats(batch);
+        output(batch);
+    }
+
+    void write(std::string& batch, LogRecord& record)
+    {
+        std::size_t const prefixSize = std::min(record.prefixSize, record.text.size());
+        bool const repeated = m_last.size() == record.text.size() - prefixSize
+            && record.text.compare(prefixSize, std::string::npos, m_last) == 0;
+        if (repeated) {
+            if (!m_repeats) {
+                m_repeatStart = std::chrono::steady_clock::now();
+            }
+            ++m_repeats;
+            m_repeatPrefix.assign(record.text, 0, prefixSize);
+            return;
+        }
+        writeRepeats(batch);
+        m_last.assign(record.text, prefixSize, std::string::npos);
+        batch += record.text;
+        batch += '\n';
+    }
+
+    void writeRepeats(std::string& batch)
+    {
+        if (!m_repeats) {
+            return;
+        }
+        batch += m_repeatPrefix;
+        batch += "last message repeated " + std::to_string(m_repeats) + (m_repeats == 1 ? " time\n" : " times\n");
+        m_repeats = 0;
+        // Counted afresh from the next occurrence
+        m_last.clear();
+    }
+
+    static void output(const std::string& batch)
+    {
+        if (batch.empty()) {
+            return;
+        }
+        try {
+            if (!g_logNoColor) {
+                std::cerr << batch;
+            } else {
+                std::string plain;
+                plain.reserve(batch.size());
+                bool skip = false;
+                for (char c : batch) {
+                    if (!skip && c == '\x1b')
+                        skip = true;
+                    else if (skip && c == 'm')
+                        skip = false;
+                    else if (!skip)
+                        plain.push_back(c);
+                }
+                std::cerr << plain;
+            }
+            std::cerr.flush();
+        } catch (...) {
+        }
+    }
+
+    MpscRing<LogRecord> m_ring;
+    std::atomic<uint64_t> m_dropped = {0};
+    std::atomic<bool> m_sleeping = {false};
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    bool m_stop = false;
+
+    // Repeat suppression, only used by the writer thread
+    std::string m_last;
+    std::string m_repeatPrefix;
+    unsigned m_repeats = 0;
+    std::chrono::steady_clock::time_point m_repeatStart;
+
+    std::thread m_thread;
+};
+
+const std::size_t LogWriter::c_capacity;
+constexpr std::chrono::seconds LogWriter::c_repeatWindow;
+constexpr std::chrono::milliseconds LogWriter::c_idleWait;
+std::atomic<bool> LogWriter::s_gone = {false};
+
+LogWriter& logWriter()
+{
+    static LogWriter writer;
+    return writer;
+}
+
+}  // namespace
+
 LogOutputStreamBase::LogOutputStreamBase(char const* _id, unsigned _v) : m_verbosity(_v)
 {
-    static std::locale logLocl = std::locale("");
     if ((int)_v <= g_logVerbosity) {
-        m_sstr.imbue(logLocl);
+        LogThreadState& state = logThreadState();
+        if (!state.busy) {
+            state.busy = true;
+            // Formatting set by the previous line must not leak into this one
+            state.stream.str(std::string());
+            state.stream.clear();
+            state.stream.flags(state.flags);
+            state.stream.precision(6);
+            state.stream.fill(' ');
+            m_sstr = &state.stream;
+        } else {
+            // An object logged from within operator<< of another log line
+            m_sstr = new std::ostringstream;
+            m_sstr->imbue(state.stream.getloc());
+            m_ownStream = true;
+        }
         if (g_logSyslog)
-            m_sstr << std::left << std::setw(8) << getThreadName() << " " EthReset;
+            *m_sstr << std::left << std::setw(8) << getThreadName() << " " EthReset;
         else {
-            time_t rawTime = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-            char buf[24];
-            if (strftime(buf, 24, "%X", localtime(&rawTime)) == 0)
-                buf[0] = '\0';  // empty if case strftime fails
-            m_sstr << _id << " " EthViolet << buf << " " EthBlue << std::left << std::setw(8)
-                   << getThreadName() << " " EthReset;
+            *m_sstr << _id << " " EthViolet << timeOfDay(state) << " " EthBlue << std::left << std::setw(8)
+                    << getThreadName() << " " EthReset;
         }
+        m_prefixSize = std::size_t(m_sstr->tellp());
+    }
+}
+
+LogOutputStreamBase::~LogOutputStreamBase()
+{
+    if (m_ownStream)
+        delete m_sstr;
+    else if (m_sstr)
+        logThreadState().busy = false;
+}
+
+void LogOutputStreamBase::post()
+{
+    if (!m_sstr)
+        return;
+    if (LogWriter::s_gone.load(std::memory_order_relaxed)) {
+        simpleDebugOut(m_sstr->str());
+        return;
     }
+    LogRecord record;
+    record.text = m_sstr->str();
+    record.prefixSize = m_prefixSize;
+    logWriter().post(std::move(record));
 }
 
 
@@ -88,10 +356,15 @@ ThreadLocalLogName g_logThreadName("main");
 string energi::getThreadName()
 {
 #if defined(__linux__) || defined(__APPLE__)
-    char buffer[128];
-    pthread_getname_np(pthread_self(), buffer, 127);
-    buffer[127] = 0;
-    return buffer;
+    LogThreadState& state = logThreadState();
+    if (!state.named) {
+        char buffer[128];
+        pthread_getname_np(pthread_self(), buffer, 127);
+        buffer[127] = 0;
+        state.name = buffer;
+        state.named = true;
+    }
+    return state.name;
 #else
     return ThreadLocalLogName::name ? ThreadLocalLogName::name : "<unknown>";
 #endif
@@ -99,6 +372,14 @@ string energi::getThreadName()
 
 void energi::setThreadName(char const* _n)
 {
+#if defined(__linux__) || defined(__APPLE__)
+    // Called for every event on shared threads, the OS is only told about changes
+    LogThreadState& state = logThreadState();
+    if (state.named && state.name == _n)
+        return;
+    state.name = _n;
+    state.named = true;
+#endif
 #if defined(__linux__)
     pthread_setname_np(pthread_self(), _n);
 #elif defined(__APPLE__)
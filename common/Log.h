@@ -68,20 +68,30 @@ struct NoteChannel : public LogChannel
     static const char* name();
 };
 
+/**
+ * Formats a log line into a stream the thread reuses and queues it for a background writer,
+ * see post(). Logging never waits for the output, lines are dropped while the queue is full.
+ */
 class LogOutputStreamBase
 {
 public:
     LogOutputStreamBase(char const* _id, unsigned _v);
+    ~LogOutputStreamBase();
 
     template <class T>
     void append(T const& _t)
     {
-        m_sstr << _t;
+        *m_sstr << _t;
     }
 
 protected:
+    /// Queues the accrued log entry
+    void post();
+
     unsigned m_verbosity = 0;
-    std::stringstream m_sstr;  ///< The accrued log entry.
+    std::ostringstream* m_sstr = nullptr;  ///< The accrued log entry.
+    std::size_t m_prefixSize = 0;          ///< Length of the channel, time and thread prefix
+    bool m_ownStream = false;              ///< Logging while formatting another entry of the thread
 };
 
 /// Logging class, iostream-like, that can be shifted to.
@@ -94,11 +104,11 @@ public:
     /// with a '|' character.
     LogOutputStream() : LogOutputStreamBase(Id::name(), Id::verbosity) {}
 
-    /// Destructor. Posts the accrued log entry to the g_logPost function.
+    /// Destructor. Posts the accrued log entry to the writer thread.
     ~LogOutputStream()
     {
         if (Id::verbosity <= g_logVerbosity)
-            simpleDebugOut(m_sstr.str());
+            post();
     }
 
     /// Shift arbitrary data to the log. Spaces will be added between items as required.
@@ -0,0 +1,73 @@
+/*
+ * MpscQueue.h
+ *
+ *  Lock-free queue for many producer threads and a single consumer.
+ */
+
+#ifndef ENERGIMINER_MPSCQUEUE_H_
+#define ENERGIMINER_MPSCQUEUE_H_
+
+#include <atomic>
+#include <utility>
+
+/**
+ * @brief Unbounded multi producer, single consumer FIFO (Vyukov's node based queue).
+ *
+ * push() is wait-free apart from allocating the node, so producers such as the hashing threads
+ * never block on the consumer. pop() must only be called from one thread at a time. An element
+ * whose push is still in progress may be missed by pop(), it is returned by a later one.
+ */
+template <typename T>
+class MpscQueue
+{
+public:
+    MpscQueue()
+        : m_head(new Node)
+        , m_tail(m_head.load(std::memory_order_relaxed))
+    {}
+
+    ~MpscQueue()
+    {
+        T value;
+        while (pop(value)) {
+        }
+        delete m_tail;
+    }
+
+    void push(T value)
+    {
+        Node* node = new Node;
+        node->value = std::move(value);
+        Node* prev = m_head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    bool pop(T& value)
+    {
+        Node* next = m_tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+        value = std::move(next->value);
+        delete m_tail;
+        m_tail = next;
+        return true;
+    }
+
+private:
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    struct Node
+    {
+        std::atomic<Node*> next{nullptr};
+        T value;
+    };
+
+    // Last pushed node, producers swap themselves in here
+    std::atomic<Node*> m_head;
+    // Node before the oldest element, only touched by the consumer
+    Node* m_tail;
+};
+
+#endif // ENERGIMINER_MPSCQUEUE_H_
@@ -0,0 +1,93 @@
+/*
+ * MpscRing.h
+ *
+ *  Bounded lock-free ring for many producer threads and a single consumer.
+ */
+
+#ifndef ENERGIMINER_MPSCRING_H_
+#define ENERGIMINER_MPSCRING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/**
+ * @brief Fixed size multi producer, single consumer FIFO (Vyukov's bounded queue).
+ *
+ * Unlike MpscQueue it never allocates after construction, and tryPush() fails instead of
+ * waiting when the ring is full, so producers never block. Each slot carries a sequence number
+ * telling whether it is free for the producer of a position or filled for the consumer.
+ * tryPop() must only be called from one thread at a time.
+ */
+template <typename T>
+class MpscRing
+{
+public:
+    /// capacity is rounded up to a power of two
+    explicit MpscRing(std::size_t capacity)
+    {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_mask = size - 1;
+        m_slots.reset(new Slot[size]);
+        for (std::size_t i = 0; i < size; ++i) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool tryPush(T&& value)
+    {
+        std::size_t position = m_enqueue.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = m_slots[position & m_mask];
+            std::size_t const sequence = slot.sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t const diff = std::ptrdiff_t(sequence) - std::ptrdiff_t(position);
+            if (diff == 0) {
+                if (m_enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    slot.value = std::move(value);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // Full, the consumer has not freed the slot of this position yet
+                return false;
+            } else {
+                position = m_enqueue.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& value)
+    {
+        Slot& slot = m_slots[m_dequeue & m_mask];
+        if (slot.sequence.load(std::memory_order_acquire) != m_dequeue + 1) {
+            return false;
+        }
+        value = std::move(slot.value);
+        slot.sequence.store(m_dequeue + m_mask + 1, std::memory_order_release);
+        ++m_dequeue;
+        return true;
+    }
+
+private:
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    struct Slot
+    {
+        std::atomic<std::size_t> sequence = {0};
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    std::size_t m_mask = 0;
+    // Next position to fill, shared by the producers
+    alignas(64) std::atomic<std::size_t> m_enqueue = {0};
+    // Next position to read, only touched by the consumer
+    alignas(64) std::size_t m_dequeue = 0;
+};
+
+#endif // ENERGIMINER_MPSCRING_H_
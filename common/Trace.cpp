@@ -0,0 +1,366 @@
+/*
+ * Trace.cpp
+ *
+ *  Spans of the work pipeline, exported as Chrome trace JSON.
+ */
+
+#include "Trace.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+namespace energi {
+
+const unsigned Trace::c_events;
+
+const char* const Trace::c_recv = "stratum.recv";
+const char* const Trace::c_notify = "stratum.notify";
+const char* const Trace::c_workBuild = "work.build";
+const char* const Trace::c_plantSetWork = "plant.setWork";
+const char* const Trace::c_minerSetWork = "miner.setWork";
+const char* const Trace::c_hashing = "device.switch";
+const char* const Trace::c_found = "solution.found";
+const char* const Trace::c_verify = "solution.verify";
+const char* const Trace::c_submit = "solution.submit";
+
+std::atomic<bool> Trace::s_enabled(false);
+std::atomic<bool> Trace::s_dumpRequested(false);
+
+namespace {
+
+struct TraceEvent
+{
+    unsigned thread;
+    const char* name;
+    uint64_t job;
+    int64_t startNs;
+    // Negative for instants
+    int64_t durationNs;
+};
+
+/**
+ * Ring of the events of one thread. The thread is the only writer, a dump reads concurrently:
+ * each slot carries a sequence number which is odd while the slot is written, so a reader
+ * skips slots it did not read in one piece. Once its thread exited the buffer is handed to
+ * the next thread, the events of the previous one stay until they are overwritten.
+ */
+class TraceBuffer
+{
+public:
+    TraceBuffer()
+        : m_slots(new Slot[Trace::c_events])
+    {
+    }
+
+    /// Called by the thread taking the buffer over
+    void adopt(unsigned thread)
+    {
+        m_thread = thread;
+    }
+
+    void record(const char* name, uint64_t job, int64_t startNs, int64_t durationNs)
+    {
+        uint64_t const index = m_next++;
+        Slot& slot = m_slots[index % Trace::c_events];
+        slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.thread.store(m_thread, std::memory_order_relaxed);
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.job.store(job, std::memory_order_relaxed);
+        slot.startNs.store(startNs, std::memory_order_relaxed);
+        slot.durationNs.store(durationNs, std::memory_order_relaxed);
+        slot.sequence.store(2 * index + 2, std::memory_order_release);
+    }
+
+    void collect(std::vector<TraceEvent>& events) const
+    {
+        for (unsigned i = 0; i < Trace::c_events; ++i) {
+            const Slot& slot = m_slots[i];
+            uint64_t const sequence = slot.sequence.load(std::memory_order_acquire);
+            if (!sequence || (sequence & 1)) {
+                continue;
+            }
+            TraceEvent event;
+            event.thread = slot.thread.load(std::memory_order_relaxed);
+            event.name = slot.name.load(std::memory_order_relaxed);
+            event.job = slot.job.load(std::memory_order_relaxed);
+            event.startNs = slot.startNs.load(std::memory_order_relaxed);
+            event.durationNs = slot.durationNs.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) == sequence) {
+                events.push_back(event);
+            }
+        }
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> sequence = {0};
+        std::atomic<unsigned> thread = {0};
+        std::atomic<const char*> name = {nullptr};
+        std::atomic<uint64_t> job = {0};
+        std::atomic<int64_t> startNs = {0};
+        std::atomic<int64_t> durationNs = {0};
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    // Only touched by the thread owning the buffer
+    unsigned m_thread = 0;
+    uint64_t m_next = 0;
+};
+
+struct TraceRegistry
+{
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+    // Buffers of the threads which exited
+    std::vector<TraceBuffer*> free;
+    // Names of all the threads which traced, by their number in the dump
+    std::map<unsigned, std::string> threads;
+};
+
+TraceRegistry& registry()
+{
+    // Never destroyed, threads may still trace while the process exits
+    static TraceRegistry* registry = new TraceRegistry;
+    return *registry;
+}
+
+/// Returns the buffer of its thread to the free list when the thread exits
+struct TraceBufferOwner
+{
+    TraceBuffer* buffer = nullptr;
+
+    ~TraceBufferOwner()
+    {
+        if (buffer) {
+            TraceRegistry& traces = registry();
+            std::lock_guard<std::mutex> lock(traces.mutex);
+            traces.free.push_back(buffer);
+        }
+    }
+};
+
+thread_local TraceBufferOwner t_owner;
+
+TraceBuffer& threadBuffer()
+{
+    if (!t_owner.buffer) {
+        TraceRegistry& traces = registry();
+        std::lock_guard<std::mutex> lock(traces.mutex);
+        unsigned const thread = unsigned(traces.threads.size()) + 1;
+        traces.threads[thread] = getThreadName();
+        if (traces.free.empty()) {
+            traces.buffers.emplace_back(new TraceBuffer);
+            t_owner.buffer = traces.buffers.back().get();
+        } else {
+            t_owner.buffer = traces.free.back();
+            traces.free.pop_back();
+        }
+        t_owner.buffer->adopt(thread);
+    }
+    return *t_owner.buffer;
+}
+
+int64_t nanoseconds(Trace::Clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+std::vector<TraceEvent> collectEvents(std::map<unsigned, std::string>* threads)
+{
+    std::vector<TraceEvent> events;
+    TraceRegistry& traces = registry();
+    std::lock_guard<std::mutex> lock(traces.mutex);
+    for (const auto& buffer : traces.buffers) {
+        buffer->collect(events);
+    }
+    if (threads) {
+        for (const TraceEvent& event : events) {
+            (*threads)[event.thread] = traces.threads[event.thread];
+        }
+    }
+    std::sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) {
+        return a.startNs < b.startNs;
+    });
+    return events;
+}
+
+std::string quoted(const std::string& text)
+{
+    std::string result = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+            result += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            result += ' ';
+        } else {
+            result += c;
+        }
+    }
+    return result + "\"";
+}
+
+// Microseconds, as Chrome traces count time
+std::string micros(int64_t ns)
+{
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.3f", ns / 1000.0);
+    return text;
+}
+
+std::string hexId(uint64_t id)
+{
+    char text[24];
+    std::snprintf(text, sizeof(text), "0x%016llx", static_cast<unsigned long long>(id));
+    return text;
+}
+
+std::string percentiles(const char* name, const char* unit, std::vector<int64_t>& values)
+{
+    std::sort(values.begin(), values.end());
+    auto const at = [&values](double percentile) {
+        std::size_t const rank = std::size_t(std::ceil(percentile / 100.0 * values.size()));
+        return values[std::max<std::size_t>(rank, 1) - 1] / 1000;
+    };
+    std::ostringstream line;
+    line << name << ": " << values.size() << ' ' << unit << ", p50 " << at(50) << " us, p90 " << at(90)
+         << " us, p99 " << at(99) << " us, max " << values.back() / 1000 << " us";
+    return line.str();
+}
+
+} // namespace
+
+uint64_t Trace::jobId(const std::string& jobName)
+{
+    if (jobName.empty()) {
+        return 0;
+    }
+    uint64_t const id = std::hash<std::string>()(jobName);
+    return id ? id : 1;
+}
+
+void Trace::complete(const char* name, Clock::time_point start, Clock::time_point end, const std::string& jobName)
+{
+    if (!enabled()) {
+        return;
+    }
+    int64_t const startNs = nanoseconds(start);
+    threadBuffer().record(name, jobId(jobName), startNs, std::max<int64_t>(nanoseconds(end) - startNs, 0));
+}
+
+void Trace::instant(const char* name, const std::string& jobName)
+{
+    if (!enabled()) {
+        return;
+    }
+    threadBuffer().record(name, jobId(jobName), nanoseconds(Clock::now()), -1);
+}
+
+bool Trace::dump(const std::string& path)
+{
+    std::map<unsigned, std::string> threads;
+    std::vector<TraceEvent> const events = collectEvents(&threads);
+
+    std::ofstream out(path, std::ios::out | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+    int64_t const origin = events.empty() ? 0 : events.front().startNs;
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"energiminer\"}}";
+    for (const auto& thread : threads) {
+        std::string const name = thread.second.empty() ? "thread " + std::to_string(thread.first) : thread.second;
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread.first
+            << ",\"args\":{\"name\":" << quoted(name) << "}}";
+    }
+
+    // The stages of a job follow each other across threads, linked by a flow
+    std::unordered_map<uint64_t, std::vector<std::size_t>> jobStages;
+    for (std::size_t i = 0; i < events.size(); ++i) {
+        const TraceEvent& event = events[i];
+        out << ",\n{\"name\":" << quoted(event.name) << ",\"cat\":\"miner\",\"pid\":1,\"tid\":" << event.thread
+            << ",\"ts\":" << micros(event.startNs - origin);
+        if (event.durationNs < 0) {
+            out << ",\"ph\":\"i\",\"s\":\"t\"";
+        } else {
+            out << ",\"ph\":\"X\",\"dur\":" << micros(event.durationNs);
+            if (event.job) {
+                jobStages[event.job].push_back(i);
+            }
+        }
+        if (event.job) {
+            out << ",\"args\":{\"job\":\"" << hexId(event.job) << "\"}";
+        }
+        out << "}";
+    }
+    for (const auto& stages : jobStages) {
+        if (stages.second.size() < 2) {
+            continue;
+        }
+        for (std::size_t i = 0; i < stages.second.size(); ++i) {
+            const TraceEvent& event = events[stages.second[i]];
+            char const* const phase = i == 0 ? "s" : i + 1 < stages.second.size() ? "t" : "f";
+            out << ",\n{\"name\":\"job\",\"cat\":\"job\",\"ph\":\"" << phase << "\",\"id\":\"" << hexId(stages.first)
+                << "\",\"pid\":1,\"tid\":" << event.thread << ",\"ts\":" << micros(event.startNs - origin);
+            if (i + 1 == stages.second.size()) {
+                out << ",\"bp\":\"e\"";
+            }
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+    out.close();
+    return !out.fail();
+}
+
+std::vector<std::string> Trace::summary()
+{
+    std::vector<TraceEvent> const events = collectEvents(nullptr);
+
+    std::map<std::string, std::vector<int64_t>> stages;
+    // Per job its first event and the latest a device started hashing on it
+    std::unordered_map<uint64_t, std::pair<int64_t, int64_t>> jobs;
+    for (const TraceEvent& event : events) {
+        if (event.durationNs >= 0) {
+            stages[event.name].push_back(event.durationNs);
+        }
+        if (!event.job) {
+            continue;
+        }
+        auto const found = jobs.emplace(event.job, std::make_pair(event.startNs, int64_t(-1)));
+        auto& job = found.first->second;
+        job.first = std::min(job.first, event.startNs);
+        if (event.name == c_hashing) {
+            job.second = std::max(job.second, event.startNs + event.durationNs);
+        }
+    }
+
+    std::vector<std::string> lines;
+    for (auto& stage : stages) {
+        lines.push_back(percentiles(stage.first.c_str(), "spans", stage.second));
+    }
+    std::vector<int64_t> untilHashing;
+    for (const auto& job : jobs) {
+        if (job.second.second >= 0) {
+            untilHashing.push_back(job.second.second - job.second.first);
+        }
+    }
+    if (!untilHashing.empty()) {
+        lines.push_back(percentiles("job until all devices hash", "jobs", untilHashing));
+    }
+    return lines;
+}
+
+} /* namespace energi */
@@ -0,0 +1,132 @@
+/*
+ * Trace.h
+ *
+ *  Spans of the work pipeline, exported as Chrome trace JSON.
+ */
+
+#ifndef ENERGIMINER_TRACE_H_
+#define ENERGIMINER_TRACE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace energi {
+
+/**
+ * @brief Lightweight tracing of the stages a job goes through, from the notify read off the
+ * socket until every device hashes on it, and of the solutions found on it.
+ *
+ * Every thread records into its own fixed ring of events, so recording is a few relaxed
+ * stores without locks and the oldest events are overwritten once a ring is full. While
+ * tracing is disabled a span costs a single relaxed load. Events carry the id of their job,
+ * which ties the stages running on different threads together in the trace and in the
+ * summary.
+ */
+class Trace
+{
+public:
+    /// Events kept per thread
+    static const unsigned c_events = 8192;
+
+    using Clock = std::chrono::steady_clock;
+
+    static bool enabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+    static void enable(bool enabled)
+    {
+        s_enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    /// Id of the job named jobName, 0 if it has no name
+    static uint64_t jobId(const std::string& jobName);
+
+    /// Records a stage which ran from start to end
+    static void complete(const char* name, Clock::time_point start, Clock::time_point end,
+                         const std::string& jobName = std::string());
+    /// Records a point in time, like the first hash on a job
+    static void instant(const char* name, const std::string& jobName = std::string());
+
+    /**
+     * @brief Writes the events recorded so far as Chrome trace JSON, which chrome://tracing
+     * and Perfetto load. Stages of a job are linked by flow arrows.
+     * @return false if the file can't be written
+     */
+    static bool dump(const std::string& path);
+
+    /// Percentile latencies of each stage and of jobs until all devices hash, one per line
+    static std::vector<std::string> summary();
+
+    /// Asks for a dump from a signal handler, see dumpRequested()
+    static void requestDump()
+    {
+        s_dumpRequested.store(true, std::memory_order_relaxed);
+    }
+    /// Whether a dump was requested since the last call
+    static bool dumpRequested()
+    {
+        return s_dumpRequested.exchange(false, std::memory_order_relaxed);
+    }
+
+    /// Names of the events
+    static const char* const c_recv;
+    static const char* const c_notify;
+    static const char* const c_workBuild;
+    static const char* const c_plantSetWork;
+    static const char* const c_minerSetWork;
+    static const char* const c_hashing;
+    static const char* const c_found;
+    static const char* const c_verify;
+    static const char* const c_submit;
+
+private:
+    static std::atomic<bool> s_enabled;
+    static std::atomic<bool> s_dumpRequested;
+};
+
+/**
+ * @brief Records the scope it lives in as a stage, when tracing was enabled at its creation.
+ */
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char* name)
+        : m_name(Trace::enabled() ? name : nullptr)
+    {
+        if (m_name) {
+            m_start = Trace::Clock::now();
+        }
+    }
+
+    TraceSpan(const char* name, const std::string& jobName)
+        : TraceSpan(name)
+    {
+        if (m_name) {
+            m_jobName = &jobName;
+        }
+    }
+
+    ~TraceSpan()
+    {
+        if (m_name) {
+            Trace::complete(m_name, m_start, Trace::Clock::now(), m_jobName ? *m_jobName : std::string());
+        }
+    }
+
+private:
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    const char* m_name;
+    // Must outlive the span
+    const std::string* m_jobName = nullptr;
+    Trace::Clock::time_point m_start;
+};
+
+} /* namespace energi */
+
+#endif /* ENERGIMINER_TRACE_H_ */
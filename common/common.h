@@ -9,6 +9,7 @@
 #define ENERGIMINER_COMMON_H_
 
 #include "Log.h"
+#include "HexCodec.h"
 #include "portable_endian.h"
 #include <cstdint>
 #include <cstring>
@@ -183,15 +184,9 @@ inline void setBuffer(const uint8_t* ptr, uint32_t value)
 
 inline std::string strToHex(const std::string& str)
 {
-    std::ostringstream result;
-    for (const auto& item : str) {
-        result << std::hex
-              << std::setfill('0')
-              << std::setw(2)
-              << std::nouppercase
-              << static_cast<unsigned int>(static_cast<unsigned char>(item));
-    }
-    return result.str();
+    std::string result(str.size() * 2, '\0');
+    hex::encode(reinterpret_cast<const uint8_t*>(str.data()), str.size(), &result[0]);
+    return result;
 }
 
 inline bool setenv(const char name[], const char value[], bool over = false)
@@ -6,7 +6,6 @@
 #ifndef BITCOIN_STREAMS_H
 #define BITCOIN_STREAMS_H
 
-#include "ZeroAfterFreeAllocator.h"
 #include "serialize.h"
 
 #include <algorithm>
@@ -30,7 +29,8 @@
 class CDataStream
 {
 protected:
-    typedef CSerializeData vector_type;
+    // Serialized blocks and transactions are public, the buffer is not wiped on release
+    typedef std::vector<char> vector_type;
     vector_type vch;
     unsigned int nReadPos;
 public:
@@ -69,11 +69,6 @@ public:
         Init(nTypeIn, nVersionIn);
     }
 
-    CDataStream(const std::vector<char>& vchIn, int nTypeIn, int nVersionIn) : vch(vchIn.begin(), vchIn.end())
-    {
-        Init(nTypeIn, nVersionIn);
-    }
-
     CDataStream(const std::vector<unsigned char>& vchIn, int nTypeIn, int nVersionIn) : vch(vchIn.begin(), vchIn.end())
     {
         Init(nTypeIn, nVersionIn);
@@ -299,7 +294,7 @@ public:
         return (*this);
     }
 
-    void GetAndClear(CSerializeData &data) {
+    void GetAndClear(vector_type &data) {
         data.insert(data.end(), begin(), end());
         clear();
     }
@@ -328,6 +323,56 @@ public:
     }
 };
 
+/** Reads serialized data in place from a buffer owned by the caller, where CDataStream
+ * would first copy it.
+ */
+class CByteReader
+{
+private:
+    const char* pbegin;
+    const char* pend;
+public:
+    int nType;
+    int nVersion;
+
+    CByteReader(const unsigned char* data, size_t size, int nTypeIn, int nVersionIn)
+        : pbegin(reinterpret_cast<const char*>(data)), pend(pbegin + size), nType(nTypeIn), nVersion(nVersionIn)
+    {
+    }
+
+    size_t size() const          { return pend - pbegin; }
+    bool empty() const           { return pbegin == pend; }
+    bool eof() const             { return empty(); }
+    int GetType() const          { return nType; }
+    int GetVersion() const       { return nVersion; }
+
+    CByteReader& read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CByteReader::read(): end of data");
+        memcpy(pch, pbegin, nSize);
+        pbegin += nSize;
+        return (*this);
+    }
+
+    CByteReader& ignore(int nSize)
+    {
+        assert(nSize >= 0);
+        if ((size_t)nSize > size())
+            throw std::ios_base::failure("CByteReader::ignore(): end of data");
+        pbegin += nSize;
+        return (*this);
+    }
+
+    template<typename T>
+    CByteReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 
 
 
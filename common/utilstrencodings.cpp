@@ -5,6 +5,7 @@
 
 #include "utilstrencodings.h"
 #include "tinyformat.h"
+#include "HexCodec.h"
 
 #include <sstream>
 #include <cstdlib>
@@ -33,63 +34,48 @@ string SanitizeString(const string& str, int rule)
     return strResult;
 }
 
-const signed char p_util_hexdigit[256] =
-{ -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-  0,1,2,3,4,5,6,7,8,9,-1,-1,-1,-1,-1,-1,
-  -1,0xa,0xb,0xc,0xd,0xe,0xf,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-  -1,0xa,0xb,0xc,0xd,0xe,0xf,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
-  -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, };
-
 signed char HexDigit(char c)
 {
-    return p_util_hexdigit[(unsigned char)c];
+    return hex::digit(c);
 }
 
 bool IsHex(const string& str)
 {
-    for(std::string::const_iterator it(str.begin()); it != str.end(); ++it)
-    {
-        if (HexDigit(*it) < 0)
-            return false;
-    }
-    return (str.size() > 0) && (str.size()%2 == 0);
+    return (str.size() > 0) && (str.size()%2 == 0) && hex::scan(str.data(), str.size()) == str.size();
 }
 
-vector<unsigned char> ParseHex(const char* psz)
+static vector<unsigned char> ParseHex(const char* psz, const char* pend)
 {
-    // convert hex dump to vector
+    // convert hex dump to vector, whitespace is allowed between the bytes
     vector<unsigned char> vch;
+    vch.reserve((pend - psz) / 2);
     while (true)
     {
-        while (isspace(*psz))
+        while (psz < pend && isspace(*psz))
             psz++;
-        signed char c = HexDigit(*psz++);
-        if (c == (signed char)-1)
-            break;
-        unsigned char n = (c << 4);
-        c = HexDigit(*psz++);
-        if (c == (signed char)-1)
+        size_t const digits = hex::scan(psz, pend - psz);
+        size_t const bytes = digits / 2;
+        if (bytes > 0) {
+            size_t const offset = vch.size();
+            vch.resize(offset + bytes);
+            hex::decode(psz, bytes, &vch[offset]);
+            psz += bytes * 2;
+        }
+        // An odd digit is dropped like any other trailing garbage
+        if (digits % 2 != 0 || psz >= pend || !isspace(*psz))
             break;
-        n |= c;
-        vch.push_back(n);
     }
     return vch;
 }
 
+vector<unsigned char> ParseHex(const char* psz)
+{
+    return ParseHex(psz, psz + strlen(psz));
+}
+
 vector<unsigned char> ParseHex(const string& str)
 {
-    return ParseHex(str.c_str());
+    return ParseHex(str.data(), str.data() + str.size());
 }
 
 string EncodeBase64(const unsigned char* pch, size_t len)
@@ -13,6 +13,8 @@
 #include <string>
 #include <vector>
 
+#include "HexCodec.h"
+
 #define BEGIN(a)            ((char*)&(a))
 #define END(a)              ((char*)&((&(a))[1]))
 #define UBEGIN(a)           ((unsigned char*)&(a))
@@ -81,16 +83,21 @@ template<typename T>
 std::string HexStr(const T itbegin, const T itend, bool fSpaces=false)
 {
     std::string rv;
-    static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
-                                     '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+    if (!fSpaces) {
+        rv.resize((itend-itbegin)*2);
+        char* out = &rv[0];
+        for(T it = itbegin; it < itend; ++it, out += 2)
+            hex::encodeByte((unsigned char)(*it), out);
+        return rv;
+    }
     rv.reserve((itend-itbegin)*3);
     for(T it = itbegin; it < itend; ++it)
     {
-        unsigned char val = (unsigned char)(*it);
-        if(fSpaces && it != itbegin)
+        char pair[2];
+        hex::encodeByte((unsigned char)(*it), pair);
+        if(it != itbegin)
             rv.push_back(' ');
-        rv.push_back(hexmap[val>>4]);
-        rv.push_back(hexmap[val&15]);
+        rv.append(pair, 2);
     }
 
     return rv;
@@ -11,8 +11,8 @@
 
 using namespace energi;
 
-CpuMiner::CpuMiner(const Plant &plant, int index)
-    :Miner("CPU/", plant, index)
+CpuMiner::CpuMiner(const Plant &plant, int index, unsigned device)
+    :Miner("CPU/", plant, index, device)
 {
 }
 
@@ -36,25 +36,27 @@ void CpuMiner::trun()
             if (!m_dagLoaded || ((work.nHeight / nrghash::constants::EPOCH_LENGTH) != (m_lastHeight / nrghash::constants::EPOCH_LENGTH))) {
                 static std::mutex mtx;
                 std::lock_guard<std::mutex> lock(mtx);
+                m_telemetry.dag(DagState::Loading, work.nHeight / nrghash::constants::EPOCH_LENGTH);
                 LoadNrgHashDAG(work.nHeight);
                 cnote << "End initialising";
                 m_dagLoaded = true;
+                m_telemetry.dag(DagState::Ready, work.nHeight / nrghash::constants::EPOCH_LENGTH);
             }
             m_lastHeight = work.nHeight;
+            m_telemetry.workHeight(work.nHeight);
 
             startNonce = m_plant.getStartNonce(work, m_index);
 
             work.nNonce = startNonce;
             uint64_t lastNonce = startNonce;
             m_newWorkAssigned = false;
+            hashingStarted(work);
             // we dont use mixHash part to calculate hash but fill it later (below)
             do {
                 auto hash = GetPOWHash(work);
                 if (UintToArith256(hash) < work.hashTarget) {
-                    updateHashRate(work.nNonce + 1 - lastNonce);
-                    Solution sol = Solution(work, work.getSecondaryExtraNonce());
                     cnote << name() << "Submitting block blockhash: " << work.GetHash().ToString() << " height: " << work.nHeight << "nonce: " << work.nNonce;
-                    m_plant.submitProof(Solution(work, work.getSecondaryExtraNonce()));
+                    submitSolution(work);
                     ++work.nNonce;
                     break;
                 } else {
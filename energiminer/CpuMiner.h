@@ -15,7 +15,7 @@ namespace energi
   class CpuMiner : public Miner
   {
   public:
-    CpuMiner(const Plant &plant, int index);
+    CpuMiner(const Plant &plant, int index, unsigned device);
 
     virtual ~CpuMiner() {stopWorking();}
 
@@ -0,0 +1,484 @@
+/*
+ * MetricsServer.cpp
+ *
+ * HTTP endpoint serving the miner metrics to Prometheus and as JSON.
+ */
+
+#include "MetricsServer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+#include <boost/bind.hpp>
+#include <json/json.h>
+
+#include "common/Log.h"
+
+namespace energi {
+
+namespace {
+
+// Requests are a request line and a few headers, anything longer is not for us
+const std::size_t c_maxRequestSize = 8192;
+// Scrapers hold one connection at a time, a few more are left for curl and the like
+const unsigned c_maxConnections = 16;
+// Time a connection has to send its request and read the response
+const unsigned c_connectionTimeoutSeconds = 10;
+const unsigned c_minAcceptBackoffMs = 100;
+const unsigned c_maxAcceptBackoffMs = 1000;
+
+const double c_quantiles[] = {0.5, 0.9, 0.99};
+
+const char* dagStateName(DagState state)
+{
+    switch (state) {
+    case DagState::Loading:
+        return "loading";
+    case DagState::Ready:
+        return "ready";
+    default:
+        return "none";
+    }
+}
+
+/// Label value with backslashes, quotes and newlines escaped as the text format wants
+std::string label(const std::string& value)
+{
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped.push_back('\\');
+            escaped.push_back(c);
+        } else if (c == '\n') {
+            escaped.append("\\n");
+        } else {
+            escaped.push_back(c);
+        }
+    }
+    return escaped;
+}
+
+class PrometheusWriter
+{
+public:
+    PrometheusWriter()
+    {
+        // Hashrates need more than the default six digits
+        m_out.precision(12);
+    }
+
+    void family(const char* name, const char* type, const char* help)
+    {
+        m_out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << ' ' << type << '\n';
+    }
+
+    template <typename T>
+    void sample(const char* name, const std::string& labels, T value)
+    {
+        m_out << name;
+        if (!labels.empty()) {
+            m_out << '{' << labels << '}';
+        }
+        m_out << ' ' << value << '\n';
+    }
+
+    /// A latency histogram as a summary in seconds
+    void summary(const char* name, const std::string& labels, const LatencySnapshot& latency)
+    {
+        std::string const prefix = labels.empty() ? std::string() : labels + ",";
+        for (double quantile : c_quantiles) {
+            char q[16];
+            std::snprintf(q, sizeof(q), "%g", quantile);
+            sample(name, prefix + "quantile=\"" + q + "\"", latency.percentileUs(quantile * 100) / 1e6);
+        }
+        sample((std::string(name) + "_sum").c_str(), labels, latency.sumUs / 1e6);
+        sample((std::string(name) + "_count").c_str(), labels, latency.count);
+    }
+
+    std::string str() const
+    {
+        return m_out.str();
+    }
+
+private:
+    std::ostringstream m_out;
+};
+
+std::string deviceLabel(const DeviceSnapshot& device)
+{
+    return "device=\"" + label(device.name) + "\"";
+}
+
+/// Pools are told apart by port too, several may run on one host
+std::string poolLabel(const PoolScoreBoard::Score& pool)
+{
+    return "pool=\"" + label(pool.host + ":" + std::to_string(pool.port)) + "\"";
+}
+
+Json::Value latencyJson(const LatencySnapshot& latency)
+{
+    Json::Value value(Json::objectValue);
+    value["count"] = Json::UInt64(latency.count);
+    value["mean_us"] = latency.meanUs();
+    value["p50_us"] = Json::UInt64(latency.percentileUs(50));
+    value["p90_us"] = Json::UInt64(latency.percentileUs(90));
+    value["p99_us"] = Json::UInt64(latency.percentileUs(99));
+    value["max_us"] = Json::UInt64(latency.maxUs);
+    return value;
+}
+
+} // namespace
+
+struct MetricsServer::Connection
+{
+    explicit Connection(boost::asio::io_service& io_service)
+        : socket(io_service)
+        , request(c_maxRequestSize)
+        , deadline(io_service)
+    {}
+
+    boost::asio::ip::tcp::socket socket;
+    boost::asio::streambuf request;
+    std::string response;
+    boost::asio::deadline_timer deadline;
+    // Counted in m_connections until closed
+    bool open = false;
+};
+
+MetricsServer::MetricsServer(boost::asio::io_service& io_service, const Collector& collector)
+    : m_io_service(io_service)
+    , m_acceptor(io_service)
+    , m_acceptTimer(io_service)
+    , m_acceptBackoffMs(c_minAcceptBackoffMs)
+    , m_collector(collector)
+{
+}
+
+void MetricsServer::start(const std::string& address, unsigned short port)
+{
+    boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address::from_string(address), port);
+    m_acceptor.open(endpoint.protocol());
+    m_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+    m_acceptor.bind(endpoint);
+    m_acceptor.listen();
+    cnote << "Metrics served on http://" << endpoint << "/metrics";
+    accept();
+}
+
+void MetricsServer::stop()
+{
+    boost::system::error_code ec;
+    m_acceptor.close(ec);
+    m_acceptTimer.cancel(ec);
+}
+
+void MetricsServer::accept()
+{
+    ConnectionPtr connection = std::make_shared<Connection>(m_io_service);
+    m_acceptor.async_accept(connection->socket,
+            boost::bind(&MetricsServer::onAccepted, this, connection, boost::asio::placeholders::error));
+}
+
+void MetricsServer::onAccepted(const ConnectionPtr& connection, const boost::system::error_code& ec)
+{
+    if (ec == boost::asio::error::operation_aborted) {
+        return;
+    }
+    if (ec) {
+        // Accepting right away would spin while the error lasts
+        cwarn << "Metrics server failed to accept: " << ec.message();
+        m_acceptTimer.expires_from_now(boost::posix_time::milliseconds(m_acceptBackoffMs));
+        m_acceptTimer.async_wait([this](const boost::system::error_code& error) {
+            if (!error) {
+                accept();
+            }
+        });
+        m_acceptBackoffMs = std::min(m_acceptBackoffMs * 2, c_maxAcceptBackoffMs);
+        return;
+    }
+    m_acceptBackoffMs = c_minAcceptBackoffMs;
+
+    if (m_connections >= c_maxConnections) {
+        boost::system::error_code ignored;
+        connection->socket.close(ignored);
+    } else {
+        ++m_connections;
+        connection->open = true;
+        connection->deadline.expires_from_now(boost::posix_time::seconds(c_connectionTimeoutSeconds));
+        connection->deadline.async_wait(
+                boost::bind(&MetricsServer::onDeadline, this, connection, boost::asio::placeholders::error));
+        boost::asio::async_read_until(connection->socket, connection->request, "\r\n\r\n",
+                boost::bind(&MetricsServer::onRequest, this, connection, boost::asio::placeholders::error));
+    }
+    accept();
+}
+
+void MetricsServer::onRequest(const ConnectionPtr& connection, const boost::system::error_code& ec)
+{
+    if (ec) {
+        // Dropped, timed out or a request beyond c_maxRequestSize
+        close(connection);
+        return;
+    }
+    std::istream stream(&connection->request);
+    std::string requestLine;
+    std::getline(stream, requestLine);
+    connection->response = respond(requestLine);
+    boost::asio::async_write(connection->socket, boost::asio::buffer(connection->response),
+            boost::bind(&MetricsServer::onResponded, this, connection, boost::asio::placeholders::error));
+}
+
+void MetricsServer::onResponded(const ConnectionPtr& connection, const boost::system::error_code&)
+{
+    close(connection);
+}
+
+void MetricsServer::onDeadline(const ConnectionPtr& connection, const boost::system::error_code& ec)
+{
+    if (ec != boost::asio::error::operation_aborted) {
+        // Aborts the pending read or write
+        close(connection);
+    }
+}
+
+void MetricsServer::close(const ConnectionPtr& connection)
+{
+    if (!connection->open) {
+        return;
+    }
+    connection->open = false;
+    --m_connections;
+    boost::system::error_code ignored;
+    connection->deadline.cancel(ignored);
+    connection->socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+    connection->socket.close(ignored);
+}
+
+std::string MetricsServer::respond(const std::string& requestLine)
+{
+    std::istringstream line(requestLine);
+    std::string method, target;
+    line >> method >> target;
+
+    const char* status = "200 OK";
+    const char* type = "text/plain; version=0.0.4; charset=utf-8";
+    std::string body;
+    if (method != "GET") {
+        status = "405 Method Not Allowed";
+        body = "Only GET is supported\n";
+    } else if (target == "/metrics") {
+        body = prometheus(m_collector());
+    } else if (target == "/metrics.json" || target == "/json") {
+        type = "application/json";
+        body = json(m_collector());
+    } else {
+        status = "404 Not Found";
+        body = "Try /metrics or /metrics.json\n";
+    }
+
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << "\r\n"
+             << "Content-Type: " << type << "\r\n"
+             << "Content-Length: " << body.size() << "\r\n"
+             << "Connection: close\r\n\r\n"
+             << body;
+    return response.str();
+}
+
+std::string MetricsServer::prometheus(const MinerMetrics& metrics)
+{
+    PrometheusWriter out;
+
+    out.family("energiminer_uptime_seconds", "gauge", "Time since the miner started");
+    out.sample("energiminer_uptime_seconds", "",
+               std::chrono::duration_cast<std::chrono::seconds>(metrics.uptime).count());
+
+    out.family("energiminer_hashrate", "gauge", "Hashes per second of the last interval and averaged over a window");
+    for (const auto& device : metrics.devices) {
+        std::string const labels = deviceLabel(device);
+        out.sample("energiminer_hashrate", labels + ",window=\"last\"", device.hashRate);
+        out.sample("energiminer_hashrate", labels + ",window=\"1m\"", device.hashRate1m);
+        out.sample("energiminer_hashrate", labels + ",window=\"5m\"", device.hashRate5m);
+        out.sample("energiminer_hashrate", labels + ",window=\"15m\"", device.hashRate15m);
+    }
+    out.family("energiminer_hashes_total", "counter", "Hashes computed");
+    for (const auto& device : metrics.devices) {
+        out.sample("energiminer_hashes_total", deviceLabel(device), device.hashes);
+    }
+    out.family("energiminer_kernel_launches_total", "counter", "Search kernels launched");
+    for (const auto& device : metrics.devices) {
+        out.sample("energiminer_kernel_launches_total", deviceLabel(device), device.kernelLaunches);
+    }
+    out.family("energiminer_shares_total", "counter", "Shares by outcome");
+    for (const auto& device : metrics.devices) {
+        std::string const labels = deviceLabel(device);
+        out.sample("energiminer_shares_total", labels + ",result=\"found\"", device.sharesFound);
+        out.sample("energiminer_shares_total", labels + ",result=\"accepted\"", device.sharesAccepted);
+        out.sample("energiminer_shares_total", labels + ",result=\"stale\"", device.sharesStale);
+        out.sample("energiminer_shares_total", labels + ",result=\"rejected\"", device.sharesRejected);
+    }
+    out.family("energiminer_height", "gauge", "Height of the work mined on");
+    for (const auto& device : metrics.devices) {
+        out.sample("energiminer_height", deviceLabel(device), device.height);
+    }
+    out.family("energiminer_dag_epoch", "gauge", "Epoch of the DAG loaded or loading");
+    for (const auto& device : metrics.devices) {
+        out.sample("energiminer_dag_epoch", deviceLabel(device), device.dagEpoch);
+    }
+    out.family("energiminer_dag_state", "gauge", "1 for the current DAG state of the device");
+    for (const auto& device : metrics.devices) {
+        std::string const labels = deviceLabel(device);
+        for (DagState state : {DagState::None, DagState::Loading, DagState::Ready}) {
+            out.sample("energiminer_dag_state", labels + ",state=\"" + dagStateName(state) + "\"",
+                       device.dagState == state ? 1 : 0);
+        }
+    }
+    out.family("energiminer_paused", "gauge", "1 while mining on the device is paused");
+    for (const auto& paused : metrics.progress.miningIsPaused) {
+        out.sample("energiminer_paused", "device=\"" + label(paused.first) + "\"", paused.second ? 1 : 0);
+    }
+    if (!metrics.progress.minerMonitors.empty()) {
+        out.family("energiminer_temperature_celsius", "gauge", "Device temperature");
+        for (const auto& hw : metrics.progress.minerMonitors) {
+            out.sample("energiminer_temperature_celsius", "device=\"" + label(hw.first) + "\"", hw.second.tempC);
+        }
+        out.family("energiminer_fan_percent", "gauge", "Device fan speed");
+        for (const auto& hw : metrics.progress.minerMonitors) {
+            out.sample("energiminer_fan_percent", "device=\"" + label(hw.first) + "\"", hw.second.fanP);
+        }
+        out.family("energiminer_power_watts", "gauge", "Device power draw");
+        for (const auto& hw : metrics.progress.minerMonitors) {
+            out.sample("energiminer_power_watts", "device=\"" + label(hw.first) + "\"", hw.second.powerW);
+        }
+    }
+    out.family("energiminer_work_switch_seconds", "summary", "Time from new work until the device mines on it");
+    for (const auto& device : metrics.devices) {
+        out.summary("energiminer_work_switch_seconds", deviceLabel(device), device.workSwitch);
+    }
+    out.family("energiminer_share_verify_seconds", "summary", "Time to verify a share on the CPU");
+    for (const auto& device : metrics.devices) {
+        out.summary("energiminer_share_verify_seconds", deviceLabel(device), device.shareVerify);
+    }
+    out.family("energiminer_submit_rtt_seconds", "summary", "Time from submitting a share until the pool answered");
+    for (const auto& device : metrics.devices) {
+        out.summary("energiminer_submit_rtt_seconds", deviceLabel(device), device.submitRtt);
+    }
+
+    out.family("energiminer_job_stage_seconds", "summary", "Time a stratum job spent in each stage of the pipeline");
+    out.summary("energiminer_job_stage_seconds", "stage=\"queued\"", metrics.pipeline.queued);
+    out.summary("energiminer_job_stage_seconds", "stage=\"decode\"", metrics.pipeline.decode);
+    out.summary("energiminer_job_stage_seconds", "stage=\"prepare\"", metrics.pipeline.prepare);
+    out.summary("energiminer_job_stage_seconds", "stage=\"publish\"", metrics.pipeline.publish);
+
+    out.family("energiminer_txid_cache_lookups_total", "counter", "Template transactions looked up in the txid cache");
+    out.sample("energiminer_txid_cache_lookups_total", "result=\"hit\"", metrics.txidCache.hits);
+    out.sample("energiminer_txid_cache_lookups_total", "result=\"miss\"", metrics.txidCache.misses);
+    out.family("energiminer_txid_cache_entries", "gauge", "Transactions held in the txid cache");
+    out.sample("energiminer_txid_cache_entries", "", metrics.txidCache.entries);
+
+    out.family("energiminer_solutions_total", "counter", "Solutions of all devices by outcome");
+    out.sample("energiminer_solutions_total", "result=\"accepted\"", metrics.solutions.getAccepts());
+    out.sample("energiminer_solutions_total", "result=\"stale\"", metrics.solutions.getAcceptedStales());
+    out.sample("energiminer_solutions_total", "result=\"rejected\"", metrics.solutions.getRejects());
+    out.sample("energiminer_solutions_total", "result=\"failed\"", metrics.solutions.getFailures());
+
+    if (!metrics.pools.empty()) {
+        out.family("energiminer_pool_active", "gauge", "1 for the pool mined on");
+        for (const auto& pool : metrics.pools) {
+            out.sample("energiminer_pool_active", poolLabel(pool), pool.active ? 1 : 0);
+        }
+        out.family("energiminer_pool_connect_seconds", "gauge", "Average time to connect to the pool");
+        for (const auto& pool : metrics.pools) {
+            out.sample("energiminer_pool_connect_seconds", poolLabel(pool), pool.connectMs / 1e3);
+        }
+        out.family("energiminer_pool_propagation_seconds", "gauge", "Average delay of new jobs behind the fastest pool");
+        for (const auto& pool : metrics.pools) {
+            out.sample("energiminer_pool_propagation_seconds", poolLabel(pool), pool.propagationMs / 1e3);
+        }
+        out.family("energiminer_pool_submit_seconds", "gauge", "Average submit round trip to the pool");
+        for (const auto& pool : metrics.pools) {
+            out.sample("energiminer_pool_submit_seconds", poolLabel(pool), pool.submitMs / 1e3);
+        }
+    }
+    return out.str();
+}
+
+std::string MetricsServer::json(const MinerMetrics& metrics)
+{
+    Json::Value root(Json::objectValue);
+    root["uptime_s"] = Json::Int64(std::chrono::duration_cast<std::chrono::seconds>(metrics.uptime).count());
+    root["hashrate"] = metrics.progress.hashRate;
+
+    Json::Value& devices = root["devices"] = Json::Value(Json::arrayValue);
+    for (const auto& device : metrics.devices) {
+        Json::Value value(Json::objectValue);
+        value["index"] = device.index;
+        value["name"] = device.name;
+        value["hashrate"] = device.hashRate;
+        value["hashrate_1m"] = device.hashRate1m;
+        value["hashrate_5m"] = device.hashRate5m;
+        value["hashrate_15m"] = device.hashRate15m;
+        value["hashes"] = Json::UInt64(device.hashes);
+        value["kernel_launches"] = Json::UInt64(device.kernelLaunches);
+        Json::Value& shares = value["shares"] = Json::Value(Json::objectValue);
+        shares["found"] = Json::UInt64(device.sharesFound);
+        shares["accepted"] = Json::UInt64(device.sharesAccepted);
+        shares["stale"] = Json::UInt64(device.sharesStale);
+        shares["rejected"] = Json::UInt64(device.sharesRejected);
+        value["height"] = Json::UInt64(device.height);
+        value["dag"]["state"] = dagStateName(device.dagState);
+        value["dag"]["epoch"] = Json::UInt64(device.dagEpoch);
+        auto paused = metrics.progress.miningIsPaused.find(device.name);
+        value["paused"] = paused != metrics.progress.miningIsPaused.end() && paused->second;
+        auto hw = metrics.progress.minerMonitors.find(device.name);
+        if (hw != metrics.progress.minerMonitors.end()) {
+            value["temperature_c"] = hw->second.tempC;
+            value["fan_percent"] = hw->second.fanP;
+            value["power_w"] = hw->second.powerW;
+        }
+        value["work_switch"] = latencyJson(device.workSwitch);
+        value["share_verify"] = latencyJson(device.shareVerify);
+        value["submit_rtt"] = latencyJson(device.submitRtt);
+        devices.append(value);
+    }
+
+    Json::Value& stages = root["job_stages"] = Json::Value(Json::objectValue);
+    stages["queued"] = latencyJson(metrics.pipeline.queued);
+    stages["decode"] = latencyJson(metrics.pipeline.decode);
+    stages["prepare"] = latencyJson(metrics.pipeline.prepare);
+    stages["publish"] = latencyJson(metrics.pipeline.publish);
+
+    Json::Value& txids = root["txid_cache"] = Json::Value(Json::objectValue);
+    txids["hits"] = Json::UInt64(metrics.txidCache.hits);
+    txids["misses"] = Json::UInt64(metrics.txidCache.misses);
+    txids["entries"] = Json::UInt64(metrics.txidCache.entries);
+
+    Json::Value& solutions = root["solutions"] = Json::Value(Json::objectValue);
+    solutions["accepted"] = metrics.solutions.getAccepts();
+    solutions["stale"] = metrics.solutions.getAcceptedStales();
+    solutions["rejected"] = metrics.solutions.getRejects();
+    solutions["failed"] = metrics.solutions.getFailures();
+
+    Json::Value& pools = root["pools"] = Json::Value(Json::arrayValue);
+    for (const auto& pool : metrics.pools) {
+        Json::Value value(Json::objectValue);
+        value["host"] = pool.host;
+        value["port"] = pool.port;
+        value["active"] = pool.active;
+        value["connects"] = pool.connects;
+        value["jobs"] = pool.jobs;
+        value["shares"] = pool.shares;
+        value["connect_ms"] = pool.connectMs;
+        value["propagation_ms"] = pool.propagationMs;
+        value["submit_ms"] = pool.submitMs;
+        value["score_ms"] = pool.value();
+        pools.append(value);
+    }
+
+    Json::FastWriter writer;
+    return writer.write(root);
+}
+
+} /* namespace energi */
@@ -0,0 +1,86 @@
+/*
+ * MetricsServer.h
+ *
+ * HTTP endpoint serving the miner metrics to Prometheus and as JSON.
+ */
+
+#ifndef ENERGIMINER_METRICSSERVER_H_
+#define ENERGIMINER_METRICSSERVER_H_
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "common/common.h"
+#include "nrgcore/mineplant.h"
+#include "nrgcore/telemetry.h"
+#include "protocol/PoolScore.h"
+
+namespace energi {
+
+/// Everything a scrape reports, collected at once
+struct MinerMetrics
+{
+    std::chrono::steady_clock::duration uptime{0};
+    std::vector<DeviceSnapshot> devices;
+    WorkingProgress progress;
+    SolutionStats solutions;
+    std::vector<PoolScoreBoard::Score> pools;
+    PipelineSnapshot pipeline;
+    TxidCache::Stats txidCache;
+};
+
+/**
+ * @brief Minimal HTTP/1.1 server on the io service of the miner.
+ *
+ * GET /metrics answers in the Prometheus text format, GET /metrics.json and GET /json with
+ * the same metrics as JSON. Every request is answered on its own connection, which is closed
+ * afterwards. Connections are capped in number and closed when the request and response are
+ * not through within a deadline, so idle clients can't hold sockets. The metrics come from
+ * the collector passed in, which is expected to read lock free telemetry and snapshots only,
+ * so scrapes never stall a miner or the io thread.
+ */
+class MetricsServer
+{
+public:
+    using Collector = std::function<MinerMetrics()>;
+
+    MetricsServer(boost::asio::io_service& io_service, const Collector& collector);
+
+    /// Starts listening, throws boost::system::system_error if the address can't be bound
+    void start(const std::string& address, unsigned short port);
+    void stop();
+
+    static std::string prometheus(const MinerMetrics& metrics);
+    static std::string json(const MinerMetrics& metrics);
+
+private:
+    struct Connection;
+    using ConnectionPtr = std::shared_ptr<Connection>;
+
+    void accept();
+    void onAccepted(const ConnectionPtr& connection, const boost::system::error_code& ec);
+    void onRequest(const ConnectionPtr& connection, const boost::system::error_code& ec);
+    void onResponded(const ConnectionPtr& connection, const boost::system::error_code& ec);
+    void onDeadline(const ConnectionPtr& connection, const boost::system::error_code& ec);
+    void close(const ConnectionPtr& connection);
+
+    /// Response to the request line, status line and headers included
+    std::string respond(const std::string& requestLine);
+
+    boost::asio::io_service& m_io_service;
+    boost::asio::ip::tcp::acceptor m_acceptor;
+    // Delays accepting again after an accept failed, e.g. out of descriptors
+    boost::asio::deadline_timer m_acceptTimer;
+    unsigned m_acceptBackoffMs;
+    unsigned m_connections = 0;
+    Collector m_collector;
+};
+
+} /* namespace energi */
+
+#endif /* ENERGIMINER_METRICSSERVER_H_ */
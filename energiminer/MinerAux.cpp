@@ -4,7 +4,14 @@
 #include <energiminer/buildinfo.h>
 #include <protocol/PoolManager.h>
 #include <protocol/stratum/StratumClient.h>
+#include <protocol/stratum/StratumCodec.h>
+#include <protocol/stratum/EndpointCache.h>
 #include <protocol/getwork/GetworkClient.h>
+#include "MetricsServer.h"
+#include <primitives/rawtransactions.h>
+#include <primitives/sha256.h>
+#include <primitives/txidcache.h>
+#include <common/HexCodec.h>
 
 #include <CLI/CLI.hpp>
 
@@ -19,6 +26,25 @@ struct MiningChannel: public LogChannel
 
 #define minelog clog(MiningChannel)
 
+namespace {
+
+// Runs per second of run, repeated for half a second
+double measureRate(const std::function<void()>& run)
+{
+    using namespace std::chrono;
+    unsigned rounds = 0;
+    auto const start = steady_clock::now();
+    auto elapsed = steady_clock::duration::zero();
+    do {
+        run();
+        rounds++;
+        elapsed = steady_clock::now() - start;
+    } while (elapsed < milliseconds(500));
+    return rounds / duration<double>(elapsed).count();
+}
+
+} // namespace
+
 void MinerCLI::ParseCommandLine(int argc, char** argv)
 {
 
@@ -67,6 +93,11 @@ void MinerCLI::ParseCommandLine(int argc, char** argv)
         ->group(CommonGroup)
         ->check(CLI::Range(3, 999));
 
+    app.add_option("--dns-ttl", m_dnsTtl,
+            "Set the time in seconds the resolved pool addresses are reused for (stratum only). If = 0 then the pool host is resolved on every connection.", true)
+        ->group(CommonGroup)
+        ->check(CLI::Range(0, 86400));
+
 //    app.add_flag("-R,--report-hashrate", m_report_stratum_hashrate,
 //            "Report current hashrate to pool")
 //        ->group(CommonGroup);
@@ -96,6 +127,25 @@ void MinerCLI::ParseCommandLine(int argc, char** argv)
 //            "Set the amount of time in minutes to stay on a failover pool before trying to reconnect to primary. If = 0 then no switch back.", true)
         ->group(CommonGroup)
         ->check(CLI::Range(0, 999));
+    app.add_option("--failover-standby", m_failoverStandby,
+            "Set the number of failover pools kept connected in the background (stratum only). If = 0 then failover pools are only connected when needed.", true)
+        ->group(CommonGroup)
+        ->check(CLI::Range(0, 8));
+    app.add_flag("--failover-latency", m_failoverLatency,
+            "Switch to the standby pool with the lowest measured latency (needs --failover-standby)")
+        ->group(CommonGroup);
+
+    app.add_option("--api-port", m_apiPort,
+            "Serve metrics over HTTP on this port, for Prometheus on /metrics and as JSON on /metrics.json. If = 0 then disabled.", true)
+        ->group(CommonGroup)
+        ->check(CLI::Range(0, 65535));
+    app.add_option("--api-bind", m_apiBind,
+            "Set the address the metrics are served on", true)
+        ->group(CommonGroup);
+
+    app.add_option("--trace", m_traceFile,
+            "Trace the stages of each job and solution and write them to this file as Chrome trace JSON on exit and on SIGUSR1")
+        ->group(CommonGroup);
 
     app.add_flag("--nocolor", g_logNoColor, "Display monochrome log")->group(CommonGroup);
 
@@ -103,6 +153,22 @@ void MinerCLI::ParseCommandLine(int argc, char** argv)
             "Use syslog appropriate log output (drop timestamp and channel prefix)")
         ->group(CommonGroup);
 
+    app.add_flag("--benchmark-sha256", m_shouldBenchmarkSha256,
+            "Measure the double SHA-256 throughput of each implementation the CPU supports and exit")
+        ->group(CommonGroup);
+
+    app.add_flag("--benchmark-hex", m_shouldBenchmarkHex,
+            "Measure the hex encoding and decoding speed of each implementation the CPU supports and exit")
+        ->group(CommonGroup);
+
+    app.add_flag("--benchmark-stratum", m_shouldBenchmarkStratum,
+            "Measure the parsing of recorded stratum lines with JsonCpp and with the stratum codec and exit")
+        ->group(CommonGroup);
+
+    app.add_flag("--benchmark-templates", m_shouldBenchmarkTemplates,
+            "Replay a sequence of block templates and measure their txids with and without the txid cache and exit")
+        ->group(CommonGroup);
+
 #if NRGHASHCL || NRGHASHCUDA
     app.add_flag("--list-devices", m_shouldListDevices,
             "List the detected OpenCL/CUDA devices and exit. Should be combined with -G, -U, or -X flag")
@@ -121,6 +187,10 @@ void MinerCLI::ParseCommandLine(int argc, char** argv)
             "Set the number of threads per hash", true)
         ->group(OpenCLGroup);
 
+    app.add_flag("--cl-autotune", m_openclAutoTune,
+            "Benchmark local/global work sizes and threads per hash, reuse the result on later starts")
+        ->group(OpenCLGroup);
+
     app.add_option("--cl-global-work", m_globalWorkSizeMultiplier,
             "Set the global work size multipler. Specify negative value for automatic scaling based on # of compute units", true)
         ->group(OpenCLGroup);
@@ -287,7 +357,7 @@ void MinerCLI::ParseCommandLine(int argc, char** argv)
             m_show_power = true;
     }
 
-    if (m_minerExecutionMode != MinerExecutionMode::kCPU) {
+    if (m_minerExecutionMode != MinerExecutionMode::kCPU && !measuresOnly()) {
         if (!cl_miner && !cuda_miner && !mixed_miner && !bench_opt->count() && !sim_opt->count()) {
             cerr << endl << "One of -G, -U, -X, -M, or -Z must be specified" << "\n\n";
             exit(-1);
@@ -336,7 +406,7 @@ void MinerCLI::ParseCommandLine(int argc, char** argv)
         m_mode = mode;
     }
 
-    if ((m_mode == OperationMode::None) && !m_shouldListDevices) {
+    if ((m_mode == OperationMode::None) && !m_shouldListDevices && !measuresOnly()) {
         cerr << endl << "At least one pool URL must be specified" << "\n\n";
         exit(-1);
     }
@@ -371,6 +441,30 @@ void MinerCLI::ParseCommandLine(int argc, char** argv)
 
 void MinerCLI::execute()
 {
+    if (m_shouldBenchmarkSha256) {
+        doSha256Benchmark();
+        stop_io_service();
+        return;
+    }
+
+    if (m_shouldBenchmarkHex) {
+        doHexBenchmark();
+        stop_io_service();
+        return;
+    }
+
+    if (m_shouldBenchmarkStratum) {
+        doStratumBenchmark();
+        stop_io_service();
+        return;
+    }
+
+    if (m_shouldBenchmarkTemplates) {
+        doTemplateBenchmark();
+        stop_io_service();
+        return;
+    }
+
     if (m_shouldListDevices) {
 #if NRGHASHCL
         if (m_minerExecutionMode == MinerExecutionMode::kCL ||
@@ -394,6 +488,7 @@ void MinerCLI::execute()
             m_miningThreads = m_openclDeviceCount;
         }
         OpenCLMiner::setThreadsPerHash(m_openclThreadsPerHash);
+        OpenCLMiner::setAutoTune(m_openclAutoTune);
         if (!OpenCLMiner::configureGPU(
                     m_localWorkSize,
                     m_globalWorkSizeMultiplier,
@@ -454,6 +549,12 @@ void MinerCLI::execute()
     g_running = true;
     signal(SIGINT, MinerCLI::signalHandler);
     signal(SIGTERM, MinerCLI::signalHandler);
+    if (!m_traceFile.empty()) {
+        Trace::enable(true);
+#ifndef _WIN32
+        signal(SIGUSR1, MinerCLI::traceSignalHandler);
+#endif
+    }
 
     switch (m_mode) {
         case OperationMode::Benchmark:
@@ -470,12 +571,190 @@ void MinerCLI::execute()
     }
 }
 
+void MinerCLI::doSha256Benchmark()
+{
+    // A merkle level of 4096 pairs and as many transactions of typical sizes
+    const std::size_t count = 4096;
+    std::vector<unsigned char> pairs(64 * count);
+    std::vector<std::vector<unsigned char>> txs(count);
+    std::vector<const unsigned char*> data;
+    std::vector<std::size_t> sizes;
+    std::size_t txBytes = 0;
+    for (std::size_t i = 0; i < pairs.size(); ++i) {
+        pairs[i] = static_cast<unsigned char>(i * 131);
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+        txs[i].assign(150 + (i * 97) % 400, static_cast<unsigned char>(i));
+        data.push_back(txs[i].data());
+        sizes.push_back(txs[i].size());
+        txBytes += txs[i].size();
+    }
+    std::vector<unsigned char> out(32 * count);
+
+    for (auto const& name : SHA256Implementations()) {
+        SHA256Use(name);
+        double const levels = measureRate([&]() { SHA256D64(out.data(), pairs.data(), count); });
+        double const blocks = measureRate([&]() { SHA256D(out.data(), data.data(), sizes.data(), count); });
+        cnote << std::fixed << std::setprecision(1) << std::setw(6) << name
+              << "  merkle: " << levels * pairs.size() / 1e6 << " MB/s " << levels * count / 1e6 << " MH/s"
+              << "  txid: " << blocks * txBytes / 1e6 << " MB/s " << blocks * count / 1e6 << " MH/s";
+    }
+    cnote << "Using " << SHA256AutoDetect();
+}
+
+void MinerCLI::doHexBenchmark()
+{
+    // Hashes as in submits and headers, and transaction sized blocks as in templates
+    const std::size_t count = 4096;
+    const std::size_t sizes[] = {32, 4096};
+    std::vector<uint8_t> bytes(count * 32);
+    for (std::size_t i = 0; i < bytes.size(); ++i) {
+        bytes[i] = static_cast<uint8_t>(i * 131);
+    }
+    std::vector<char> text(2 * bytes.size());
+    std::vector<uint8_t> decoded(bytes.size());
+
+    // The formatting the codec replaced, for comparison
+    double const printed = measureRate([&]() {
+        for (std::size_t i = 0; i < bytes.size(); ++i) {
+            std::snprintf(&text[2 * i], 3, "%02x", bytes[i]);
+        }
+    });
+    cnote << std::fixed << std::setprecision(3) << std::setw(7) << "sprintf"
+          << "  encode: " << 1e9 / (printed * bytes.size()) << " ns/byte";
+
+    hex::Impl const best = hex::impl();
+    for (hex::Impl impl : {hex::Impl::Scalar, hex::Impl::SSSE3, hex::Impl::AVX2}) {
+        hex::setImpl(impl);
+        if (hex::impl() != impl) {
+            continue;
+        }
+        for (std::size_t size : sizes) {
+            double const encoded = measureRate([&]() {
+                for (std::size_t offset = 0; offset < bytes.size(); offset += size) {
+                    hex::encode(&bytes[offset], size, &text[2 * offset]);
+                }
+            });
+            double const parsed = measureRate([&]() {
+                for (std::size_t offset = 0; offset < bytes.size(); offset += size) {
+                    hex::decode(&text[2 * offset], size, &decoded[offset]);
+                }
+            });
+            cnote << std::fixed << std::setprecision(3) << std::setw(7) << hex::implName(impl) << std::setw(5)
+                  << size << " B  encode: " << 1e9 / (encoded * bytes.size()) << " ns/byte  decode: "
+                  << 1e9 / (parsed * bytes.size()) << " ns/byte";
+        }
+    }
+    hex::setImpl(best);
+    cnote << "Using " << hex::implName(hex::impl());
+}
+
+void MinerCLI::doStratumBenchmark()
+{
+    // Lines shaped like the ones pools send, notifies with typical transactions
+    auto const notify = [](std::size_t transactions) {
+        std::string line = "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"6f1a\",\"" + std::string(64, 'a')
+                + "\",\"" + std::string(180, 'b') + "\",\"" + std::string(220, 'c') + "\",[";
+        for (std::size_t i = 0; i < transactions; ++i) {
+            line += i ? ",{\"data\":\"" : "{\"data\":\"";
+            line += std::string(300 + (i * 97) % 400, 'd') + "\",\"txid\":\"" + std::string(64, 'e') + "\"}";
+        }
+        return line + "],\"20000000\",\"1b0404cb\",\"5f5e1000\",true,1234567]}";
+    };
+    struct Sample
+    {
+        std::string name;
+        std::string line;
+    };
+    const Sample samples[] = {
+        {"submit response", "{\"id\":1042,\"jsonrpc\":\"2.0\",\"result\":true,\"error\":null}"},
+        {"set_difficulty", "{\"id\":null,\"method\":\"mining.set_difficulty\",\"params\":[16384]}"},
+        {"notify 0 tx", notify(0)},
+        {"notify 200 tx", notify(200)},
+        {"notify 2000 tx", notify(2000)},
+    };
+
+    StratumCodec codec;
+    StratumCodec::Message message;
+    energi::StratumJob job;
+    for (const auto& sample : samples) {
+        // The path the codec replaced: a Json::Value, then the job read off it
+        double const json = measureRate([&]() {
+            Json::Value value;
+            Json::Reader reader;
+            reader.parse(sample.line, value);
+            if (value.isMember("params") && value["method"].asString() == "mining.notify") {
+                energi::StratumJob parsed(value["params"]);
+            }
+        });
+        double const parsed = measureRate([&]() {
+            codec.parse(sample.line.data(), sample.line.size(), message);
+            if (message.kind == StratumCodec::Message::Notify) {
+                StratumCodec::toJob(message, job);
+            }
+        });
+        cnote << std::fixed << std::setprecision(2) << std::setw(15) << sample.name << std::setw(8)
+              << sample.line.size() << " B  json: " << 1e6 / json << " us  codec: " << 1e6 / parsed << " us";
+    }
+}
+
+void MinerCLI::doTemplateBenchmark()
+{
+    // Consecutive templates of a busy chain: each one drops the oldest tenth of the
+    // transactions of the one before and adds as many new ones
+    const std::size_t count = 2000;
+    const std::size_t templates = 20;
+    const std::size_t turnover = count / 10;
+    std::vector<std::string> pool;
+    for (std::size_t i = 0; i < count + templates * turnover; ++i) {
+        std::vector<uint8_t> bytes(150 + (i * 97) % 400);
+        for (std::size_t j = 0; j < bytes.size(); ++j) {
+            bytes[j] = static_cast<uint8_t>((i * 7919 + j * 131) >> (j % 3));
+        }
+        std::memcpy(bytes.data(), &i, sizeof(i));
+        pool.emplace_back(2 * bytes.size(), '0');
+        hex::encode(bytes.data(), bytes.size(), &pool.back()[0]);
+    }
+    std::vector<std::vector<std::string>> replay;
+    for (std::size_t t = 0; t < templates; ++t) {
+        replay.emplace_back(pool.begin() + t * turnover, pool.begin() + t * turnover + count);
+    }
+    std::vector<std::string> const noTxids;
+    auto const run = [&]() {
+        energi::TxidCache::instance().clear();
+        for (const auto& hexes : replay) {
+            energi::RawTransactions transactions(hexes);
+            transactions.decode(hexes, noTxids, 0, hexes.size());
+        }
+    };
+
+    energi::TxidCache& cache = energi::TxidCache::instance();
+    cache.setCapacity(0);
+    double const uncached = measureRate(run);
+    cache.setCapacity(energi::TxidCache::c_defaultCapacity);
+    double const cached = measureRate(run);
+    energi::TxidCache::Stats const before = cache.stats();
+    run();
+    energi::TxidCache::Stats const after = cache.stats();
+    cache.clear();
+
+    uint64_t const lookups = (after.hits - before.hits) + (after.misses - before.misses);
+    cnote << std::fixed << std::setprecision(3) << templates << " templates of " << count << " transactions, "
+          << turnover << " new per template";
+    cnote << std::fixed << std::setprecision(3) << "no cache: " << 1e3 / (uncached * templates)
+          << " ms per template";
+    cnote << std::fixed << std::setprecision(3) << "   cache: " << 1e3 / (cached * templates)
+          << " ms per template, " << std::setprecision(1)
+          << (lookups ? 100.0 * (after.hits - before.hits) / lookups : 0.0) << "% hits";
+}
+
 void MinerCLI::doMiner()
 {
     PoolClient* client = nullptr;
     if (m_mode == OperationMode::GBT) {
 			client = new GetworkClient(m_farmRecheckPeriod, m_coinbase_addr);
     } else if (m_mode == OperationMode::Stratum) {
+        EndpointCache::instance().setTtl(std::chrono::seconds(m_dnsTtl));
         client = new StratumClient(m_io_service, m_worktimeout, m_responsetimeout, m_report_stratum_hashrate);
     } else if (m_mode == OperationMode::Simulation) {
         //client = new SimulationClient(20, m_benchmarkBlock);
@@ -494,6 +773,12 @@ void MinerCLI::doMiner()
     cnote << "Engines started!";
     energi::MinePlant plant(m_io_service, m_show_hwmonitors, m_show_power);
     PoolManager mgr(m_io_service, client, plant, m_minerExecutionMode, m_maxFarmRetries, m_failovertimeout);
+    if (m_mode == OperationMode::Stratum) {
+        for (unsigned i = 0; i < m_failoverStandby; ++i) {
+            mgr.addStandbyClient(new StratumClient(m_io_service, m_worktimeout, m_responsetimeout, m_report_stratum_hashrate));
+        }
+        mgr.setLatencySelection(m_failoverLatency);
+    }
 
     // If we are in simulation mode we add a fake connection
     if (m_mode == OperationMode::Simulation) {
@@ -506,6 +791,26 @@ void MinerCLI::doMiner()
             mgr.addConnection(conn);
         }
     }
+    MetricsServer metrics(m_io_service, [&plant, &mgr]() {
+        // Lock free telemetry and state of the io thread only, the miners are never waited for
+        MinerMetrics metrics;
+        metrics.uptime = std::chrono::steady_clock::now() - plant.farmLaunched();
+        metrics.devices = Telemetry::instance().snapshot();
+        metrics.pipeline = Telemetry::instance().pipeline();
+        metrics.txidCache = Telemetry::instance().txidCache();
+        metrics.progress = plant.miningProgress();
+        metrics.solutions = plant.getSolutionStats();
+        metrics.pools = mgr.poolScores();
+        return metrics;
+    });
+    if (m_apiPort) {
+        try {
+            metrics.start(m_apiBind, m_apiPort);
+        } catch (const boost::system::system_error& ex) {
+            cwarn << "Can't serve metrics on " << m_apiBind << ":" << m_apiPort << ": " << ex.what();
+        }
+    }
+
     //start PoolManager
     mgr.start();
 
@@ -516,6 +821,9 @@ void MinerCLI::doMiner()
         // services to start properly. Otherwise we get a "not-connected"
         // message immediately
         this_thread::sleep_for(chrono::seconds(2));
+        if (Trace::dumpRequested()) {
+            dumpTrace();
+        }
         if (interval > 2) {
             interval -= 2;
             continue;
@@ -530,9 +838,24 @@ void MinerCLI::doMiner()
     }
     mgr.stop();
     stop_io_service();
+    if (Trace::enabled()) {
+        dumpTrace();
+    }
     exit(0);
 }
 
+void MinerCLI::dumpTrace()
+{
+    if (!Trace::dump(m_traceFile)) {
+        cwarn << "Can't write the trace to " << m_traceFile;
+        return;
+    }
+    cnote << "Trace written to " << m_traceFile;
+    for (const auto& line : Trace::summary()) {
+        cnote << line;
+    }
+}
+
 void MinerCLI::io_work_timer_handler(const boost::system::error_code& ec)
 {
 
@@ -29,6 +29,7 @@
 #include "primitives/solution.h"
 #include "primitives/work.h"
 #include "nrgcore/mineplant.h"
+#include "common/Trace.h"
 #include <protocol/PoolURI.h>
 
 
@@ -91,6 +92,12 @@ public:
 		g_running = false;
 	}
 
+	static void traceSignalHandler(int sig)
+	{
+		(void)sig;
+		Trace::requestDump();
+	}
+
 	MinerCLI()
         : m_io_work(m_io_service)
         , m_io_work_timer(m_io_service)
@@ -143,6 +150,11 @@ private:
 
     */
     void doMiner();
+    void dumpTrace();
+    void doSha256Benchmark();
+    void doHexBenchmark();
+    void doStratumBenchmark();
+    void doTemplateBenchmark();
 
 private:
 	/// Operating mode.
@@ -162,11 +174,23 @@ private:
 	unsigned m_openclPlatform = 0;
 	unsigned m_miningThreads = 1;
 	bool m_shouldListDevices = false;
+	bool m_shouldBenchmarkSha256 = false;
+	bool m_shouldBenchmarkHex = false;
+	bool m_shouldBenchmarkStratum = false;
+	bool m_shouldBenchmarkTemplates = false;
+
+	/// Whether one of the --benchmark-* measurements runs instead of mining
+	bool measuresOnly() const
+	{
+		return m_shouldBenchmarkSha256 || m_shouldBenchmarkHex || m_shouldBenchmarkStratum
+			|| m_shouldBenchmarkTemplates;
+	}
 
 #if NRGHASHCL
 	unsigned m_openclDeviceCount = 0;
     std::vector<unsigned> m_openclDevices = std::vector<unsigned>(MAX_MINERS, -1);
 	unsigned m_openclThreadsPerHash = 8;
+	bool m_openclAutoTune = false;
 
     int m_globalWorkSizeMultiplier = energi::OpenCLMiner::c_defaultGlobalWorkSizeMultiplier;
 	unsigned m_localWorkSize = energi::OpenCLMiner::c_defaultLocalWorkSize;
@@ -198,8 +222,14 @@ private:
 	int m_worktimeout = 180;
 	// Number of seconds to wait before triggering a response timeout from pool
 	int m_responsetimeout = 3;
+    // Number of seconds the resolved addresses of a pool are cached
+    unsigned m_dnsTtl = 300;
     // Number of minutes to wait on a failover pool before trying to go back to primary. In minutes !!
     unsigned m_failovertimeout = 0;
+    // Number of failover pools to keep connected as hot standby
+    unsigned m_failoverStandby = 0;
+    // Let the pool latency scores pick the active pool
+    bool m_failoverLatency = false;
 
 	bool m_show_hwmonitors = false;
 	bool m_show_power = false;
@@ -215,4 +245,11 @@ private:
 	std::string m_coinbase_addr;
 
 	bool m_report_stratum_hashrate = false;
+
+    // Metrics endpoint, disabled while the port is 0
+    std::string m_apiBind = "127.0.0.1";
+    unsigned m_apiPort = 0;
+
+    // Pipeline trace written on exit and SIGUSR1, tracing is off while empty
+    std::string m_traceFile;
 };
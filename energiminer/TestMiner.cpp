@@ -11,8 +11,8 @@
 
 namespace energi
 {
-  TestMiner::TestMiner(const Plant& plant, unsigned index)
-  :Miner("test", plant, index)
+  TestMiner::TestMiner(const Plant& plant, unsigned index, unsigned device)
+  :Miner("test", plant, index, device)
   {
 
   }
@@ -18,7 +18,7 @@ namespace energi
   class TestMiner : public Miner
   {
   public:
-    TestMiner(const Plant& plant, unsigned index);
+    TestMiner(const Plant& plant, unsigned index, unsigned device);
     virtual ~TestMiner()
     {}
 
@@ -30,13 +30,13 @@
 #define ETHASH_DATASET_PARENTS 256
 #define NODE_WORDS (64/4)
 
-//this kernel supports only exactly 8 threads
-//overwrite whatever is incoming
-#ifdef THREADS_PER_HASH
-#undef THREADS_PER_HASH
+// number of threads working together on one hash, one of 1, 2, 4 or 8.
+// Each thread handles LANES_PER_THREAD of the eight uint4 lanes of the mix.
+#ifndef THREADS_PER_HASH
+#define THREADS_PER_HASH (128 / 16)
 #endif
 
-#define THREADS_PER_HASH (128 / 16)
+#define LANES_PER_THREAD (8 / THREADS_PER_HASH)
 #define HASHES_PER_LOOP (GROUP_SIZE / THREADS_PER_HASH)
 #define FNV_PRIME	0x01000193
 
@@ -316,9 +316,9 @@ __kernel void ethash_search(
 
 	keccak_f1600_no_absorb((uint2*)state, 8, isolate);
 	
-	// Threads work together in this phase in groups of 8.
-	uint const thread_id = gid & 7;
-	uint const hash_id = (gid % GROUP_SIZE) >> 3;
+	// Threads work together in this phase in groups of THREADS_PER_HASH.
+	uint const thread_id = gid & (THREADS_PER_HASH - 1);
+	uint const hash_id = (gid % GROUP_SIZE) / THREADS_PER_HASH;
 
 	for (uint i = 0; i < THREADS_PER_HASH; i++)
 	{
@@ -328,34 +328,46 @@ __kernel void ethash_search(
 
 		barrier(CLK_LOCAL_MEM_FENCE);
 
-		uint4 mix = share[hash_id].uint4s[thread_id & 3];
+		uint4 mix[LANES_PER_THREAD];
+		for (uint l = 0; l != LANES_PER_THREAD; ++l)
+			mix[l] = share[hash_id].uint4s[(thread_id * LANES_PER_THREAD + l) & 3];
 		barrier(CLK_LOCAL_MEM_FENCE);
 
+		// The dag index alternates between two words so that it is never
+		// overwritten before every thread of the group has read it, which
+		// matters on runtimes not executing the group in lock step (e.g. PoCL).
+		// init0 is kept in a third word for the same reason.
 		__local uint *share0 = share[hash_id].uints;
 
 		// share init0
 		if (thread_id == 0)
-			*share0 = mix.x;
+			share0[2] = mix[0].x;
 		barrier(CLK_LOCAL_MEM_FENCE);
-		uint init0 = *share0;
+		uint init0 = share0[2];
 
+		uint slot = 0;
 		for (uint a = 0; a < ACCESSES; a += 4)
 		{
-			bool update_share = thread_id == ((a >> 2) & (THREADS_PER_HASH - 1));
+			uint const lane = (a >> 2) & 7;
+			bool update_share = thread_id == lane / LANES_PER_THREAD;
 
-			for (uint i = 0; i != 4; ++i)
+			for (uint i = 0; i != 4; ++i, slot ^= 1)
 			{
 				if (update_share)
 				{
-					*share0 = fnv(init0 ^ (a + i), ((uint *)&mix)[i]) % DAG_SIZE;
+					share0[slot] = fnv(init0 ^ (a + i), ((uint *)&mix[lane % LANES_PER_THREAD])[i]) % DAG_SIZE;
 				}
 				barrier(CLK_LOCAL_MEM_FENCE);
 
-				mix = fnv4(mix, g_dag[*share0].uint4s[thread_id]);
+				uint const index = share0[slot];
+				for (uint l = 0; l != LANES_PER_THREAD; ++l)
+					mix[l] = fnv4(mix[l], g_dag[index].uint4s[thread_id * LANES_PER_THREAD + l]);
 			}
 		}
+		barrier(CLK_LOCAL_MEM_FENCE);
 
-		share[hash_id].uints[thread_id] = fnv_reduce(mix);
+		for (uint l = 0; l != LANES_PER_THREAD; ++l)
+			share[hash_id].uints[thread_id * LANES_PER_THREAD + l] = fnv_reduce(mix[l]);
 		barrier(CLK_LOCAL_MEM_FENCE);
 
 		if (i == thread_id)
@@ -17,6 +17,9 @@
 #include "common/Log.h"
 
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
 #include <vector>
 #include <iostream>
 
@@ -219,10 +222,58 @@ std::vector<cl::Device> getDevices(std::vector<cl::Platform> const& _platforms,
         if (err.err() != CL_DEVICE_NOT_FOUND)
             throw err;
     }
+    if (devices.empty()) {
+        // CPU only platforms (e.g. PoCL) are used when nothing else is available,
+        // which allows to run the search on machines without a GPU.
+        try
+        {
+            _platforms[platform_num].getDevices(CL_DEVICE_TYPE_CPU, &devices);
+        }
+        catch (cl::Error const& err)
+        {
+            if (err.err() != CL_DEVICE_NOT_FOUND)
+                throw err;
+        }
+    }
     return devices;
 }
 
 
+std::string deviceFingerprint(const cl::Device& device)
+{
+    cl::Platform platform(device.getInfo<CL_DEVICE_PLATFORM>());
+    return platform.getInfo<CL_PLATFORM_NAME>() + "|" + platform.getInfo<CL_PLATFORM_VERSION>() + "|"
+        + device.getInfo<CL_DEVICE_NAME>() + "|" + device.getInfo<CL_DRIVER_VERSION>();
+}
+
+bool readProgramBinary(const boost::filesystem::path& file, std::vector<unsigned char>& binary)
+{
+    boost::filesystem::ifstream in(file, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    binary.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return !binary.empty();
+}
+
+void writeProgramBinary(const boost::filesystem::path& file, const std::vector<unsigned char>& binary, unsigned index)
+{
+    namespace fs = boost::filesystem;
+    // Several devices of the same kind may store the same binary concurrently,
+    // write to a private file first and move it in place.
+    fs::create_directories(file.parent_path());
+    fs::path tmp = file;
+    tmp += "." + std::to_string(index) + ".tmp";
+    {
+        fs::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(binary.data()), binary.size());
+        if (!out) {
+            throw std::runtime_error("write to " + tmp.string() + " failed");
+        }
+    }
+    fs::rename(tmp, file);
+}
+
 } //unnamed namespace
 
 using namespace energi;
@@ -234,7 +285,15 @@ unsigned OpenCLMiner::s_workgroupSize = OpenCLMiner::c_defaultLocalWorkSize;
 unsigned OpenCLMiner::s_initialGlobalWorkSize = OpenCLMiner::c_defaultGlobalWorkSizeMultiplier * OpenCLMiner::c_defaultLocalWorkSize;
 unsigned OpenCLMiner::s_threadsPerHash = 8;
 bool OpenCLMiner::s_adjustWorkSize = false;
-constexpr size_t c_maxSearchResults = 1;
+bool OpenCLMiner::s_autoTune = false;
+constexpr size_t c_maxSearchResults = 4;
+
+/// Candidates benchmarked by the auto-tuner
+constexpr unsigned c_tuneThreadsPerHash[] = { 2, 4, 8 };
+constexpr unsigned c_tuneLocalWorkSizes[] = { 64, 128, 256 };
+constexpr unsigned c_tuneGlobalMultipliers[] = { 1024, 2048, 4096, 8192, 16384 };
+/// Time spent measuring a single candidate
+const std::chrono::milliseconds c_tuneWindow(250);
 
 unsigned OpenCLMiner::s_platformId = 0;
 unsigned OpenCLMiner::s_numInstances = 0;
@@ -270,8 +329,8 @@ struct OpenCLMiner::clInfo
     cl::Buffer              searchBuffer_;
 };
 
-OpenCLMiner::OpenCLMiner(const Plant& plant, unsigned index)
-    : Miner("GPU/", plant, index)
+OpenCLMiner::OpenCLMiner(const Plant& plant, unsigned index, unsigned device)
+    : Miner("GPU/", plant, index, device)
 {
 }
 
@@ -396,14 +455,6 @@ bool OpenCLMiner::configureGPU(
 void OpenCLMiner::trun()
 {
     setThreadName("OpenCL");
-    // Memory for zero-ing buffers. Cannot be static because crashes on macOS.
-    uint32_t const c_zero = 0;
-    uint64_t startNonce = 0;
-
-    const uint8_t kIntervalPasses = 4;  // must be a power of 2 passes
-    // this gives each miner a pretty big range of nonces, supporting up to 16 miners.
-    // TODO: get smarter about how many miners we support.
-    //uint64_t const nonceSegment = static_cast<uint64_t>(m_index) << (64 - 4);
     try {
         while (!shouldStop()) {
             if (is_mining_paused()) {
@@ -424,80 +475,148 @@ void OpenCLMiner::trun()
             if (m_current != work) {
                 if (!m_dagLoaded || ((work.nHeight / nrghash::constants::EPOCH_LENGTH) != (m_lastHeight / nrghash::constants::EPOCH_LENGTH))) {
                     if (s_dagLoadMode == DAG_LOAD_MODE_SEQUENTIAL) {
-                        while (s_dagLoadIndex < m_index)
-                            std::this_thread::sleep_for(std::chrono::seconds(1));
-                        ++s_dagLoadIndex;
+                        waitForDagLoadTurn();
                     }
+                    m_telemetry.dag(DagState::Loading, work.nHeight / nrghash::constants::EPOCH_LENGTH);
                     init_dag(work.nHeight);
                     m_dagLoaded = true;
+                    m_telemetry.dag(DagState::Ready, work.nHeight / nrghash::constants::EPOCH_LENGTH);
+                    if (s_dagLoadMode == DAG_LOAD_MODE_SEQUENTIAL) {
+                        dagLoadFinished();
+                    }
                 }
                 m_lastHeight = work.nHeight;
+                m_telemetry.workHeight(work.nHeight);
                 m_current = work;
-                energi::CBlockHeaderTruncatedLE truncatedBlockHeader(m_current);
-                nrghash::h256_t hash_header(&truncatedBlockHeader, sizeof(truncatedBlockHeader));
+            }
+            energi::CBlockHeaderTruncatedLE truncatedBlockHeader(m_current);
+            nrghash::h256_t hash_header(&truncatedBlockHeader, sizeof(truncatedBlockHeader));
 
-                // Upper 64 bits of the boundary.
-                const uint64_t target = *reinterpret_cast<uint64_t const *>((m_current.hashTarget >> 192).data());
-                assert(target > 0);
+            // Upper 64 bits of the boundary.
+            const uint64_t target = *reinterpret_cast<uint64_t const *>((m_current.hashTarget >> 192).data());
+            assert(target > 0);
+            uint64_t startNonce = m_plant.getStartNonce(m_current, m_index);
 
-                // Update header constant buffer.
-                m_queue.enqueueWriteBuffer(m_header, CL_FALSE, 0, hash_header.hash_size, &hash_header.b[0]);
-                m_queue.enqueueWriteBuffer(m_searchBuffer, CL_FALSE, 0, sizeof(c_zero), &c_zero);
+            search(hash_header.data(), target, startNonce, m_current);
+        }
+        m_queue.finish();
+        releaseResultBuffers();
+    } catch (cl::Error const& _e) {
+        cwarn << name() << " OpenCL Error: " << CLErrorHelper(_e);
+    }
+}
+
+void OpenCLMiner::onSetWork()
+{
+    m_new_work.store(true, std::memory_order_relaxed);
+}
+
+void OpenCLMiner::enqueueSearch(unsigned index, uint64_t startNonce)
+{
+    // Kernel, result readback and buffer reset are queued back to back so that
+    // the device never waits on the host between two batches.
+    m_searchKernel.setArg(0, m_searchBuffer[index]);
+    m_searchKernel.setArg(3, startNonce);
+    m_queue.enqueueNDRangeKernel(m_searchKernel, cl::NullRange, globalWorkSize_, workgroupSize_);
+    m_queue.enqueueReadBuffer(m_searchBuffer[index], CL_FALSE, 0, (c_maxSearchResults + 1) * sizeof(uint32_t),
+                              m_results[index], nullptr, &m_readEvent[index]);
+    m_queue.enqueueFillBuffer(m_searchBuffer[index], cl_uint(0), 0, sizeof(cl_uint));
+    m_queue.flush();
+    m_telemetry.kernelLaunched();
+}
+
+void OpenCLMiner::search(uint8_t const* header, uint64_t target, uint64_t startN, Work& work)
+{
+    const uint8_t kReportingInterval = 4;  // must be a power of 2 passes
 
-                m_searchKernel.setArg(0, m_searchBuffer);  // Supply output buffer to kernel.
-                m_searchKernel.setArg(4, target);
+    // Header is a local of the caller, the write has to complete before returning.
+    m_queue.enqueueWriteBuffer(m_header, CL_TRUE, 0, 32, header);
+    m_searchKernel.setArg(4, target);
 
-                startNonce = m_plant.getStartNonce(m_current, m_index);
+    uint64_t current_nonce = startN;
+    uint64_t batchNonce[c_bufferCount];
+
+    // prime each buffer with a batch
+    for (unsigned i = 0; i < c_bufferCount; ++i, current_nonce += globalWorkSize_) {
+        batchNonce[i] = current_nonce;
+        enqueueSearch(i, current_nonce);
+    }
+    hashingStarted(work);
+
+    // process batches until we get new work.
+    bool done = false;
+    bool stop = false;
+    while (!done) {
+        bool t = true;
+        if (m_new_work.compare_exchange_strong(t, false)) {
+            done = true;
+        }
+        for (unsigned i = 0; i < c_bufferCount; ++i) {
+            m_readEvent[i].wait();
+
+            // Copy the results out of the pinned buffer so that it can be
+            // reused by the next batch right away.
+            uint32_t results[c_maxSearchResults + 1];
+            std::copy(m_results[i], m_results[i] + c_maxSearchResults + 1, results);
+            uint64_t const nonceBase = batchNonce[i];
+
+            if (shouldStop()) {
+                m_new_work.store(false, std::memory_order_relaxed);
+                done = true;
+                stop = true;
+            } else if (is_mining_paused()) {
+                // Leave like on stop, trun() waits until the device is resumed
+                done = true;
+                stop = true;
+            }
+            // restart the buffer on the next batch of nonces
+            if (!done) {
+                batchNonce[i] = current_nonce;
+                enqueueSearch(i, current_nonce);
+                current_nonce += globalWorkSize_;
             }
 
-            // Run the kernel.
-            m_searchKernel.setArg(3, startNonce);
-            m_queue.enqueueNDRangeKernel(m_searchKernel, cl::NullRange, globalWorkSize_, workgroupSize_);
-
-            // Read results.
-            // TODO: could use pinned host pointer instead.
-            uint32_t results[c_maxSearchResults + 1] = { 0 };
-            m_queue.enqueueReadBuffer(m_searchBuffer, CL_TRUE, 0, sizeof(results), &results);
-
-            uint64_t nonce = 0;
-            if (results[0] > 0) {
-                // Ignore results except the first one.
-                nonce = startNonce + results[1];
-                // Reset search buffer if any solution found.
-                m_queue.enqueueWriteBuffer(m_searchBuffer, CL_TRUE, 0, sizeof(c_zero), &c_zero);
+            m_hashCount += globalWorkSize_;
+            if ((++m_searchPasses & (kReportingInterval - 1)) == 0) {
+                updateHashRate(m_hashCount);
+                m_hashCount = 0;
             }
 
-            // Report results while the kernel is running.
+            // Report results while the next batch is running.
             // It takes some time because proof of work must be re-evaluated on CPU.
-            if (nonce != 0) {
-                m_current.nNonce = nonce;
-                auto const powHash = GetPOWHash(m_current);
-                if (UintToArith256(powHash) <= m_current.hashTarget) {
-                    cllog << name() << " Submitting block blockhash: " << m_current.GetHash().ToString() << " height: " << m_current.nHeight << " nonce: " << nonce;
-                    Solution solution(m_current, m_current.getSecondaryExtraNonce());
-                    m_plant.submitProof(solution);
+            uint32_t const found = std::min<uint32_t>(results[0], c_maxSearchResults);
+            for (uint32_t j = 1; j <= found; ++j) {
+                work.nNonce = nonceBase + results[j];
+                if (verifySolution(work)) {
+                    cllog << name() << " Submitting block blockhash: " << work.GetHash().ToString() << " height: " << work.nHeight << " nonce: " << work.nNonce;
+                    submitSolution(work);
                 } else {
-                    cwarn << name() << " CL Miner proposed invalid solution: " << m_current.GetHash().ToString() << " nonce: " << nonce;
+                    cwarn << name() << " CL Miner proposed invalid solution: " << work.GetHash().ToString() << " nonce: " << work.nNonce;
                 }
             }
-            // Increase start nonce for following kernel execution.
-            startNonce += globalWorkSize_;
-            m_hashCount += globalWorkSize_;
-            if ((++m_searchPasses & (kIntervalPasses - 1)) == 0) {
-                updateHashRate(m_hashCount);
-                m_hashCount = 0;
-            }
+        }
+    }
 
-            // Make sure the last buffer write has finished --
-            // it reads local variable.
-            m_queue.finish();
+    if (!stop) {
+        auto const switchTime = workSwitched();
+        if (g_logVerbosity >= 6) {
+            cllog << "Switch time: "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(switchTime).count() << " ms.";
         }
-        m_queue.finish();
-    } catch (cl::Error const& _e) {
-        cwarn << name() << " OpenCL Error: " << CLErrorHelper(_e);
     }
 }
 
+void OpenCLMiner::releaseResultBuffers()
+{
+    for (unsigned i = 0; i < c_bufferCount; ++i) {
+        if (m_results[i]) {
+            m_queue.enqueueUnmapMemObject(m_resultBuffer[i], m_results[i]);
+            m_results[i] = nullptr;
+        }
+    }
+    m_queue.finish();
+}
+
 
 std::tuple<bool, cl::Device, int, int, std::string> OpenCLMiner::getDeviceInfo(int index)
 {
@@ -569,129 +688,464 @@ std::tuple<bool, cl::Device, int, int, std::string> OpenCLMiner::getDeviceInfo(i
     return std::make_tuple(true, device, platformId, computeCapability, std::string(options));
 }
 
-bool OpenCLMiner::init_dag(uint32_t height)
+std::string OpenCLMiner::kernelSource(unsigned groupSize, unsigned threadsPerHash) const
 {
-    // get all platforms
+    // patch source code
+    // note: CLMiner_kernel is simply ethash_cl_miner_kernel.cl compiled
+    // into a byte array by bin2h.cmake. There is no need to load the file by hand in runtime
+    // TODO: Just use C++ raw string literal.
+    std::string code(CLMiner_kernel, CLMiner_kernel + sizeof(CLMiner_kernel));
+
+    addDefinition(code, "GROUP_SIZE", groupSize);
+    addDefinition(code, "DAG_SIZE", m_dagSize128);
+    addDefinition(code, "LIGHT_SIZE", m_lightSize64);
+    addDefinition(code, "ACCESSES", nrghash::constants::ACCESSES);
+    addDefinition(code, "MAX_OUTPUTS", c_maxSearchResults);
+    addDefinition(code, "PLATFORM", m_platform);
+    addDefinition(code, "COMPUTE", m_computeCapability);
+    addDefinition(code, "THREADS_PER_HASH", threadsPerHash);
+    return code;
+}
+
+bool OpenCLMiner::buildProgram(cl::Program& program, const cl::Device& device, const std::string& code, const std::string& options)
+{
+    using namespace std::chrono;
+    auto const start = steady_clock::now();
+
+    // The patched source carries every injected define, so hashing it together with
+    // the platform, driver and device identifies the binary completely.
+    std::string const key = deviceFingerprint(device) + "|" + options + "|" + code;
+    nrghash::h256_t const keyHash(key.data(), key.size());
+    boost::filesystem::path const cacheFile = GetDataDir() / "kernels" / (keyHash.to_hex() + ".bin");
+
+    std::vector<unsigned char> binary;
+    if (readProgramBinary(cacheFile, binary)) {
+        try {
+            program = cl::Program(m_context, {device}, cl::Program::Binaries{binary});
+            program.build({device}, options.c_str());
+            cllog << name() << " Loaded OpenCL program " << cacheFile.filename().string() << " in "
+                  << duration_cast<milliseconds>(steady_clock::now() - start).count() << " ms.";
+            return true;
+        } catch (cl::Error const& err) {
+            cwarn << name() << " Cached OpenCL program rejected" << CLErrorHelper(err) << ". Building from source.";
+        }
+    }
+
+    cl::Program::Sources sources{{code.data(), code.size()}};
+    program = cl::Program(m_context, sources);
     try {
-        uint32_t const epoch = height / nrghash::constants::EPOCH_LENGTH;
-        cllog << name() << " Generating DAG for epoch #" << epoch;
-        auto deviceResult = getDeviceInfo(m_index);
-        // create context
-        auto device = std::get<1>(deviceResult);
-        m_context  = cl::Context(std::vector<cl::Device>(&device, &device + 1));
-        m_queue    = cl::CommandQueue(m_context, device);
-
-        workgroupSize_        = s_workgroupSize;
-        globalWorkSize_       = s_initialGlobalWorkSize;
-
-
-        if (s_adjustWorkSize) {
-            unsigned int computeUnits;
-            clGetDeviceInfo(device(), CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(computeUnits), &computeUnits, NULL);
-            // Apparently some 36 CU devices return a bogus 14!!!
-            auto platformId = std::get<2>(deviceResult);
-            computeUnits = computeUnits == 14 ? 36 : computeUnits;
-            if ((platformId == OPENCL_PLATFORM_AMD) && (computeUnits != 36)) {
-                globalWorkSize_ = (globalWorkSize_ * computeUnits) / 36;
-                // make sure that global work size is evenly divisible by the local workgroup size
-                if (globalWorkSize_ % workgroupSize_ != 0)
-                    globalWorkSize_ = ((globalWorkSize_ / workgroupSize_) + 1) * workgroupSize_;
-                cnote << "Adjusting CL work multiplier for " << computeUnits << " CUs."
-                    << " Adjusted work multiplier: " << globalWorkSize_ / workgroupSize_;
+        program.build({device}, options.c_str());
+    } catch (cl::Error const&) {
+        cwarn << name() << " Build info: " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device);
+        cwarn << name() << " Failed" ;
+        return false;
+    }
+    cllog << name() << " Built OpenCL program in "
+          << duration_cast<milliseconds>(steady_clock::now() - start).count() << " ms.";
+
+    try {
+        auto const binaries = program.getInfo<CL_PROGRAM_BINARIES>();
+        if (!binaries.empty() && !binaries[0].empty()) {
+            writeProgramBinary(cacheFile, binaries[0], m_index);
+        }
+    } catch (cl::Error const& err) {
+        cwarn << name() << " Unable to retrieve OpenCL program binary" << CLErrorHelper(err);
+    } catch (std::exception const& e) {
+        cwarn << name() << " Unable to cache OpenCL program binary: " << e.what();
+    }
+    return true;
+}
+
+boost::filesystem::path OpenCLMiner::tuningFile(const cl::Device& device)
+{
+    std::string const fingerprint = deviceFingerprint(device);
+    nrghash::h256_t const hash(fingerprint.data(), fingerprint.size());
+    return GetDataDir() / "tuning" / (hash.to_hex() + ".txt");
+}
+
+bool OpenCLMiner::loadTuning(const cl::Device& device)
+{
+    boost::filesystem::ifstream in(tuningFile(device));
+    unsigned local = 0, global = 0, threads = 0;
+    if (!(in >> local >> global >> threads) || local == 0 || global % local != 0 || threads == 0) {
+        return false;
+    }
+    workgroupSize_ = local;
+    globalWorkSize_ = global;
+    m_threadsPerHash = threads;
+    cllog << name() << " Using tuned work sizes: local " << workgroupSize_
+          << ", work multiplier " << globalWorkSize_ / workgroupSize_
+          << ", threads per hash " << m_threadsPerHash;
+    return true;
+}
+
+void OpenCLMiner::saveTuning(const cl::Device& device)
+{
+    try {
+        boost::filesystem::path const file = tuningFile(device);
+        boost::filesystem::create_directories(file.parent_path());
+        boost::filesystem::ofstream out(file, std::ios::trunc);
+        out << workgroupSize_ << " " << globalWorkSize_ << " " << m_threadsPerHash << std::endl;
+    } catch (std::exception const& e) {
+        cwarn << name() << " Unable to store tuning result: " << e.what();
+    }
+}
+
+void OpenCLMiner::autoTune(const cl::Device& device, const std::string& options)
+{
+    using namespace std::chrono;
+    cllog << name() << " Auto-tuning work sizes, this takes a moment...";
+
+    // A zero target never yields results, the output buffer is only there to satisfy the kernel.
+    cl::Buffer output(m_context, CL_MEM_WRITE_ONLY, (c_maxSearchResults + 1) * sizeof(uint32_t));
+    m_queue.enqueueFillBuffer(m_header, cl_uint(0), 0, 32);
+
+    size_t const maxGroupSize = device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
+    double bestRate = 0;
+    for (unsigned threads : c_tuneThreadsPerHash) {
+        for (unsigned local : c_tuneLocalWorkSizes) {
+            if (local > maxGroupSize) {
+                continue;
+            }
+            cl::Program program;
+            if (!buildProgram(program, device, kernelSource(local, threads), options)) {
+                continue;
+            }
+            cl::Kernel kernel(program, "ethash_search");
+            if (kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device) < local) {
+                continue;
+            }
+            kernel.setArg(0, output);
+            kernel.setArg(1, m_header);
+            kernel.setArg(2, m_dag);
+            kernel.setArg(3, uint64_t(0));
+            kernel.setArg(4, uint64_t(0));
+            kernel.setArg(5, ~0u);
+
+            for (unsigned multiplier : c_tuneGlobalMultipliers) {
+                unsigned const global = local * multiplier;
+
+                // warm up and estimate the duration of a single pass
+                auto start = steady_clock::now();
+                m_queue.enqueueNDRangeKernel(kernel, cl::NullRange, global, local);
+                m_queue.finish();
+                auto const pass = steady_clock::now() - start;
+
+                unsigned passes = 1;
+                if (pass < c_tuneWindow && pass.count() > 0) {
+                    passes = static_cast<unsigned>(c_tuneWindow / pass);
+                }
+                start = steady_clock::now();
+                for (unsigned i = 0; i < passes; ++i) {
+                    m_queue.enqueueNDRangeKernel(kernel, cl::NullRange, global, local);
+                }
+                m_queue.finish();
+                double const seconds = duration<double>(steady_clock::now() - start).count();
+                double const rate = seconds > 0 ? double(global) * passes / seconds : 0;
+                if (g_logVerbosity >= 6) {
+                    cllog << name() << " local " << local << " multiplier " << multiplier
+                          << " threads per hash " << threads << ": " << rate / 1000000 << " MH/s";
+                }
+                if (rate > bestRate) {
+                    bestRate = rate;
+                    workgroupSize_ = local;
+                    globalWorkSize_ = global;
+                    m_threadsPerHash = threads;
+                }
+                // larger batches only take longer, the device is saturated already
+                if (pass >= c_tuneWindow) {
+                    break;
+                }
             }
         }
-        nrghash::cache_t  cache = nrghash::cache_t(height);
-        uint64_t dagSize = nrghash::dag_t::get_full_size(height);//dag->size();
-        uint32_t dagSize128 = (unsigned)(dagSize / nrghash::constants::MIX_BYTES);
-        uint32_t lightSize64 = (unsigned)(cache.data().size()); //dag->get_cache().data().size();
-        // patch source code
-        // note: CLMiner_kernel is simply ethash_cl_miner_kernel.cl compiled
-        // into a byte array by bin2h.cmake. There is no need to load the file by hand in runtime
-        // TODO: Just use C++ raw string literal.
-        std::string code(CLMiner_kernel, CLMiner_kernel + sizeof(CLMiner_kernel));
-
-        addDefinition(code, "GROUP_SIZE", workgroupSize_);
-        addDefinition(code, "DAG_SIZE", dagSize128);
-        addDefinition(code, "LIGHT_SIZE", lightSize64);
-        addDefinition(code, "ACCESSES", nrghash::constants::ACCESSES);
-        addDefinition(code, "MAX_OUTPUTS", c_maxSearchResults);
-        addDefinition(code, "PLATFORM", std::get<2>(deviceResult));
-        addDefinition(code, "COMPUTE", std::get<3>(deviceResult));
-        addDefinition(code, "THREADS_PER_HASH", 8); // going to be set to 8 by the kernel either way , kernel only supports 8
+    }
+    m_queue.enqueueFillBuffer(m_header, cl_uint(0), 0, 32);
+    m_queue.finish();
+    cllog << name() << " Tuned work sizes: local " << workgroupSize_
+          << ", work multiplier " << globalWorkSize_ / workgroupSize_
+          << ", threads per hash " << m_threadsPerHash
+          << " (" << bestRate / 1000000 << " MH/s)";
+}
 
-        // create miner OpenCL program
-        cl::Program::Sources sources{{code.data(), code.size()}};
-        cl::Program program(m_context, sources);
-        try {
-            program.build({device}, std::get<4>(deviceResult).c_str());
-        } catch (cl::Error const&) {
-            cwarn << name() << " Build info: " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device);
-            cwarn << name() << " Failed" ;
-            return false;
+bool OpenCLMiner::init_device()
+{
+    auto deviceResult = getDeviceInfo(m_index);
+    if (!std::get<0>(deviceResult)) {
+        return false;
+    }
+    // create context
+    m_device = std::get<1>(deviceResult);
+    m_platform = std::get<2>(deviceResult);
+    m_computeCapability = std::get<3>(deviceResult);
+    m_buildOptions = std::get<4>(deviceResult);
+    m_context  = cl::Context(std::vector<cl::Device>(&m_device, &m_device + 1));
+    m_queue    = cl::CommandQueue(m_context, m_device);
+
+    workgroupSize_        = s_workgroupSize;
+    globalWorkSize_       = s_initialGlobalWorkSize;
+    m_threadsPerHash      = s_threadsPerHash;
+
+    if (s_adjustWorkSize) {
+        unsigned int computeUnits;
+        clGetDeviceInfo(m_device(), CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(computeUnits), &computeUnits, NULL);
+        // Apparently some 36 CU devices return a bogus 14!!!
+        computeUnits = computeUnits == 14 ? 36 : computeUnits;
+        if ((m_platform == OPENCL_PLATFORM_AMD) && (computeUnits != 36)) {
+            globalWorkSize_ = (globalWorkSize_ * computeUnits) / 36;
+            // make sure that global work size is evenly divisible by the local workgroup size
+            if (globalWorkSize_ % workgroupSize_ != 0)
+                globalWorkSize_ = ((globalWorkSize_ / workgroupSize_) + 1) * workgroupSize_;
+            cnote << "Adjusting CL work multiplier for " << computeUnits << " CUs."
+                << " Adjusted work multiplier: " << globalWorkSize_ / workgroupSize_;
         }
+    }
+    m_tuned = s_autoTune && loadTuning(m_device);
+
+    // create buffer for header
+    m_header = cl::Buffer(m_context, CL_MEM_READ_ONLY, 32);
+
+    // create mining buffers, results are read back through host allocated
+    // buffers which stay mapped for the lifetime of the context.
+    for (unsigned i = 0; i < c_bufferCount; ++i) {
+        m_searchBuffer[i] = cl::Buffer(m_context, CL_MEM_WRITE_ONLY, (c_maxSearchResults + 1) * sizeof(uint32_t));
+        m_resultBuffer[i] = cl::Buffer(m_context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, (c_maxSearchResults + 1) * sizeof(uint32_t));
+        m_results[i] = static_cast<uint32_t*>(m_queue.enqueueMapBuffer(m_resultBuffer[i], CL_TRUE, CL_MAP_READ | CL_MAP_WRITE,
+                                                                       0, (c_maxSearchResults + 1) * sizeof(uint32_t)));
+        m_queue.enqueueFillBuffer(m_searchBuffer[i], cl_uint(0), 0, sizeof(cl_uint));
+    }
+    m_deviceReady = true;
+    return true;
+}
 
-        // create buffer for dag
-        std::vector<uint32_t> vData;
-        for (auto &d : cache.data()) {
-            for ( auto &dv : d) {
-                vData.push_back(dv.hword);
-            }
+bool OpenCLMiner::reserveBuffers(uint32_t height, bool withDag)
+{
+    uint64_t const dagSize = withDag ? nrghash::dag_t::get_full_size(height) : 0;
+    uint64_t const lightSize = nrghash::cache_t::get_cache_size(height);
+    if (dagSize <= m_dagCapacity && lightSize <= m_lightCapacity) {
+        return true;
+    }
+
+    cl_ulong globalMem = 0;
+    cl_ulong maxAlloc = 0;
+    m_device.getInfo(CL_DEVICE_GLOBAL_MEM_SIZE, &globalMem);
+    m_device.getInfo(CL_DEVICE_MAX_MEM_ALLOC_SIZE, &maxAlloc);
+    if (globalMem < dagSize) {
+        cllog << name() << " OpenCL device " << m_device.getInfo<CL_DEVICE_NAME>()
+            << " has insufficient GPU memory. " << FormattedMemSize(globalMem)
+            << " of memory found < " << FormattedMemSize(dagSize) << " of memory required";
+        return false;
+    }
+
+    // Size the buffers for a few epochs ahead so that following epoch switches
+    // only regenerate the DAG in place. Fall back to the exact size if the
+    // device cannot hold the reserve.
+    uint64_t const reserveHeight = height + c_reservedEpochs * nrghash::constants::EPOCH_LENGTH;
+    uint64_t dagCapacity = withDag ? nrghash::dag_t::get_full_size(reserveHeight) : 0;
+    uint64_t lightCapacity = nrghash::cache_t::get_cache_size(reserveHeight);
+    if (dagCapacity + lightCapacity > globalMem || dagCapacity > maxAlloc) {
+        dagCapacity = dagSize;
+        lightCapacity = lightSize;
+    }
+
+    // release the old buffers first, both may not fit at the same time
+    if (withDag) {
+        m_dag = cl::Buffer();
+        m_dagCapacity = 0;
+    }
+    m_light = cl::Buffer();
+    m_lightCapacity = 0;
+    try {
+        m_light = cl::Buffer(m_context, CL_MEM_READ_ONLY, lightCapacity);
+        if (withDag) {
+            m_dag = cl::Buffer(m_context, CL_MEM_READ_ONLY, dagCapacity);
         }
+    } catch (cl::Error const& err) {
+        cwarn << name() << "Creating DAG buffer failed: " << err.what() << err.err();
+        return false;
+    }
+    if (withDag) {
+        m_dagCapacity = dagCapacity;
+    }
+    m_lightCapacity = lightCapacity;
+    return true;
+}
 
-        cl_ulong result = 0;
-        device.getInfo(CL_DEVICE_GLOBAL_MEM_SIZE, &result);
-        if (result < dagSize) {
-            cllog << name() << " OpenCL device " << device.getInfo<CL_DEVICE_NAME>()
-                << " has insufficient GPU memory. " << FormattedMemSize(result)
-                << " of memory found < " << FormattedMemSize(dagSize) << " of memory required";
+bool OpenCLMiner::uploadDAG(const std::shared_ptr<HostDAG>& host)
+{
+    using namespace std::chrono;
+    auto const start = steady_clock::now();
+
+    if (m_device.getInfo<CL_DEVICE_HOST_UNIFIED_MEMORY>()) {
+        // Shared memory devices (integrated GPUs, CPU runtimes) use the host copy in place.
+        if (!host->waitFor(host->size(), [this]() { return shouldStop(); })) {
             return false;
         }
-        try {
-            m_light      = cl::Buffer(m_context, CL_MEM_READ_ONLY, sizeof(uint32_t) * vData.size());
-            m_dag        = cl::Buffer(m_context, CL_MEM_READ_ONLY, dagSize);
+        m_dag = cl::Buffer(m_context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, host->size(), host->data());
+        m_dagCapacity = 0; // tied to the host copy of this epoch
+        m_hostDAG = host;
+        cllog << name() << " Using host DAG in place.";
+        return true;
+    }
 
-            m_searchKernel     = cl::Kernel(program, "ethash_search");
-            m_dagKernel        = cl::Kernel(program, "ethash_calculate_dag_item");
+    // Chunks are queued as soon as they are available, so the transfers overlap with
+    // the production of the remaining chunks and with the uploads of the other devices.
+    for (uint64_t offset = 0; offset < host->size(); offset += HostDAG::c_chunkSize) {
+        uint64_t const bytes = std::min(HostDAG::c_chunkSize, host->size() - offset);
+        if (!host->waitFor(offset + bytes, [this]() { return shouldStop(); })) {
+            m_queue.finish();
+            return false;
+        }
+        m_queue.enqueueWriteBuffer(m_dag, CL_FALSE, offset, bytes, host->data() + offset);
+        m_queue.flush();
+    }
+    m_queue.finish();
+    cllog << name() << " Uploaded DAG from host in "
+          << duration_cast<milliseconds>(steady_clock::now() - start).count() << " ms.";
+    return true;
+}
 
-            //ETHCL_LOG("Creating light buffer");
+void OpenCLMiner::readbackDAG(HostDAG& host)
+{
+    std::vector<cl::Event> chunks;
+    for (uint64_t offset = 0; offset < host.size(); offset += HostDAG::c_chunkSize) {
+        uint64_t const bytes = std::min(HostDAG::c_chunkSize, host.size() - offset);
+        chunks.emplace_back();
+        m_queue.enqueueReadBuffer(m_dag, CL_FALSE, offset, bytes, host.data() + offset, nullptr, &chunks.back());
+    }
+    m_queue.flush();
+    // hand out every chunk to the other devices as soon as it arrived
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        chunks[i].wait();
+        host.publish((i + 1) * HostDAG::c_chunkSize);
+    }
+}
 
-            m_queue.enqueueWriteBuffer(m_light, CL_TRUE, 0, sizeof(uint32_t) * vData.size(), vData.data());
-        } catch (cl::Error const& err) {
-            cwarn << name() << "Creating DAG buffer failed: " << err.what() << err.err();
+bool OpenCLMiner::init_dag(uint32_t height)
+{
+    std::shared_ptr<HostDAG> host;
+    bool produce = false;
+    // A producer leaving before it published the whole copy fails it, so no consumer waits for it
+    struct ProducerGuard
+    {
+        std::shared_ptr<HostDAG>& host;
+        bool& produce;
+        ~ProducerGuard()
+        {
+            if (produce && host) {
+                host->abort();
+            }
+        }
+    } guard{host, produce};
+    try {
+        if (!m_deviceReady && !init_device()) {
             return false;
         }
+        uint32_t const epoch = height / nrghash::constants::EPOCH_LENGTH;
 
-        // create buffer for header
-        //ETHCL_LOG("Creating buffer for header.");
-        m_header = cl::Buffer(m_context, CL_MEM_READ_ONLY, 32);
+        // A host copy is used when the DAG is in host memory already. In single mode one
+        // device generates the DAG and reads it back for all the others.
+        if (m_hostDAG) {
+            m_dag = cl::Buffer();
+            m_hostDAG.reset();
+        }
+        host = HostDAG::fromActiveDAG(epoch, instances());
+        if (!host && s_dagLoadMode == DAG_LOAD_MODE_SINGLE) {
+            bool created = false;
+            host = HostDAG::acquire(epoch, instances(), created);
+            produce = m_index == std::min(s_dagCreateDevice, instances() - 1);
+        }
+        cllog << name() << (host && !produce ? " Loading DAG for epoch #" : " Generating DAG for epoch #") << epoch;
 
-        m_searchKernel.setArg(1, m_header);
-        m_searchKernel.setArg(2, m_dag);
-        m_searchKernel.setArg(5, ~0u);  // Pass this to stop the compiler unrolling the loops.
+        // Shared memory devices use the host copy in place, a device DAG is only allocated
+        // when they have to generate it after all
+        bool const inPlace = host && !produce && m_device.getInfo<CL_DEVICE_HOST_UNIFIED_MEMORY>();
+        if (!reserveBuffers(height, !inPlace)) {
+            return false;
+        }
 
-        // create mining buffers
-        //ETHCL_LOG("Creating mining buffer");
-        m_searchBuffer = cl::Buffer(m_context, CL_MEM_WRITE_ONLY, (c_maxSearchResults + 1) * sizeof(uint32_t));
+        uint64_t dagSize = nrghash::dag_t::get_full_size(height);//dag->size();
+        m_dagSize128 = (unsigned)(dagSize / nrghash::constants::MIX_BYTES);
+        m_lightSize64 = (unsigned)(nrghash::cache_t::get_cache_size(height) / nrghash::constants::HASH_BYTES);
 
-        uint32_t const work = (uint32_t)(dagSize / sizeof(nrghash::node));
-        uint32_t fullRuns = work / globalWorkSize_;
-        uint32_t const restWork = work % globalWorkSize_;
-        if (restWork > 0) {
-            fullRuns++;
+        // create miner OpenCL program
+        cl::Program program;
+        if (!buildProgram(program, m_device, kernelSource(workgroupSize_, m_threadsPerHash), m_buildOptions)) {
+            return false;
         }
+        m_searchKernel     = cl::Kernel(program, "ethash_search");
+        m_dagKernel        = cl::Kernel(program, "ethash_calculate_dag_item");
+
+        bool loaded = false;
+        if (host && !produce) {
+            loaded = uploadDAG(host);
+            host->release();
+            host.reset();
+            if (!loaded) {
+                if (shouldStop()) {
+                    return false;
+                }
+                cwarn << name() << " Host DAG for epoch #" << epoch << " is not available, generating it.";
+            }
+        }
+        if (!loaded) {
+            if (inPlace && !reserveBuffers(height, true)) {
+                return false;
+            }
+            nrghash::cache_t  cache = nrghash::cache_t(height);
+
+            // upload the light cache row by row straight into the mapped buffer
+            uint64_t const lightSize = cache.size();
+            void* mapped = m_queue.enqueueMapBuffer(m_light, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, 0, lightSize);
+            uint8_t* light = static_cast<uint8_t*>(mapped);
+            for (auto const& row : cache.data()) {
+                std::memcpy(light, row.data(), row.size() * sizeof(nrghash::node));
+                light += row.size() * sizeof(nrghash::node);
+            }
+            m_queue.enqueueUnmapMemObject(m_light, mapped);
 
-        m_dagKernel.setArg(1, m_light);
-        m_dagKernel.setArg(2, m_dag);
-        m_dagKernel.setArg(3, ~0u);
+            uint32_t const work = (uint32_t)(dagSize / sizeof(nrghash::node));
+            uint32_t fullRuns = work / globalWorkSize_;
+            uint32_t const restWork = work % globalWorkSize_;
+            if (restWork > 0) {
+                fullRuns++;
+            }
 
-        for (uint32_t i = 0; i < fullRuns; ++i) {
-            m_dagKernel.setArg(0, i * globalWorkSize_);
-            m_queue.enqueueNDRangeKernel(m_dagKernel, cl::NullRange, globalWorkSize_, workgroupSize_);
+            m_dagKernel.setArg(1, m_light);
+            m_dagKernel.setArg(2, m_dag);
+            m_dagKernel.setArg(3, ~0u);
+
+            for (uint32_t i = 0; i < fullRuns; ++i) {
+                m_dagKernel.setArg(0, i * globalWorkSize_);
+                m_queue.enqueueNDRangeKernel(m_dagKernel, cl::NullRange, globalWorkSize_, workgroupSize_);
+            }
             m_queue.finish();
+
+            if (produce) {
+                readbackDAG(*host);
+                host->release();
+                host.reset();
+            }
         }
 
+        m_searchKernel.setArg(1, m_header);
+        m_searchKernel.setArg(2, m_dag);
+        m_searchKernel.setArg(5, ~0u);  // Pass this to stop the compiler unrolling the loops.
+
         cllog << name() << " Generating DAG for epoch #" << epoch << " finished.";
 
+        if (s_autoTune && !m_tuned) {
+            autoTune(m_device, m_buildOptions);
+            saveTuning(m_device);
+            m_tuned = true;
+            if (!buildProgram(program, m_device, kernelSource(workgroupSize_, m_threadsPerHash), m_buildOptions)) {
+                return false;
+            }
+            m_searchKernel = cl::Kernel(program, "ethash_search");
+            m_searchKernel.setArg(1, m_header);
+            m_searchKernel.setArg(2, m_dag);
+            m_searchKernel.setArg(5, ~0u);
+        }
+
     } catch (cl::Error const& err) {
         cwarn << name() << err.what() << " (" << err.err() << ")";
         return false;
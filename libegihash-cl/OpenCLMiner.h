@@ -8,7 +8,9 @@
 
 #include "nrgcore/plant.h"
 #include "nrgcore/miner.h"
+#include "nrgcore/hostdag.h"
 
+#include <atomic>
 #include <cstdint>
 #include <mutex>
 #include <tuple>
@@ -52,9 +54,13 @@ namespace energi
     static const unsigned c_defaultLocalWorkSize = 128;
     /// Default value of the global work size as a multiplier of the local work size
     static const unsigned c_defaultGlobalWorkSizeMultiplier = 8192;
+    /// Number of search batches kept in flight on the device
+    static const unsigned c_bufferCount = 2;
+    /// Number of future epochs the DAG and light buffers are sized for
+    static const unsigned c_reservedEpochs = 4;
 
 
-    OpenCLMiner(const Plant& plant, unsigned index);
+    OpenCLMiner(const Plant& plant, unsigned index, unsigned device);
 
     virtual ~OpenCLMiner();
 
@@ -82,6 +88,11 @@ namespace energi
       s_threadsPerHash = _threadsPerHash;
     }
 
+    static void setAutoTune(bool _autoTune)
+    {
+      s_autoTune = _autoTune;
+    }
+
     std::tuple<bool, cl::Device, int, int, std::string> getDeviceInfo(int index);
 
     static void setDevices(const std::vector<unsigned>& _devices, unsigned _selectedDeviceCount)
@@ -96,27 +107,63 @@ namespace energi
 
   private:
     void trun() override;
-    void onSetWork() override {}
+    void onSetWork() override;
 
+    bool init_device();
+    /// Grows the light and, unless the DAG is used from host memory, the DAG buffer for height
+    bool reserveBuffers(uint32_t height, bool withDag);
     bool init_dag(uint32_t height);
+    bool uploadDAG(const std::shared_ptr<HostDAG>& host);
+    void readbackDAG(HostDAG& host);
+    std::string kernelSource(unsigned groupSize, unsigned threadsPerHash) const;
+    bool buildProgram(cl::Program& program, const cl::Device& device, const std::string& code, const std::string& options);
+
+    static boost::filesystem::path tuningFile(const cl::Device& device);
+    bool loadTuning(const cl::Device& device);
+    void saveTuning(const cl::Device& device);
+    void autoTune(const cl::Device& device, const std::string& options);
+    void search(uint8_t const* header, uint64_t target, uint64_t startN, Work& work);
+    void enqueueSearch(unsigned index, uint64_t startNonce);
+    void releaseResultBuffers();
 
     struct clInfo;
     clInfo * cl;
 
+	/// long-lived device state, created once per miner
+	cl::Device m_device;
 	cl::Context m_context;
 	cl::CommandQueue m_queue;
 	cl::Kernel m_searchKernel;
 	cl::Kernel m_dagKernel;
 	cl::Buffer m_dag;
 	cl::Buffer m_light;
+	uint64_t   m_dagCapacity = 0;
+	uint64_t   m_lightCapacity = 0;
+	/// host copy the DAG buffer is created from on shared memory devices
+	std::shared_ptr<HostDAG> m_hostDAG;
 	cl::Buffer m_header;
-	cl::Buffer m_searchBuffer;
+	cl::Buffer m_searchBuffer[c_bufferCount];
+	/// Host allocated (pinned) buffers the search results are read back into
+	cl::Buffer m_resultBuffer[c_bufferCount];
+	uint32_t*  m_results[c_bufferCount] = {};
+	cl::Event  m_readEvent[c_bufferCount];
+
+    std::atomic<bool> m_new_work = {false};
 
     uint64_t m_hashCount = 0;
     uint8_t m_searchPasses = 0;
 
     unsigned                globalWorkSize_ = 0;
     unsigned                workgroupSize_ = 0;
+    unsigned                m_threadsPerHash = 8;
+
+    uint32_t                m_dagSize128 = 0;
+    uint32_t                m_lightSize64 = 0;
+    int                     m_platform = OPENCL_PLATFORM_UNKNOWN;
+    int                     m_computeCapability = 0;
+    std::string             m_buildOptions;
+    bool                    m_deviceReady = false;
+    bool                    m_tuned = false;
 
     static std::mutex       m_device_mutex;
 
@@ -130,6 +177,8 @@ namespace energi
     /// The initial global work size for the searches
     static unsigned         s_initialGlobalWorkSize;
     static bool s_adjustWorkSize;
+    /// Benchmark work sizes on first start and reuse the result later on
+    static bool s_autoTune;
 
   };
 
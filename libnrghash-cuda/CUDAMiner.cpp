@@ -38,8 +38,8 @@ struct CUDAChannel: public LogChannel
 
 #define cudalog clog(CUDAChannel)
 
-CUDAMiner::CUDAMiner(const Plant& plant, unsigned index)
-    : Miner("GPU/", plant, index)
+CUDAMiner::CUDAMiner(const Plant& plant, unsigned index, unsigned device)
+    : Miner("GPU/", plant, index, device)
     , m_light(getNumDevices())
 {
 }
@@ -57,15 +57,14 @@ bool CUDAMiner::init_dag(uint32_t height)
         uint32_t epoch = height / nrghash::constants::EPOCH_LENGTH;
         cudalog << name() << " Generating DAG for epoch #" << epoch;
         if (s_dagLoadMode == DAG_LOAD_MODE_SEQUENTIAL)
-            while (s_dagLoadIndex < m_index)
-                this_thread::sleep_for(chrono::milliseconds(100));
+            waitForDagLoadTurn();
         unsigned device = s_devices[m_index] > -1 ? s_devices[m_index] : m_index;
 
         cnote << "Initialising miner " << m_index;
 
         cuda_init(getNumDevices(), height, device, (s_dagLoadMode == DAG_LOAD_MODE_SINGLE),
             s_dagInHostMemory, s_dagCreateDevice);
-        s_dagLoadIndex++;
+        dagLoadFinished();
 
         if (s_dagLoadMode == DAG_LOAD_MODE_SINGLE) {
             if (s_dagLoadIndex >= s_numInstances && s_dagInHostMemory) {
@@ -108,11 +107,14 @@ void CUDAMiner::trun()
 
             if (m_current != work) {
                 if (!m_dagLoaded || ((work.nHeight / nrghash::constants::EPOCH_LENGTH) != (m_lastHeight / nrghash::constants::EPOCH_LENGTH))) {
+                    m_telemetry.dag(DagState::Loading, work.nHeight / nrghash::constants::EPOCH_LENGTH);
                     init_dag(work.nHeight);
                     cnote << "End initialising";
                     m_dagLoaded = true;
+                    m_telemetry.dag(DagState::Ready, work.nHeight / nrghash::constants::EPOCH_LENGTH);
                 }
                 m_lastHeight = work.nHeight;
+                m_telemetry.workHeight(work.nHeight);
                 m_current = work;
             }
             energi::CBlockHeaderTruncatedLE truncatedBlockHeader(m_current);
@@ -450,7 +452,9 @@ void CUDAMiner::search(
         buffer = m_search_buf[current_index];
         buffer->count = 0;
         run_ethash_search(s_gridSize, s_blockSize, stream, buffer, current_nonce, m_parallelHash);
+        m_telemetry.kernelLaunched();
     }
+    hashingStarted(work);
 
     // process stream batches until we get new work.
     bool done = false;
@@ -491,13 +495,12 @@ void CUDAMiner::search(
                     work.nNonce = nonce_base + buffer->result[i].gid;
                     if (s_noeval) {
                         cudalog << name() << " Submitting block blockhash: " << work.GetHash().ToString() << " height: " << work.nHeight << " nonce: " << work.nNonce;
-                        m_plant.submitProof(Solution(work, work.getSecondaryExtraNonce()));
+                        submitSolution(work);
                         break;
                     } else {
-                        auto const powHash = GetPOWHash(work);
-                        if (UintToArith256(powHash) <= work.hashTarget) {
+                        if (verifySolution(work)) {
                             cudalog << name() << " Submitting block blockhash: " << work.GetHash().ToString() << " height: " << work.nHeight << " nonce: " << work.nNonce;
-                            m_plant.submitProof(Solution(work, work.getSecondaryExtraNonce()));
+                            submitSolution(work);
                             break;
                         } else {
                             cwarn << name() << " CUDA Miner proposed invalid solution: " << work.GetHash().ToString() << " nonce: " << work.nNonce;
@@ -508,16 +511,17 @@ void CUDAMiner::search(
             // restart the stream on the next batch of nonces
             if (!done) {
                 run_ethash_search(s_gridSize, s_blockSize, stream, buffer, current_nonce, m_parallelHash);
+                m_telemetry.kernelLaunched();
             }
         }
     }
 
-    if (!stop && (g_logVerbosity >= 6)) {
-        cudalog << "Switch time: "
-                << std::chrono::duration_cast<std::chrono::milliseconds>(
-                       std::chrono::steady_clock::now() - workSwitchStart)
-                       .count()
-                << " ms.";
+    if (!stop) {
+        auto const switchTime = workSwitched();
+        if (g_logVerbosity >= 6) {
+            cudalog << "Switch time: "
+                    << std::chrono::duration_cast<std::chrono::milliseconds>(switchTime).count() << " ms.";
+        }
     }
 }
 
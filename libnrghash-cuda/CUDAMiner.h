@@ -34,7 +34,7 @@ class CUDAMiner: public Miner
 {
 
 public:
-	CUDAMiner(const Plant& plant, unsigned _index);
+	CUDAMiner(const Plant& plant, unsigned _index, unsigned device);
 	~CUDAMiner() override;
 
 	static unsigned instances()
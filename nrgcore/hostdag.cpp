@@ -0,0 +1,143 @@
+/*
+ * hostdag.cpp
+ *
+ * Host copy of the DAG shared by the GPU miners.
+ */
+
+#include "hostdag.h"
+#include "miner.h"
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+using namespace energi;
+
+const uint64_t HostDAG::c_chunkSize;
+const uint64_t HostDAG::c_alignment;
+const unsigned HostDAG::c_stallSeconds;
+
+std::mutex HostDAG::s_mutex;
+std::shared_ptr<HostDAG> HostDAG::s_current;
+
+HostDAG::HostDAG(uint64_t epoch, uint64_t size, unsigned users)
+    : m_epoch(epoch)
+    , m_size(size)
+    , m_memory(new uint8_t[size + c_alignment])
+    , m_users(users)
+{
+    uintptr_t const address = reinterpret_cast<uintptr_t>(m_memory.get());
+    m_data = m_memory.get() + ((c_alignment - address % c_alignment) % c_alignment);
+}
+
+std::shared_ptr<HostDAG> HostDAG::acquire(uint64_t epoch, unsigned users, bool& created)
+{
+    std::lock_guard<std::mutex> lock(s_mutex);
+    created = false;
+    if (s_current && s_current->m_epoch == epoch) {
+        std::lock_guard<std::mutex> l(s_current->m_mutex);
+        if (!s_current->m_failed) {
+            return s_current;
+        }
+    }
+    // drop the copy of the previous epoch first, two DAGs may not fit into host memory
+    s_current.reset();
+    uint64_t const size = nrghash::dag_t::get_full_size(epoch * nrghash::constants::EPOCH_LENGTH);
+    s_current = std::make_shared<HostDAG>(epoch, size, users);
+    created = true;
+    return s_current;
+}
+
+std::shared_ptr<HostDAG> HostDAG::fromActiveDAG(uint64_t epoch, unsigned users)
+{
+    // Holding the DAG keeps it alive for the copy when the active DAG is swapped meanwhile
+    std::shared_ptr<const nrghash::dag_t> const source = Miner::ActiveDAG();
+    if (!source || source->epoch() != epoch) {
+        return nullptr;
+    }
+    bool created = false;
+    auto host = acquire(epoch, users, created);
+    if (created) {
+        std::thread([host, source]() {
+            uint64_t offset = 0;
+            uint64_t next = c_chunkSize;
+            for (auto const& row : source->data()) {
+                uint64_t const bytes = row.size() * sizeof(nrghash::node);
+                if (offset + bytes > host->size()) {
+                    host->abort();
+                    return;
+                }
+                std::memcpy(host->data() + offset, row.data(), bytes);
+                offset += bytes;
+                if (offset >= next) {
+                    host->publish(offset);
+                    next = offset + c_chunkSize;
+                }
+            }
+            if (offset != host->size()) {
+                host->abort();
+                return;
+            }
+            host->publish(offset);
+        }).detach();
+    }
+    return host;
+}
+
+void HostDAG::publish(uint64_t end)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_published = std::min(end, m_size);
+    }
+    m_available.notify_all();
+}
+
+void HostDAG::abort()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_failed = true;
+    }
+    m_available.notify_all();
+}
+
+bool HostDAG::waitFor(uint64_t end, const std::function<bool()>& cancelled)
+{
+    using namespace std::chrono;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    end = std::min(end, m_size);
+    uint64_t progress = m_published;
+    steady_clock::time_point stalled = steady_clock::now() + seconds(c_stallSeconds);
+    while (!m_failed && m_published < end) {
+        m_available.wait_for(lock, milliseconds(100));
+        steady_clock::time_point const now = steady_clock::now();
+        if (m_published != progress) {
+            progress = m_published;
+            stalled = now + seconds(c_stallSeconds);
+        } else if (now >= stalled) {
+            // Later consumers don't wait for the producer either
+            m_failed = true;
+            m_available.notify_all();
+        }
+        if (cancelled && cancelled()) {
+            return false;
+        }
+    }
+    return !m_failed;
+}
+
+void HostDAG::release()
+{
+    bool last = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        last = m_users > 0 && --m_users == 0;
+    }
+    if (last) {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        if (s_current.get() == this) {
+            s_current.reset();
+        }
+    }
+}
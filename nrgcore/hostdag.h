@@ -0,0 +1,102 @@
+/*
+ * hostdag.h
+ *
+ * Host copy of the DAG shared by the GPU miners.
+ */
+
+#ifndef ENERGIMINER_HOSTDAG_H_
+#define ENERGIMINER_HOSTDAG_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace energi {
+
+/**
+ * @brief Contiguous host copy of the DAG of one epoch.
+ *
+ * The copy is filled front to back by a single producer, either by packing the rows of
+ * the active nrghash::dag_t or by the device which generated the DAG and reads it back.
+ * Consumers upload the part which is available already while the rest is still produced,
+ * so all devices load the DAG concurrently from one copy. A producer which makes no progress
+ * for c_stallSeconds, like a paused device, fails the copy so the consumers fall back to
+ * generating the DAG themselves.
+ */
+class HostDAG
+{
+public:
+    /// Granularity producers publish and consumers upload with
+    static const uint64_t c_chunkSize = 32ull * 1024 * 1024;
+    /// Alignment of the host memory, suitable for zero-copy device buffers
+    static const uint64_t c_alignment = 4096;
+    /// Time without progress after which the producer is given up
+    static const unsigned c_stallSeconds = 120;
+
+    HostDAG(uint64_t epoch, uint64_t size, unsigned users);
+    HostDAG(const HostDAG&) = delete;
+    HostDAG& operator=(const HostDAG&) = delete;
+
+    /**
+     * @brief Returns the host copy of the epoch, creating an empty one when there is none.
+     * @param users number of devices which are going to load the copy. It is kept alive
+     *        until all of them called release() or the copy of another epoch is acquired.
+     * @param created set if the caller has to produce the copy
+     */
+    static std::shared_ptr<HostDAG> acquire(uint64_t epoch, unsigned users, bool& created);
+
+    /**
+     * @brief Returns the host copy of the epoch if the active nrghash::dag_t belongs to it.
+     * The rows are packed on a separate thread, nullptr if there is no such DAG.
+     */
+    static std::shared_ptr<HostDAG> fromActiveDAG(uint64_t epoch, unsigned users);
+
+    uint8_t* data()
+    {
+        return m_data;
+    }
+
+    uint64_t size() const
+    {
+        return m_size;
+    }
+
+    uint64_t epoch() const
+    {
+        return m_epoch;
+    }
+
+    /// Marks [0, end) as available
+    void publish(uint64_t end);
+    /// Marks the copy as unusable, waiting consumers return
+    void abort();
+    /**
+     * @brief Blocks until [0, end) is available.
+     * @param cancelled polled while waiting, the wait is given up once it returns true
+     * @return false if the producer failed or stalled or the wait was cancelled
+     */
+    bool waitFor(uint64_t end, const std::function<bool()>& cancelled);
+    /// To be called once by every user after loading its device
+    void release();
+
+private:
+    static std::mutex s_mutex;
+    static std::shared_ptr<HostDAG> s_current;
+
+    uint64_t m_epoch;
+    uint64_t m_size;
+    std::unique_ptr<uint8_t[]> m_memory;
+    uint8_t* m_data;
+
+    mutable std::mutex m_mutex;
+    mutable std::condition_variable m_available;
+    uint64_t m_published = 0;
+    bool m_failed = false;
+    unsigned m_users;
+};
+
+} /* namespace energi */
+
+#endif /* ENERGIMINER_HOSTDAG_H_ */
@@ -22,6 +22,7 @@
 
 #include "common/common.h"
 #include "common/Log.h"
+#include "common/Trace.h"
 
 #include <boost/bind.hpp>
 #include <iostream>
@@ -30,23 +31,23 @@
 using namespace energi;
 
 
-MinerPtr createMiner(EnumMinerEngine minerEngine, int index, const MinePlant &plant)
+MinerPtr createMiner(EnumMinerEngine minerEngine, int index, unsigned device, const MinePlant &plant)
 {
 #if NRGHASHCL
     if (minerEngine == EnumMinerEngine::kCL) {
-        return MinerPtr(new OpenCLMiner(plant, index));
+        return MinerPtr(new OpenCLMiner(plant, index, device));
     }
 #endif
 #if NRGHASHCUDA
     if (minerEngine == EnumMinerEngine::kCUDA) {
-        return MinerPtr(new CUDAMiner(plant, index));
+        return MinerPtr(new CUDAMiner(plant, index, device));
     }
 #endif
     if (minerEngine == EnumMinerEngine::kCPU) {
-        return MinerPtr(new CpuMiner(plant, index));
+        return MinerPtr(new CpuMiner(plant, index, device));
     }
     if (minerEngine == EnumMinerEngine::kTest) {
-        return MinerPtr(new TestMiner(plant, index));
+        return MinerPtr(new TestMiner(plant, index, device));
     }
     return nullptr;
 }
@@ -101,6 +102,8 @@ bool MinePlant::start(const std::vector<EnumMinerEngine> &vMinerEngine)
         return true;
     }
     //m_started = true;
+    // Engines number their devices from 0, the telemetry counts all of them
+    unsigned device = 0;
     for ( auto &minerEngine : vMinerEngine) {
         unsigned count = 0;
 #if NRGHASHCL
@@ -120,7 +123,7 @@ bool MinePlant::start(const std::vector<EnumMinerEngine> &vMinerEngine)
             count = std::thread::hardware_concurrency() - 1;
         }
         for ( unsigned i = 0; i < count; ++i ) {
-            m_miners.push_back(createMiner(minerEngine, i, *this));
+            m_miners.push_back(createMiner(minerEngine, i, device++, *this));
             m_miners.back()->startWorking();
         }
     }
@@ -142,6 +145,7 @@ void MinePlant::stop()
 
 void MinePlant::setWork(const Work& work)
 {
+    TraceSpan span(Trace::c_plantSetWork, work.getJobName());
     std::lock_guard<std::mutex> lock(x_minerWork);
     // if new work hasnt changed, then ignore
     if (work == m_work) {
@@ -172,7 +176,20 @@ void MinePlant::resetWork()
 void MinePlant::submitProof(const Solution& solution) const
 {
     assert(m_onSolutionFound);
-    m_onSolutionFound(solution);
+    m_solutions.push(solution);
+    if (!m_drainPosted.exchange(true)) {
+        m_io_strand.post(boost::bind(&MinePlant::drainSolutions, this));
+    }
+}
+
+void MinePlant::drainSolutions() const
+{
+    // Cleared before popping: a solution pushed later either gets popped here or posts again
+    m_drainPosted = false;
+    Solution solution;
+    while (m_solutions.pop(solution)) {
+        m_onSolutionFound(solution);
+    }
 }
 
 void MinePlant::collectData(const boost::system::error_code& ec)
@@ -180,6 +197,8 @@ void MinePlant::collectData(const boost::system::error_code& ec)
     if (ec)
         return;
 
+    Telemetry::instance().sample();
+
     WorkingProgress progress;
 
     // Process miners
@@ -257,7 +276,10 @@ void MinePlant::collectData(const boost::system::error_code& ec)
         }
     }
 
-    m_progress = progress;
+    {
+        std::lock_guard<std::mutex> lock(x_progress);
+        m_progress = std::move(progress);
+    }
 
     // Resubmit timer for another loop
     m_collectTimer.expires_from_now(boost::posix_time::milliseconds(m_collectInterval));
@@ -290,6 +312,12 @@ uint64_t MinePlant::getStartNonce(const Work& work, unsigned idx) const
     return work.startNonce + range * idx;
 }
 
+WorkingProgress MinePlant::miningProgress() const
+{
+    std::lock_guard<std::mutex> lock(x_progress);
+    return m_progress;
+}
+
 SolutionStats MinePlant::getSolutionStats()
 {
     return m_solutionStats;
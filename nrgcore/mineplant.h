@@ -11,6 +11,7 @@
 #include "plant.h"
 #include "miner.h"
 #include "primitives/solution.h"
+#include "common/MpscQueue.h"
 #include <boost/asio.hpp>
 
 
@@ -100,10 +101,7 @@ public:
     void setWork(const Work& work);
     void resetWork();
     void submitProof(const Solution &sol) const override;
-    const WorkingProgress& miningProgress() const
-    {
-        return m_progress;
-    }
+    WorkingProgress miningProgress() const;
 
     using SolutionFound = std::function<void(Solution const&)>;
     using MinerRestart = std::function<void()>;
@@ -138,6 +136,8 @@ public:
 private:
     // Collects data about hashing and hardware status
     void collectData(const boost::system::error_code& ec);
+    // Passes the queued solutions on to m_onSolutionFound, on the strand
+    void drainSolutions() const;
 
 private:
 	mutable std::mutex                  x_minerWork;
@@ -146,15 +146,21 @@ private:
 
 	std::atomic<bool>                   m_isMining = {false};
 
-	mutable WorkingProgress             m_progress;
+	// Rebuilt by collectData() on the io thread, read by the display
+	mutable std::mutex                  x_progress;
+	WorkingProgress                     m_progress;
 
 	SolutionFound                       m_onSolutionFound;
 	MinerRestart                        m_onMinerRestart;
 
+    // Solutions found by the miners, drained on the io service so mining threads never wait
+    mutable MpscQueue<Solution>         m_solutions;
+    mutable std::atomic<bool>           m_drainPosted = {false};
+
 	//std::map<std::string, SealerDescriptor> m_sealers;
 	//std::string                             m_lastSealer;
 
-    boost::asio::io_service::strand m_io_strand;
+    mutable boost::asio::io_service::strand m_io_strand;
     boost::asio::deadline_timer     m_collectTimer;
     int m_collectInterval = 5000;
     SolutionStats                           m_solutionStats;
@@ -11,6 +11,7 @@
 #include <sstream>
 
 #include "miner.h"
+#include "common/Trace.h"
 
 using namespace energi;
 
@@ -24,18 +25,91 @@ unsigned Miner::s_dagCreateDevice = 0;
 
 uint8_t* Miner::s_dagInHostMemory = nullptr;
 
+std::mutex Miner::s_dagLoadMutex;
+
+std::condition_variable Miner::s_dagLoadCondition;
+
 bool Miner::s_noeval = false;
 
+static_assert(MAX_MINERS <= Telemetry::c_maxDevices, "Every miner needs a telemetry slot");
+
 void Miner::updateHashRate(uint64_t _n)
 {
-    using namespace std::chrono;
-    steady_clock::time_point t = steady_clock::now();
-    auto us = duration_cast<microseconds>(t - m_hashTime).count();
-    m_hashTime = t;
-    float hr = 0.0;
-    if (us)
-        hr = (float(_n) * 1.0e6f) / us;
-    m_hashRate.store(hr, std::memory_order_relaxed);
+    m_telemetry.addHashes(_n);
+}
+
+bool Miner::verifySolution(const Work& work)
+{
+    auto const start = std::chrono::steady_clock::now();
+    bool const valid = UintToArith256(GetPOWHash(work)) <= work.hashTarget;
+    auto const end = std::chrono::steady_clock::now();
+    m_telemetry.shareVerify.record(end - start);
+    Trace::complete(Trace::c_verify, start, end, work.getJobName());
+    return valid;
+}
+
+std::chrono::steady_clock::duration Miner::workSwitched()
+{
+    std::chrono::steady_clock::time_point start;
+    {
+        std::lock_guard<std::mutex> lock(x_work);
+        start = workSwitchStart;
+    }
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+    m_telemetry.workSwitch.record(elapsed);
+    return elapsed;
+}
+
+void Miner::hashingStarted(const Work& work)
+{
+    if (!Trace::enabled()) {
+        return;
+    }
+    std::chrono::steady_clock::time_point start;
+    {
+        // Only the first call after a setWork() is traced, not the resumes on the same work
+        std::lock_guard<std::mutex> lock(x_work);
+        start = m_traceSwitchStart;
+        m_traceSwitchStart = std::chrono::steady_clock::time_point();
+    }
+    if (start == std::chrono::steady_clock::time_point()) {
+        return;
+    }
+    Trace::complete(Trace::c_hashing, start, std::chrono::steady_clock::now(), work.getJobName());
+}
+
+void Miner::submitSolution(const Work& work)
+{
+    const std::shared_ptr<const Work>& last = m_solutionWork;
+    if (!last
+        || last->getJobName() != work.getJobName()
+        || last->hashMerkleRoot != work.hashMerkleRoot
+        || last->hashPrevBlock != work.hashPrevBlock
+        || last->nTime != work.nTime
+        || last->nBits != work.nBits
+        || last->nHeight != work.nHeight
+        || last->nVersion != work.nVersion) {
+        m_solutionWork = std::make_shared<const Work>(work);
+    }
+    m_telemetry.shareFound();
+    Trace::instant(Trace::c_found, work.getJobName());
+    m_plant.submitProof(Solution(m_solutionWork, work.nNonce, work.hashMix,
+                                 work.getSecondaryExtraNonce(), name()));
+}
+
+void Miner::waitForDagLoadTurn()
+{
+    std::unique_lock<std::mutex> lock(s_dagLoadMutex);
+    s_dagLoadCondition.wait(lock, [this]() { return s_dagLoadIndex >= m_index; });
+}
+
+void Miner::dagLoadFinished()
+{
+    {
+        std::lock_guard<std::mutex> lock(s_dagLoadMutex);
+        ++s_dagLoadIndex;
+    }
+    s_dagLoadCondition.notify_all();
 }
 
 bool Miner::LoadNrgHashDAG(uint64_t blockHeight)
@@ -99,22 +173,22 @@ uint256 Miner::GetPOWHash(const BlockHeader& header)
     return uint256(ret.value);
 }
 
-std::unique_ptr<nrghash::dag_t> const & Miner::ActiveDAG(std::unique_ptr<nrghash::dag_t> next_dag)
+std::shared_ptr<nrghash::dag_t> Miner::ActiveDAG(std::unique_ptr<nrghash::dag_t> next_dag)
 {
     using namespace std;
 
     static std::mutex m;
     std::lock_guard<std::mutex> lock(m);
-    static std::unique_ptr<nrghash::dag_t> active; // only keep one DAG in memory at once
+    static std::shared_ptr<nrghash::dag_t> active; // only keep one DAG in memory at once
 
     // if we have a next_dag swap it
     if (next_dag) {
-        active.swap(next_dag);
-    }
-    // unload the previous dag
-    if (next_dag) {
-        next_dag->unload();
-        next_dag.reset();
+        std::shared_ptr<nrghash::dag_t> previous = std::move(active);
+        active = std::move(next_dag);
+        // unload the previous dag, its memory is freed once the last holder let go of it
+        if (previous) {
+            previous->unload();
+        }
     }
     return active;
 }
@@ -217,13 +291,14 @@ void Miner::clear_mining_paused(MinigPauseReason pause_reason)
 
 void Miner::setWork(const Work& work)
 {
+    TraceSpan span(Trace::c_minerSetWork, work.getJobName());
     {
         std::lock_guard<std::mutex> lock(x_work);
         m_work = work;
         m_work.incrementExtraNonce();
         m_newWorkAssigned = true;
-        if (g_logVerbosity >= 6)
-            workSwitchStart = std::chrono::steady_clock::now();
+        workSwitchStart = std::chrono::steady_clock::now();
+        m_traceSwitchStart = workSwitchStart;
     }
     onSetWork();
 }
@@ -9,12 +9,15 @@
 #define ENERGIMINER_MINER_H_
 
 #include "nrgcore/plant.h"
+#include "nrgcore/telemetry.h"
 #include "primitives/worker.h"
 #include "nrghash/nrghash.h"
 
 #include <string>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
 
 #include <tuple>
 #include <memory>
@@ -57,11 +60,13 @@ inline std::ostream& operator<<(std::ostream& os, const FormattedMemSize& s)
 class Miner : public Worker
 {
 public:
-    Miner(const std::string& name, const Plant &plant, unsigned index)
+    /// index counts the devices of the engine, device all the devices of the plant
+    Miner(const std::string& name, const Plant &plant, unsigned index, unsigned device)
         : Worker(name + std::to_string(index))
         , m_lastHeight(0)
         , m_index(index)
         , m_plant(plant)
+        , m_telemetry(Telemetry::instance().registerDevice(device, Worker::name()))
     {
     }
 
@@ -81,9 +86,10 @@ public:
 	void update_temperature(unsigned temperature);
 	bool is_mining_paused() const;
 
+    /// Hashrate averaged over the last minute, see Telemetry::sample()
     float RetrieveHashRate()
     {
-        return m_hashRate.load(std::memory_order_relaxed);
+        return float(m_telemetry.hashRate());
     }
 
     void set_mining_paused(MinigPauseReason pause_reason);
@@ -96,7 +102,8 @@ public:
     static void InitDAG(uint64_t blockHeight, nrghash::progress_callback_type callback);
     static uint256 GetPOWHash(const BlockHeader& header);
 
-    static std::unique_ptr<nrghash::dag_t> const & ActiveDAG(std::unique_ptr<nrghash::dag_t> next_dag  = std::unique_ptr<nrghash::dag_t>());
+    /// Swaps in next_dag if given, returns the active DAG which stays valid while held
+    static std::shared_ptr<nrghash::dag_t> ActiveDAG(std::unique_ptr<nrghash::dag_t> next_dag  = std::unique_ptr<nrghash::dag_t>());
 
 protected:
 	/**
@@ -110,12 +117,35 @@ protected:
         return m_work;
     }
 
+    /// Counts _n more hashes done
     void updateHashRate(uint64_t _n);
 
+    /// Checks the nonce of work on the CPU, which sets its mix hash, and times it
+    bool verifySolution(const Work& work);
+
+    /// Records and returns the time since setWork() asked for the work switch
+    std::chrono::steady_clock::duration workSwitched();
+
+    /// Traces the time from setWork() until the first hash or kernel launch on work, once per setWork()
+    void hashingStarted(const Work& work);
+
+    /**
+     * @brief Hands the nonce and mix hash of work to the plant and returns right away. Solutions
+     * of the same job share one snapshot of it, only taken for the first one.
+     */
+    void submitSolution(const Work& work);
+
+    /// Sequential DAG load mode: blocks until the miners with a lower index loaded their DAG
+    void waitForDagLoadTurn();
+    /// Sequential DAG load mode: lets the next miner load its DAG
+    void dagLoadFinished();
+
     static unsigned s_dagLoadMode;
     static unsigned s_dagLoadIndex;
     static unsigned s_dagCreateDevice;
     static uint8_t* s_dagInHostMemory;
+    static std::mutex s_dagLoadMutex;
+    static std::condition_variable s_dagLoadCondition;
     static bool s_exit;
     static bool s_noeval;
 
@@ -126,7 +156,10 @@ protected:
     unsigned m_index = 0;
     const Plant &m_plant;
     std::chrono::steady_clock::time_point workSwitchStart;
+    // Start of the switch hashingStarted() has yet to trace, cleared once traced
+    std::chrono::steady_clock::time_point m_traceSwitchStart;
 	HwMonitorInfo m_hwmoninfo;
+    DeviceTelemetry& m_telemetry;
 
 protected:
 	Work m_work;
@@ -136,8 +169,8 @@ private:
     MiningPause m_mining_paused;
 	mutable std::mutex x_work;
 
-    std::chrono::steady_clock::time_point m_hashTime = std::chrono::steady_clock::now();
-    std::atomic<float> m_hashRate = {0.0};
+    // Work of the last solution, only used by the mining thread
+    std::shared_ptr<const Work> m_solutionWork;
 };
 
 using MinerPtr = std::shared_ptr<energi::Miner>;
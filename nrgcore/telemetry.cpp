@@ -0,0 +1,219 @@
+/*
+ * telemetry.cpp
+ *
+ * Per device counters, hashrates and latency histograms.
+ */
+
+#include "telemetry.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "common/Log.h"
+
+namespace energi {
+
+const unsigned LatencyHistogram::c_subBucketBits;
+const unsigned LatencyHistogram::c_subBuckets;
+const unsigned LatencyHistogram::c_buckets;
+const unsigned Telemetry::c_maxDevices;
+
+namespace {
+
+// Windows of the hashrate EWMAs
+const double c_window1m = 60.0;
+const double c_window5m = 5 * 60.0;
+const double c_window15m = 15 * 60.0;
+
+double ewma(double average, double rate, double elapsed, double window)
+{
+    return average + (1.0 - std::exp(-elapsed / window)) * (rate - average);
+}
+
+} // namespace
+
+uint64_t LatencySnapshot::percentileUs(double percentile) const
+{
+    if (!count || buckets.empty()) {
+        return 0;
+    }
+    uint64_t const rank = std::max<uint64_t>(1, uint64_t(std::ceil(percentile / 100.0 * count)));
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return std::min(LatencyHistogram::upperBoundOf(i), maxUs);
+        }
+    }
+    return maxUs;
+}
+
+LatencyHistogram::LatencyHistogram()
+    : m_sumUs(0)
+    , m_maxUs(0)
+{
+    for (auto& bucket : m_buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+unsigned LatencyHistogram::bucketOf(uint64_t us)
+{
+    if (us < c_subBuckets) {
+        return unsigned(us);
+    }
+    unsigned shift = 0;
+    while ((us >> shift) >= 2 * c_subBuckets) {
+        ++shift;
+    }
+    unsigned const bucket = (shift + 1) * c_subBuckets + unsigned((us >> shift) & (c_subBuckets - 1));
+    return bucket < c_buckets ? bucket : c_buckets - 1;
+}
+
+uint64_t LatencyHistogram::upperBoundOf(unsigned bucket)
+{
+    if (bucket < c_subBuckets) {
+        return bucket;
+    }
+    unsigned const shift = bucket / c_subBuckets - 1;
+    uint64_t const lower = uint64_t(c_subBuckets + bucket % c_subBuckets) << shift;
+    return lower + (uint64_t(1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t us)
+{
+    m_buckets[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+    m_sumUs.fetch_add(us, std::memory_order_relaxed);
+    uint64_t max = m_maxUs.load(std::memory_order_relaxed);
+    while (us > max && !m_maxUs.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+    }
+}
+
+LatencySnapshot LatencyHistogram::snapshot() const
+{
+    // Not one atomic snapshot, a latency recorded meanwhile may be in some of the fields only
+    LatencySnapshot snapshot;
+    snapshot.buckets.resize(c_buckets);
+    uint64_t count = 0;
+    for (unsigned i = 0; i < c_buckets; ++i) {
+        snapshot.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+        count += snapshot.buckets[i];
+    }
+    snapshot.count = count;
+    snapshot.sumUs = m_sumUs.load(std::memory_order_relaxed);
+    snapshot.maxUs = m_maxUs.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+Telemetry& Telemetry::instance()
+{
+    static Telemetry telemetry;
+    return telemetry;
+}
+
+DeviceTelemetry& Telemetry::registerDevice(unsigned index, const std::string& name)
+{
+    if (index >= c_maxDevices) {
+        cwarn << "No telemetry for " << name << ", only " << c_maxDevices << " devices are tracked";
+        return m_unlisted;
+    }
+    DeviceTelemetry& device = m_devices[index];
+    std::lock_guard<std::mutex> lock(m_namesMutex);
+    const std::string* current = device.m_name.load(std::memory_order_acquire);
+    if (!current || *current != name) {
+        m_names.push_back(name);
+        device.m_name.store(&m_names.back(), std::memory_order_release);
+    }
+    return device;
+}
+
+DeviceTelemetry* Telemetry::find(const std::string& name)
+{
+    for (auto& device : m_devices) {
+        const std::string* current = device.m_name.load(std::memory_order_acquire);
+        if (current && *current == name) {
+            return &device;
+        }
+    }
+    return nullptr;
+}
+
+void Telemetry::sample()
+{
+    auto const now = std::chrono::steady_clock::now();
+    for (auto& device : m_devices) {
+        if (!device.m_name.load(std::memory_order_acquire)) {
+            continue;
+        }
+        uint64_t const hashes = device.m_hashes.load(std::memory_order_relaxed);
+        if (device.m_sampled == std::chrono::steady_clock::time_point()) {
+            // First sample only sets the baseline
+            device.m_sampledHashes = hashes;
+            device.m_sampled = now;
+            continue;
+        }
+        double const elapsed = std::chrono::duration<double>(now - device.m_sampled).count();
+        if (elapsed <= 0.0) {
+            continue;
+        }
+        double const rate = (hashes - device.m_sampledHashes) / elapsed;
+        double rate1m = rate, rate5m = rate, rate15m = rate;
+        // The averages start from the first rate instead of ramping up from zero
+        if (device.m_hashRate1m.load(std::memory_order_relaxed) != 0.0) {
+            rate1m = ewma(device.m_hashRate1m.load(std::memory_order_relaxed), rate, elapsed, c_window1m);
+            rate5m = ewma(device.m_hashRate5m.load(std::memory_order_relaxed), rate, elapsed, c_window5m);
+            rate15m = ewma(device.m_hashRate15m.load(std::memory_order_relaxed), rate, elapsed, c_window15m);
+        }
+        device.m_hashRate.store(rate, std::memory_order_relaxed);
+        device.m_hashRate1m.store(rate1m, std::memory_order_relaxed);
+        device.m_hashRate5m.store(rate5m, std::memory_order_relaxed);
+        device.m_hashRate15m.store(rate15m, std::memory_order_relaxed);
+        device.m_sampledHashes = hashes;
+        device.m_sampled = now;
+    }
+}
+
+std::vector<DeviceSnapshot> Telemetry::snapshot() const
+{
+    std::vector<DeviceSnapshot> snapshots;
+    for (unsigned i = 0; i < c_maxDevices; ++i) {
+        const DeviceTelemetry& device = m_devices[i];
+        const std::string* name = device.m_name.load(std::memory_order_acquire);
+        if (!name) {
+            continue;
+        }
+        DeviceSnapshot snapshot;
+        snapshot.index = i;
+        snapshot.name = *name;
+        snapshot.hashes = device.m_hashes.load(std::memory_order_relaxed);
+        snapshot.kernelLaunches = device.m_kernelLaunches.load(std::memory_order_relaxed);
+        snapshot.sharesFound = device.m_sharesFound.load(std::memory_order_relaxed);
+        snapshot.sharesAccepted = device.m_sharesAccepted.load(std::memory_order_relaxed);
+        snapshot.sharesRejected = device.m_sharesRejected.load(std::memory_order_relaxed);
+        snapshot.sharesStale = device.m_sharesStale.load(std::memory_order_relaxed);
+        snapshot.height = device.m_height.load(std::memory_order_relaxed);
+        snapshot.dagState = DagState(device.m_dagState.load(std::memory_order_relaxed));
+        snapshot.dagEpoch = device.m_dagEpoch.load(std::memory_order_relaxed);
+        snapshot.hashRate = device.m_hashRate.load(std::memory_order_relaxed);
+        snapshot.hashRate1m = device.m_hashRate1m.load(std::memory_order_relaxed);
+        snapshot.hashRate5m = device.m_hashRate5m.load(std::memory_order_relaxed);
+        snapshot.hashRate15m = device.m_hashRate15m.load(std::memory_order_relaxed);
+        snapshot.workSwitch = device.workSwitch.snapshot();
+        snapshot.shareVerify = device.shareVerify.snapshot();
+        snapshot.submitRtt = device.submitRtt.snapshot();
+        snapshots.push_back(std::move(snapshot));
+    }
+    return snapshots;
+}
+
+PipelineSnapshot Telemetry::pipeline() const
+{
+    PipelineSnapshot snapshot;
+    snapshot.queued = jobQueued.snapshot();
+    snapshot.decode = jobDecode.snapshot();
+    snapshot.prepare = jobPrepare.snapshot();
+    snapshot.publish = jobPublish.snapshot();
+    return snapshot;
+}
+
+} /* namespace energi */
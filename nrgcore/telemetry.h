@@ -0,0 +1,260 @@
+/*
+ * telemetry.h
+ *
+ * Per device counters, hashrates and latency histograms.
+ */
+
+#ifndef ENERGIMINER_TELEMETRY_H_
+#define ENERGIMINER_TELEMETRY_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "primitives/txidcache.h"
+
+namespace energi {
+
+/**
+ * @brief Snapshot of a LatencyHistogram.
+ */
+struct LatencySnapshot
+{
+    uint64_t count = 0;
+    uint64_t sumUs = 0;
+    uint64_t maxUs = 0;
+    std::vector<uint64_t> buckets;
+
+    double meanUs() const
+    {
+        return count ? double(sumUs) / count : 0.0;
+    }
+
+    /// Upper bound of the bucket holding the given percentile (0 - 100), in microseconds
+    uint64_t percentileUs(double percentile) const;
+};
+
+/**
+ * @brief Histogram of latencies in microseconds with buckets of logarithmic width.
+ *
+ * As in HDR histograms, each power of two is split into c_subBuckets linear buckets, so
+ * every value is kept within 12.5% from a microsecond up to hours with a few hundred
+ * counters. Recording is a handful of relaxed atomic increments and never blocks.
+ */
+class LatencyHistogram
+{
+public:
+    static const unsigned c_subBucketBits = 3;
+    static const unsigned c_subBuckets = 1u << c_subBucketBits;
+    // The linear range below c_subBuckets and the powers of two above it up to 2^41 us (25 days),
+    // larger values are counted in the last bucket
+    static const unsigned c_buckets = (41 - c_subBucketBits + 1) * c_subBuckets;
+
+    LatencyHistogram();
+
+    void record(uint64_t us);
+
+    void record(std::chrono::steady_clock::duration duration)
+    {
+        auto const us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+        record(us > 0 ? uint64_t(us) : 0);
+    }
+
+    LatencySnapshot snapshot() const;
+
+    static unsigned bucketOf(uint64_t us);
+    /// Largest value falling into the bucket
+    static uint64_t upperBoundOf(unsigned bucket);
+
+private:
+    std::array<std::atomic<uint64_t>, c_buckets> m_buckets;
+    std::atomic<uint64_t> m_sumUs;
+    std::atomic<uint64_t> m_maxUs;
+};
+
+enum class DagState : unsigned
+{
+    None,
+    Loading,
+    Ready
+};
+
+/**
+ * @brief Snapshot of the telemetry of one device.
+ */
+struct DeviceSnapshot
+{
+    unsigned index = 0;
+    std::string name;
+    uint64_t hashes = 0;
+    uint64_t kernelLaunches = 0;
+    uint64_t sharesFound = 0;
+    uint64_t sharesAccepted = 0;
+    uint64_t sharesRejected = 0;
+    uint64_t sharesStale = 0;
+    uint64_t height = 0;
+    DagState dagState = DagState::None;
+    uint64_t dagEpoch = 0;
+    // Hashes per second over the last sampling interval and as EWMAs over 1, 5 and 15 minutes
+    double hashRate = 0.0;
+    double hashRate1m = 0.0;
+    double hashRate5m = 0.0;
+    double hashRate15m = 0.0;
+    LatencySnapshot workSwitch;
+    LatencySnapshot shareVerify;
+    LatencySnapshot submitRtt;
+};
+
+/**
+ * @brief Snapshot of the stage latencies of the stratum job pipeline.
+ */
+struct PipelineSnapshot
+{
+    LatencySnapshot queued;
+    LatencySnapshot decode;
+    LatencySnapshot prepare;
+    LatencySnapshot publish;
+};
+
+/**
+ * @brief Telemetry of one device.
+ *
+ * The mining thread, the pool client and the sampler each write their own cache line, so
+ * counting hashes never contends with anything else.
+ */
+class alignas(64) DeviceTelemetry
+{
+public:
+    void addHashes(uint64_t hashes)
+    {
+        m_hashes.fetch_add(hashes, std::memory_order_relaxed);
+    }
+    void kernelLaunched()
+    {
+        m_kernelLaunches.fetch_add(1, std::memory_order_relaxed);
+    }
+    void shareFound()
+    {
+        m_sharesFound.fetch_add(1, std::memory_order_relaxed);
+    }
+    /// Height of the work the device mines on
+    void workHeight(uint64_t height)
+    {
+        m_height.store(height, std::memory_order_relaxed);
+    }
+    void dag(DagState state, uint64_t epoch)
+    {
+        m_dagEpoch.store(epoch, std::memory_order_relaxed);
+        m_dagState.store(unsigned(state), std::memory_order_relaxed);
+    }
+    void shareAccepted(bool stale)
+    {
+        (stale ? m_sharesStale : m_sharesAccepted).fetch_add(1, std::memory_order_relaxed);
+    }
+    void shareRejected()
+    {
+        m_sharesRejected.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// Hashrate EWMA over one minute, in hashes per second
+    double hashRate() const
+    {
+        return m_hashRate1m.load(std::memory_order_relaxed);
+    }
+
+    LatencyHistogram workSwitch;
+    LatencyHistogram shareVerify;
+    LatencyHistogram submitRtt;
+
+private:
+    friend class Telemetry;
+
+    // Written by the mining thread
+    alignas(64) std::atomic<uint64_t> m_hashes = {0};
+    std::atomic<uint64_t> m_kernelLaunches = {0};
+    std::atomic<uint64_t> m_sharesFound = {0};
+    std::atomic<uint64_t> m_height = {0};
+    std::atomic<unsigned> m_dagState = {0};
+    std::atomic<uint64_t> m_dagEpoch = {0};
+
+    // Written by the pool client
+    alignas(64) std::atomic<uint64_t> m_sharesAccepted = {0};
+    std::atomic<uint64_t> m_sharesRejected = {0};
+    std::atomic<uint64_t> m_sharesStale = {0};
+
+    // Written by the sampler
+    alignas(64) std::atomic<double> m_hashRate = {0.0};
+    std::atomic<double> m_hashRate1m = {0.0};
+    std::atomic<double> m_hashRate5m = {0.0};
+    std::atomic<double> m_hashRate15m = {0.0};
+    std::atomic<const std::string*> m_name = {nullptr};
+
+    // Only touched by the sampler
+    uint64_t m_sampledHashes = 0;
+    std::chrono::steady_clock::time_point m_sampled;
+};
+
+/**
+ * @brief Process wide registry of the telemetry of all devices.
+ *
+ * Devices live in a fixed table indexed by their number in the plant, so the hot paths hold
+ * a reference and never look anything up. Devices past the table share a slot which is not
+ * reported. Snapshots only load atomics and can be taken from any thread
+ * at any time.
+ */
+class Telemetry
+{
+public:
+    static const unsigned c_maxDevices = 32;
+
+    static Telemetry& instance();
+
+    /// Names the device of a miner, its counters keep running if it registered before
+    DeviceTelemetry& registerDevice(unsigned index, const std::string& name);
+
+    /// Device registered under name, nullptr if there is none
+    DeviceTelemetry* find(const std::string& name);
+
+    /**
+     * @brief Turns the hashes counted since the last call into hashrates. Called periodically
+     * by a single thread.
+     */
+    void sample();
+
+    std::vector<DeviceSnapshot> snapshot() const;
+
+    PipelineSnapshot pipeline() const;
+
+    /// Hits and misses of the txids of template transactions
+    TxidCache::Stats txidCache() const
+    {
+        return TxidCache::instance().stats();
+    }
+
+    /// Stages of the stratum job pipeline, from the notify until the plant has the work
+    LatencyHistogram jobQueued;
+    LatencyHistogram jobDecode;
+    LatencyHistogram jobPrepare;
+    LatencyHistogram jobPublish;
+
+private:
+    Telemetry() = default;
+    Telemetry(const Telemetry&) = delete;
+    Telemetry& operator=(const Telemetry&) = delete;
+
+    std::array<DeviceTelemetry, c_maxDevices> m_devices;
+    // Counts for the devices beyond c_maxDevices, never named
+    DeviceTelemetry m_unlisted;
+    // Backing store of the device names, only grows so readers need no lock
+    std::deque<std::string> m_names;
+    std::mutex m_namesMutex;
+};
+
+} /* namespace energi */
+
+#endif /* ENERGIMINER_TELEMETRY_H_ */
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <sstream>
 #include <cstdlib>
+#include <memory>
 #include <vector>
 
 #include "transaction.h"
@@ -11,6 +12,7 @@
 #include "common/serialize.h"
 #include "uint256.h"
 #include "extranoncesingleton.h"
+#include "rawtransactions.h"
 
 namespace energi {
 
@@ -100,9 +102,52 @@ struct BlockHeader
     }
 };
 
+/**
+ * @brief Parameters of a stratum mining.notify job.
+ * Filled either from a parsed Json::Value or directly by the stratum codec,
+ * the hex fields are kept as sent by the pool.
+ */
+struct StratumJob
+{
+    std::string jobName;
+    std::string prevHash;
+    std::string coinbase1;
+    std::string coinbase2;
+    std::vector<std::string> transactions;  // raw hex of the non coinbase transactions
+    std::vector<std::string> txids;         // their txids if the pool sends them, empty otherwise
+    std::string version;
+    std::string bits;
+    std::string time;
+    bool cleanJobs = false;
+    uint32_t height = 0;
+
+    StratumJob() = default;
+
+    explicit StratumJob(const Json::Value& jPrm)
+    {
+        jobName = jPrm.get((Json::Value::ArrayIndex)0, "").asString();
+        prevHash = jPrm.get((Json::Value::ArrayIndex)1, "").asString();
+        coinbase1 = jPrm.get((Json::Value::ArrayIndex)2, "").asString();
+        coinbase2 = jPrm.get((Json::Value::ArrayIndex)3, "").asString();
+        const auto merkleBranches = jPrm.get((Json::Value::ArrayIndex)4, "");
+        for (const auto& branch : merkleBranches) {
+            transactions.push_back(branch["data"].asString());
+            txids.push_back(branch.isObject() ? branch.get("txid", "").asString() : std::string());
+        }
+        version = jPrm.get((Json::Value::ArrayIndex)5, "").asString();
+        bits = jPrm.get((Json::Value::ArrayIndex)6, "").asString();
+        time = jPrm.get((Json::Value::ArrayIndex)7, "").asString();
+        cleanJobs = jPrm.get((Json::Value::ArrayIndex)8, "").asBool();
+        height = jPrm.get((Json::Value::ArrayIndex)9, "").asUInt();
+    }
+};
+
 struct Block : public BlockHeader
 {
+    // The decoded transactions, i.e. the coinbase
     std::vector<CTransaction> vtx;
+    // The other transactions, raw and shared by the copies
+    std::shared_ptr<RawTransactions> rawTransactions;
 
     CTxOut txoutBackbone; // Energibackbone payment
     CTxOut txoutMasternode; // masternode payment
@@ -116,32 +161,50 @@ struct Block : public BlockHeader
 
     Block(const Json::Value& jPrm,
           const std::string& extraNonce, bool)
+        : Block(StratumJob(jPrm), extraNonce)
+    {
+    }
+
+    Block(const StratumJob& job,
+          const std::string& extraNonce,
+          bool withTransactions = true)
     {
-        hashPrevBlock = uint256S(jPrm.get((Json::Value::ArrayIndex)1, "").asString());
+        hashPrevBlock = uint256S(job.prevHash);
         hashMerkleRoot.SetNull();
-        nVersion = std::stoul(jPrm.get((Json::Value::ArrayIndex)5, "").asString(), 0, 16);
-        nTime = std::stoul(jPrm.get((Json::Value::ArrayIndex)7, "").asString(), 0, 16);
-        nBits = std::stoul(jPrm.get((Json::Value::ArrayIndex)6, "").asString(), 0, 16);
+        nVersion = std::stoul(job.version, 0, 16);
+        nTime = std::stoul(job.time, 0, 16);
+        nBits = std::stoul(job.bits, 0, 16);
         hashMix.SetNull();
         nNonce = 0;
-        nHeight = jPrm.get((Json::Value::ArrayIndex)9, "").asUInt();
+        nHeight = job.height;
 
-        std::string coinbase1 = jPrm.get((Json::Value::ArrayIndex)2, "").asString();
-        std::string coinbase2 = jPrm.get((Json::Value::ArrayIndex)3, "").asString();
-        std::string hexData = coinbase1 + extraNonce +/* + "00000000" +*/ coinbase2;
+        std::string hexData = job.coinbase1 + extraNonce +/* + "00000000" +*/ job.coinbase2;
         CTransaction coinbaseTx;
         DecodeHexTx(coinbaseTx, hexData);
 
-        vtx.push_back(coinbaseTx);
+        vtx.resize(1);
+        vtx[0] = coinbaseTx;
         vtx[0].UpdateHash();
-        const auto merkleBranches = jPrm.get((Json::Value::ArrayIndex)4, "");
-        for (const auto branch : merkleBranches) {
-            CTransaction trans;
-            DecodeHexTx(trans, branch["data"].asString());
-            vtx.push_back(trans);
+        rawTransactions = std::make_shared<RawTransactions>(job.transactions);
+        if (withTransactions) {
+            decodeTransactions(job, 0, job.transactions.size());
         }
     }
 
+    /// Hex decodes the transactions [begin, end) of job behind the coinbase, see RawTransactions
+    void decodeTransactions(const StratumJob& job, std::size_t begin, std::size_t end)
+    {
+        if (begin < end) {
+            rawTransactions->decode(job.transactions, job.txids, begin, end);
+        }
+    }
+
+    /// Number of transactions, the coinbase included
+    std::size_t transactionCount() const
+    {
+        return vtx.size() + (rawTransactions ? rawTransactions->size() : 0);
+    }
+
     Block(const Json::Value& gbt,
           const std::string& coinbaseAddress)
         : BlockHeader(gbt)
@@ -225,12 +288,18 @@ struct Block : public BlockHeader
             vtx.push_back(coinbaseTransaction);
             vtx[0].UpdateHash();
 
+            // Kept raw, the txids the node sends along are only checked
             auto transactions = gbt["transactions"];
+            std::vector<std::string> hexes;
+            std::vector<std::string> txids;
+            hexes.reserve(transactions.size());
+            txids.reserve(transactions.size());
             for (const auto& txn : transactions) {
-                CTransaction trans;
-                DecodeHexTx(trans, txn["data"].asString());
-                vtx.push_back(trans);
+                hexes.push_back(txn["data"].asString());
+                txids.push_back(txn.get("txid", "").asString());
             }
+            rawTransactions = std::make_shared<RawTransactions>(hexes, true);
+            rawTransactions->decode(hexes, txids, 0, hexes.size());
         }
     }
 
@@ -249,19 +318,25 @@ struct Block : public BlockHeader
         return CTxOut();
     }
 
-    ADD_SERIALIZE_METHODS
-
-    template<typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    /// Writes the block as submitted, the raw transactions as they were received
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
     {
-        READWRITE(*(BlockHeader*)this);
-        READWRITE(vtx);
+        BlockHeader::Serialize(s, nType, nVersion);
+        WriteCompactSize(s, transactionCount());
+        for (const auto& tx : vtx) {
+            tx.Serialize(s, nType, nVersion);
+        }
+        if (rawTransactions && !rawTransactions->bytes().empty()) {
+            s.write(reinterpret_cast<const char*>(rawTransactions->bytes().data()), rawTransactions->bytes().size());
+        }
     }
 
     void SetNull()
     {
         BlockHeader::SetNull();
         vtx.clear();
+        rawTransactions.reset();
         txoutBackbone = CTxOut();
         txoutMasternode = CTxOut();
         voutSuperblock.clear();
@@ -10,8 +10,8 @@
 
 #include "block.h"
 
-uint256 ComputeMerkleRoot(const std::vector<uint256>& leaves, bool* mutated = NULL);
-std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256>& leaves, uint32_t position);
+uint256 ComputeMerkleRoot(std::vector<uint256> leaves, bool* mutated = NULL);
+std::vector<uint256> ComputeMerkleBranch(std::vector<uint256> leaves, uint32_t position);
 uint256 ComputeMerkleRootFromBranch(const uint256& leaf, const std::vector<uint256>& branch, uint32_t position);
 
 /*
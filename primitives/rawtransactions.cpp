@@ -0,0 +1,90 @@
+/*
+ * rawtransactions.cpp
+ *
+ * The non coinbase transactions of a block template, kept as raw bytes.
+ */
+
+#include "rawtransactions.h"
+
+#include <algorithm>
+
+#include "common/HexCodec.h"
+#include "sha256.h"
+#include "txidcache.h"
+
+namespace energi {
+
+RawTransactions::RawTransactions(const std::vector<std::string>& hexes, bool withHex)
+    : m_txids(hexes.size())
+{
+    m_offsets.reserve(hexes.size() + 1);
+    std::size_t offset = 0;
+    for (const auto& hex : hexes) {
+        m_offsets.push_back(offset);
+        offset += hex.size() / 2;
+    }
+    m_offsets.push_back(offset);
+    m_data.resize(offset);
+    if (withHex) {
+        m_hex.resize(2 * offset);
+    }
+}
+
+bool RawTransactions::decode(const std::vector<std::string>& hexes, const std::vector<std::string>& txids,
+                             std::size_t begin, std::size_t end)
+{
+    bool valid = true;
+    std::vector<const unsigned char*> raws;
+    std::vector<std::size_t> sizes;
+    std::vector<std::size_t> indexes;
+    for (std::size_t i = begin; i < end; ++i) {
+        const std::string& hex = hexes[i];
+        unsigned char* raw = m_data.data() + m_offsets[i];
+        if (hex.empty() || hex.size() % 2 != 0 || !hex::decode(hex.data(), size(i), raw)) {
+            std::fill(raw, raw + size(i), 0);
+            valid = false;
+            continue;
+        }
+        raws.push_back(raw);
+        sizes.push_back(size(i));
+        indexes.push_back(i);
+    }
+
+    if (begin < end && !m_hex.empty()) {
+        // Re-encoded rather than copied so the payload is lowercase whatever the case sent
+        hex::encode(data(begin), m_offsets[end] - m_offsets[begin], &m_hex[2 * m_offsets[begin]]);
+    }
+
+    // The txids go into the merkle root, so they are always hashed from the bytes, only the
+    // transactions seen in earlier templates are taken from the cache
+    std::vector<uint256> hashes(indexes.size());
+    TxidCache& cache = TxidCache::instance();
+    std::vector<std::size_t> const missed = cache.lookup(raws.data(), sizes.data(), hashes.data(), indexes.size());
+    std::vector<const unsigned char*> messages;
+    std::vector<std::size_t> messageSizes;
+    for (std::size_t j : missed) {
+        messages.push_back(raws[j]);
+        messageSizes.push_back(sizes[j]);
+    }
+    std::vector<uint256> hashed(missed.size());
+    SHA256D(hashed.empty() ? nullptr : hashed[0].begin(), messages.data(), messageSizes.data(), missed.size());
+    cache.store(messages.data(), messageSizes.data(), hashed.data(), missed.size());
+    for (std::size_t j = 0; j < missed.size(); ++j) {
+        hashes[missed[j]] = hashed[j];
+    }
+
+    std::size_t mismatched = 0;
+    for (std::size_t j = 0; j < indexes.size(); ++j) {
+        std::size_t const i = indexes[j];
+        m_txids[i] = hashes[j];
+        if (i < txids.size() && !txids[i].empty() && uint256S(txids[i]) != hashes[j]) {
+            mismatched++;
+        }
+    }
+    if (mismatched) {
+        m_mismatchedTxids.fetch_add(mismatched, std::memory_order_relaxed);
+    }
+    return valid;
+}
+
+} /* namespace energi */
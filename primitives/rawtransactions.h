@@ -0,0 +1,94 @@
+/*
+ * rawtransactions.h
+ *
+ * The non coinbase transactions of a block template, kept as raw bytes.
+ */
+
+#ifndef ENERGIMINER_RAWTRANSACTIONS_H_
+#define ENERGIMINER_RAWTRANSACTIONS_H_
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "uint256.h"
+
+namespace energi {
+
+/**
+ * @brief The transactions of a template besides the coinbase, in one buffer.
+ *
+ * Miners never look into them: the merkle tree only needs their txids and a found block
+ * carries their bytes as received. So they are hex decoded back to back into a single buffer
+ * and never deserialized. The txids are hashed from the bytes when the template arrives, or
+ * taken from the TxidCache for transactions seen before. GBT work also hex encodes the buffer
+ * right away for submitting a found block, stratum pools only get the nonce. Shared by all
+ * copies of a Work and not changed once decoded.
+ */
+class RawTransactions
+{
+public:
+    /// Lays out the buffer for the raw hex transactions in hexes, and their hex if withHex, see decode()
+    explicit RawTransactions(const std::vector<std::string>& hexes, bool withHex = false);
+
+    /**
+     * @brief Decodes the transactions [begin, end) of hexes into their place in the buffer and
+     * its hex if any. Disjoint ranges may be decoded concurrently.
+     * @param txids hex txids sent with the transactions, may be shorter than hexes or hold
+     *        empty strings. They are only checked against the hashed ones, see mismatchedTxids().
+     * @return false if one of them is no hex, its bytes and txid are left zero
+     */
+    bool decode(const std::vector<std::string>& hexes, const std::vector<std::string>& txids,
+                std::size_t begin, std::size_t end);
+
+    std::size_t size() const
+    {
+        return m_txids.size();
+    }
+
+    /// Number of txids sent along which differ from the hash of their transaction
+    std::size_t mismatchedTxids() const
+    {
+        return m_mismatchedTxids.load(std::memory_order_relaxed);
+    }
+
+    const std::vector<uint256>& txids() const
+    {
+        return m_txids;
+    }
+
+    /// All the transactions, serialized back to back the way they follow the coinbase in a block
+    const std::vector<unsigned char>& bytes() const
+    {
+        return m_data;
+    }
+
+    /// bytes() in lowercase hex, as it goes into a submitblock payload. Empty unless made withHex
+    const std::string& hex() const
+    {
+        return m_hex;
+    }
+
+    const unsigned char* data(std::size_t i) const
+    {
+        return m_data.data() + m_offsets[i];
+    }
+
+    std::size_t size(std::size_t i) const
+    {
+        return m_offsets[i + 1] - m_offsets[i];
+    }
+
+private:
+    std::vector<unsigned char> m_data;
+    std::string m_hex;
+    // Start of each transaction in m_data, followed by the end of the last one
+    std::vector<std::size_t> m_offsets;
+    std::vector<uint256> m_txids;
+    std::atomic<std::size_t> m_mismatchedTxids = {0};
+};
+
+} /* namespace energi */
+
+#endif /* ENERGIMINER_RAWTRANSACTIONS_H_ */
@@ -7,6 +7,25 @@
 #include "common/common.h"
 #include "sha256.h"
 
+#if defined(ENABLE_SHA256_X86)
+#include <cpuid.h>
+
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+namespace sha256_avx2
+{
+void Transform_8way(uint32_t* s, const unsigned char* const* blocks);
+}
+#if defined(__x86_64__)
+namespace sha256_avx512
+{
+void Transform_16way(uint32_t* s, const unsigned char* const* blocks);
+}
+#endif
+#endif
+
 
 // Internal implementation code.
 namespace
@@ -128,7 +147,222 @@ void Transform(uint32_t* s, const unsigned char* chunk)
     s[7] += h;
 }
 
+void TransformBlocks(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    while (blocks--) {
+        Transform(s, chunk);
+        chunk += 64;
+    }
+}
+
 } // namespace sha256
+
+typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
+typedef void (*LanesType)(uint32_t*, const unsigned char* const*);
+
+/** A single buffer transform, optionally with a multi-buffer one of width lanes. */
+struct Implementation
+{
+    const char* name;
+    TransformType transform;
+    LanesType lanes;
+    size_t width;
+};
+
+#if defined(ENABLE_SHA256_X86)
+uint64_t inline GetXCR0()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return a | (uint64_t(d) << 32);
+}
+#endif
+
+/** The implementations the CPU supports, slowest first. */
+std::vector<Implementation> Supported()
+{
+    std::vector<Implementation> supported;
+    supported.push_back({"scalar", sha256::TransformBlocks, nullptr, 1});
+#if defined(ENABLE_SHA256_X86)
+    uint32_t eax, ebx, ecx, edx;
+    bool sse41 = false;
+    bool avx = false;
+    bool avx512 = false;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        sse41 = ecx & (1u << 19);
+        if (ecx & (1u << 27)) {
+            // The OS has to save the YMM (and ZMM) registers too
+            uint64_t const xcr0 = GetXCR0();
+            avx = (ecx & (1u << 28)) && (xcr0 & 0x6) == 0x6;
+            avx512 = avx && (xcr0 & 0xe6) == 0xe6;
+        }
+    }
+    if (__get_cpuid_max(0, nullptr) >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        // One SHA-NI stream outruns the 8 AVX2 lanes, so it ranks above them
+        bool const shani = sse41 && (ebx & (1u << 29));
+        TransformType const single = shani ? sha256_shani::Transform : sha256::TransformBlocks;
+        if (avx && (ebx & (1u << 5))) {
+            supported.push_back({"avx2", single, sha256_avx2::Transform_8way, 8});
+        }
+        if (shani) {
+            supported.push_back({"shani", single, nullptr, 1});
+        }
+#if defined(__x86_64__)
+        if (avx512 && (ebx & (1u << 16))) {
+            supported.push_back({"avx512", single, sha256_avx512::Transform_16way, 16});
+        }
+#endif
+    }
+#endif
+    return supported;
+}
+
+Implementation& Active()
+{
+    static Implementation active = Supported().back();
+    return active;
+}
+
+/** Where a lane is in its current message. */
+struct Lane
+{
+    size_t message;
+    const unsigned char* data;
+    size_t full;
+    unsigned char tail[128];
+    size_t tailBlocks;
+    size_t tailPos;
+    bool second;
+
+    const unsigned char* block() const
+    {
+        return full ? data : tail + 64 * tailPos;
+    }
+
+    /** Moves past the current block, true when it was the last one */
+    bool advance()
+    {
+        if (full) {
+            full--;
+            data += 64;
+        } else {
+            tailPos++;
+        }
+        return full == 0 && tailPos == tailBlocks;
+    }
+
+    void start(size_t index, const unsigned char* begin, size_t size)
+    {
+        message = index;
+        second = false;
+        data = begin;
+        full = size / 64;
+        size_t const rest = size % 64;
+        tailBlocks = rest + 9 > 64 ? 2 : 1;
+        tailPos = 0;
+        memset(tail, 0, sizeof(tail));
+        if (rest) {
+            memcpy(tail, begin + full * 64, rest);
+        }
+        tail[rest] = 0x80;
+        WriteBE64(tail + 64 * tailBlocks - 8, uint64_t(size) << 3);
+    }
+
+    /** Turns the first digest into the single padded block of the second hash */
+    void startSecond(const unsigned char* digest)
+    {
+        second = true;
+        full = 0;
+        tailBlocks = 1;
+        tailPos = 0;
+        memset(tail, 0, 64);
+        memcpy(tail, digest, 32);
+        tail[32] = 0x80;
+        tail[62] = 0x01;
+    }
+};
+
+void InitializeLane(uint32_t* s, size_t lane, size_t width)
+{
+    uint32_t iv[8];
+    sha256::Initialize(iv);
+    for (size_t i = 0; i < 8; ++i) {
+        s[i * width + lane] = iv[i];
+    }
+}
+
+void DigestOfLane(unsigned char* out, const uint32_t* s, size_t lane, size_t width)
+{
+    for (size_t i = 0; i < 8; ++i) {
+        WriteBE32(out + 4 * i, s[i * width + lane]);
+    }
+}
+
+/**
+ * Double SHA-256 of count messages on the lanes of impl. Each lane runs a message through
+ * both hashes and takes the next one as soon as it is done, idle lanes hash a dummy block.
+ * get(i, data, size) yields message i. Messages are started in order and a digest is only
+ * written once its message completed, which keeps in place merkle levels safe.
+ */
+template <typename Get>
+void HashLanes(const Implementation& impl, unsigned char* output, size_t count, Get get)
+{
+    static const unsigned char dummy[64] = {};
+    size_t const width = impl.width;
+    uint32_t s[8 * 16];
+    Lane lanes[16];
+    const unsigned char* blocks[16];
+    size_t next = 0;
+    size_t active = 0;
+
+    auto feed = [&](size_t l) {
+        if (next < count) {
+            const unsigned char* data;
+            size_t size;
+            get(next, data, size);
+            lanes[l].start(next++, data, size);
+            InitializeLane(s, l, width);
+            active++;
+        } else {
+            lanes[l].message = count;
+        }
+    };
+    for (size_t l = 0; l < width; ++l) {
+        feed(l);
+    }
+
+    while (active) {
+        for (size_t l = 0; l < width; ++l) {
+            blocks[l] = lanes[l].message < count ? lanes[l].block() : dummy;
+        }
+        impl.lanes(s, blocks);
+        for (size_t l = 0; l < width; ++l) {
+            Lane& lane = lanes[l];
+            if (lane.message >= count || !lane.advance()) {
+                continue;
+            }
+            unsigned char digest[32];
+            DigestOfLane(digest, s, l, width);
+            if (!lane.second) {
+                lane.startSecond(digest);
+                InitializeLane(s, l, width);
+                continue;
+            }
+            memcpy(output + 32 * lane.message, digest, 32);
+            active--;
+            feed(l);
+        }
+    }
+}
+
+void HashSingle(unsigned char* output, const unsigned char* data, size_t size)
+{
+    unsigned char digest[32];
+    CSHA256().Write(data, size).Finalize(digest);
+    CSHA256().Write(digest, 32).Finalize(output);
+}
+
 } // namespace
 
 
@@ -148,14 +382,15 @@ CSHA256& CSHA256::Write(const unsigned char* data, size_t len)
         memcpy(buf + bufsize, data, 64 - bufsize);
         bytes += 64 - bufsize;
         data += 64 - bufsize;
-        sha256::Transform(s, buf);
+        Active().transform(s, buf, 1);
         bufsize = 0;
     }
-    while (end >= data + 64) {
+    if (end >= data + 64) {
         // Process full chunks directly from the source.
-        sha256::Transform(s, data);
-        bytes += 64;
-        data += 64;
+        size_t const blocks = (end - data) / 64;
+        Active().transform(s, data, blocks);
+        bytes += 64 * blocks;
+        data += 64 * blocks;
     }
     if (end > data) {
         // Fill the buffer with what remains.
@@ -188,3 +423,60 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+std::string SHA256AutoDetect()
+{
+    Implementation& active = Active();
+    active = Supported().back();
+    return active.name;
+}
+
+std::vector<std::string> SHA256Implementations()
+{
+    std::vector<std::string> names;
+    for (auto const& impl : Supported()) {
+        names.push_back(impl.name);
+    }
+    return names;
+}
+
+bool SHA256Use(const std::string& name)
+{
+    for (auto const& impl : Supported()) {
+        if (name == impl.name) {
+            Active() = impl;
+            return true;
+        }
+    }
+    return false;
+}
+
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks)
+{
+    const Implementation& impl = Active();
+    if (impl.lanes && blocks >= impl.width / 2) {
+        HashLanes(impl, output, blocks, [input](size_t i, const unsigned char*& data, size_t& size) {
+            data = input + 64 * i;
+            size = 64;
+        });
+        return;
+    }
+    for (size_t i = 0; i < blocks; ++i) {
+        HashSingle(output + 32 * i, input + 64 * i, 64);
+    }
+}
+
+void SHA256D(unsigned char* output, const unsigned char* const* data, const size_t* sizes, size_t count)
+{
+    const Implementation& impl = Active();
+    if (impl.lanes && count >= impl.width / 2) {
+        HashLanes(impl, output, count, [data, sizes](size_t i, const unsigned char*& begin, size_t& size) {
+            begin = data[i];
+            size = sizes[i];
+        });
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        HashSingle(output + 32 * i, data[i], sizes[i]);
+    }
+}
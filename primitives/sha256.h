@@ -8,6 +8,8 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
+#include <vector>
 
 #if (defined(_WIN16) || defined(_WIN32) || defined(_WIN64)) || defined(__APPLE__)
     #include "common/portable_endian.h"
@@ -34,4 +36,26 @@ public:
     CSHA256& Reset();
 };
 
+/** Autodetect the best available SHA256 implementation. Returns its name. */
+std::string SHA256AutoDetect();
+
+/** Names of the implementations usable on this CPU, slowest first. */
+std::vector<std::string> SHA256Implementations();
+
+/** Switch to the implementation called name. Not thread safe, for startup and benchmarks. */
+bool SHA256Use(const std::string& name);
+
+/**
+ * Compute the double SHA-256 of blocks independent 64-byte blobs, e.g. the pairs of a merkle
+ * tree level. output receives blocks * 32 bytes and may be the same as input.
+ */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
+
+/**
+ * Compute the double SHA-256 of count independent messages data[i] of sizes[i] bytes, e.g.
+ * the txids of a block, into count * 32 bytes at output. Runs them side by side on the
+ * multi-buffer lanes when the CPU has them.
+ */
+void SHA256D(unsigned char* output, const unsigned char* const* data, const size_t* sizes, size_t count);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -0,0 +1,171 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// SHA-256 compression of 8 independent blocks at once, one per 32 bit lane of the AVX2
+// registers. Built with -mavx2, only called after the CPU has been checked for support.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+namespace sha256_avx2
+{
+namespace
+{
+
+inline __m256i K(uint32_t x) { return _mm256_set1_epi32(x); }
+
+inline __m256i Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+inline __m256i Add(__m256i x, __m256i y, __m256i z) { return Add(Add(x, y), z); }
+inline __m256i Add(__m256i x, __m256i y, __m256i z, __m256i w) { return Add(Add(x, y), Add(z, w)); }
+inline __m256i Add(__m256i x, __m256i y, __m256i z, __m256i w, __m256i v) { return Add(Add(x, y, z), Add(w, v)); }
+inline __m256i Inc(__m256i& x, __m256i y) { x = Add(x, y); return x; }
+inline __m256i Inc(__m256i& x, __m256i y, __m256i z) { x = Add(x, y, z); return x; }
+inline __m256i Inc(__m256i& x, __m256i y, __m256i z, __m256i w) { x = Add(x, y, z, w); return x; }
+inline __m256i Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+inline __m256i Xor(__m256i x, __m256i y, __m256i z) { return Xor(Xor(x, y), z); }
+inline __m256i Or(__m256i x, __m256i y) { return _mm256_or_si256(x, y); }
+inline __m256i And(__m256i x, __m256i y) { return _mm256_and_si256(x, y); }
+inline __m256i ShR(__m256i x, int n) { return _mm256_srli_epi32(x, n); }
+inline __m256i ShL(__m256i x, int n) { return _mm256_slli_epi32(x, n); }
+
+inline __m256i Ch(__m256i x, __m256i y, __m256i z) { return Xor(z, And(x, Xor(y, z))); }
+inline __m256i Maj(__m256i x, __m256i y, __m256i z) { return Or(And(x, y), And(z, Or(x, y))); }
+inline __m256i Sigma0(__m256i x) { return Xor(Or(ShR(x, 2), ShL(x, 30)), Or(ShR(x, 13), ShL(x, 19)), Or(ShR(x, 22), ShL(x, 10))); }
+inline __m256i Sigma1(__m256i x) { return Xor(Or(ShR(x, 6), ShL(x, 26)), Or(ShR(x, 11), ShL(x, 21)), Or(ShR(x, 25), ShL(x, 7))); }
+inline __m256i sigma0(__m256i x) { return Xor(Or(ShR(x, 7), ShL(x, 25)), Or(ShR(x, 18), ShL(x, 14)), ShR(x, 3)); }
+inline __m256i sigma1(__m256i x) { return Xor(Or(ShR(x, 17), ShL(x, 15)), Or(ShR(x, 19), ShL(x, 13)), ShR(x, 10)); }
+
+/** One round of SHA-256, k already includes the message word. */
+inline void Round(__m256i a, __m256i b, __m256i c, __m256i& d, __m256i e, __m256i f, __m256i g, __m256i& h, __m256i k)
+{
+    __m256i t1 = Add(h, Sigma1(e), Ch(e, f, g), k);
+    __m256i t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+/** Loads the words [8 * half, 8 * half + 8) of the 8 blocks, transposed so w[i] holds word i of every block. */
+inline void Load(__m256i* w, const unsigned char* const* blocks, int half)
+{
+    const __m256i swap = _mm256_set_epi32(0x0c0d0e0f, 0x08090a0b, 0x04050607, 0x00010203,
+                                          0x0c0d0e0f, 0x08090a0b, 0x04050607, 0x00010203);
+    __m256i r[8];
+    for (int l = 0; l < 8; ++l) {
+        r[l] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blocks[l] + 32 * half));
+    }
+    __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]), t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+    __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]), t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+    __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]), t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+    __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]), t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6);
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7);
+    w[0] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u0, u4, 0x20), swap);
+    w[1] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u1, u5, 0x20), swap);
+    w[2] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u2, u6, 0x20), swap);
+    w[3] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u3, u7, 0x20), swap);
+    w[4] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u0, u4, 0x31), swap);
+    w[5] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u1, u5, 0x31), swap);
+    w[6] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u2, u6, 0x31), swap);
+    w[7] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u3, u7, 0x31), swap);
+}
+
+} // namespace
+
+void Transform_8way(uint32_t* s, const unsigned char* const* blocks)
+{
+    __m256i w[16];
+    Load(w, blocks, 0);
+    Load(w + 8, blocks, 1);
+    __m256i w0 = w[0], w1 = w[1], w2 = w[2], w3 = w[3], w4 = w[4], w5 = w[5], w6 = w[6], w7 = w[7];
+    __m256i w8 = w[8], w9 = w[9], w10 = w[10], w11 = w[11], w12 = w[12], w13 = w[13], w14 = w[14], w15 = w[15];
+
+    __m256i* state = reinterpret_cast<__m256i*>(s);
+    __m256i a = _mm256_loadu_si256(state + 0), b = _mm256_loadu_si256(state + 1);
+    __m256i c = _mm256_loadu_si256(state + 2), d = _mm256_loadu_si256(state + 3);
+    __m256i e = _mm256_loadu_si256(state + 4), f = _mm256_loadu_si256(state + 5);
+    __m256i g = _mm256_loadu_si256(state + 6), h = _mm256_loadu_si256(state + 7);
+
+    Round(a, b, c, d, e, f, g, h, Add(K(0x428a2f98ul), w0));
+    Round(h, a, b, c, d, e, f, g, Add(K(0x71374491ul), w1));
+    Round(g, h, a, b, c, d, e, f, Add(K(0xb5c0fbcful), w2));
+    Round(f, g, h, a, b, c, d, e, Add(K(0xe9b5dba5ul), w3));
+    Round(e, f, g, h, a, b, c, d, Add(K(0x3956c25bul), w4));
+    Round(d, e, f, g, h, a, b, c, Add(K(0x59f111f1ul), w5));
+    Round(c, d, e, f, g, h, a, b, Add(K(0x923f82a4ul), w6));
+    Round(b, c, d, e, f, g, h, a, Add(K(0xab1c5ed5ul), w7));
+    Round(a, b, c, d, e, f, g, h, Add(K(0xd807aa98ul), w8));
+    Round(h, a, b, c, d, e, f, g, Add(K(0x12835b01ul), w9));
+    Round(g, h, a, b, c, d, e, f, Add(K(0x243185beul), w10));
+    Round(f, g, h, a, b, c, d, e, Add(K(0x550c7dc3ul), w11));
+    Round(e, f, g, h, a, b, c, d, Add(K(0x72be5d74ul), w12));
+    Round(d, e, f, g, h, a, b, c, Add(K(0x80deb1feul), w13));
+    Round(c, d, e, f, g, h, a, b, Add(K(0x9bdc06a7ul), w14));
+    Round(b, c, d, e, f, g, h, a, Add(K(0xc19bf174ul), w15));
+    Round(a, b, c, d, e, f, g, h, Add(K(0xe49b69c1ul), Inc(w0, sigma1(w14), w9, sigma0(w1))));
+    Round(h, a, b, c, d, e, f, g, Add(K(0xefbe4786ul), Inc(w1, sigma1(w15), w10, sigma0(w2))));
+    Round(g, h, a, b, c, d, e, f, Add(K(0x0fc19dc6ul), Inc(w2, sigma1(w0), w11, sigma0(w3))));
+    Round(f, g, h, a, b, c, d, e, Add(K(0x240ca1ccul), Inc(w3, sigma1(w1), w12, sigma0(w4))));
+    Round(e, f, g, h, a, b, c, d, Add(K(0x2de92c6ful), Inc(w4, sigma1(w2), w13, sigma0(w5))));
+    Round(d, e, f, g, h, a, b, c, Add(K(0x4a7484aaul), Inc(w5, sigma1(w3), w14, sigma0(w6))));
+    Round(c, d, e, f, g, h, a, b, Add(K(0x5cb0a9dcul), Inc(w6, sigma1(w4), w15, sigma0(w7))));
+    Round(b, c, d, e, f, g, h, a, Add(K(0x76f988daul), Inc(w7, sigma1(w5), w0, sigma0(w8))));
+    Round(a, b, c, d, e, f, g, h, Add(K(0x983e5152ul), Inc(w8, sigma1(w6), w1, sigma0(w9))));
+    Round(h, a, b, c, d, e, f, g, Add(K(0xa831c66dul), Inc(w9, sigma1(w7), w2, sigma0(w10))));
+    Round(g, h, a, b, c, d, e, f, Add(K(0xb00327c8ul), Inc(w10, sigma1(w8), w3, sigma0(w11))));
+    Round(f, g, h, a, b, c, d, e, Add(K(0xbf597fc7ul), Inc(w11, sigma1(w9), w4, sigma0(w12))));
+    Round(e, f, g, h, a, b, c, d, Add(K(0xc6e00bf3ul), Inc(w12, sigma1(w10), w5, sigma0(w13))));
+    Round(d, e, f, g, h, a, b, c, Add(K(0xd5a79147ul), Inc(w13, sigma1(w11), w6, sigma0(w14))));
+    Round(c, d, e, f, g, h, a, b, Add(K(0x06ca6351ul), Inc(w14, sigma1(w12), w7, sigma0(w15))));
+    Round(b, c, d, e, f, g, h, a, Add(K(0x14292967ul), Inc(w15, sigma1(w13), w8, sigma0(w0))));
+    Round(a, b, c, d, e, f, g, h, Add(K(0x27b70a85ul), Inc(w0, sigma1(w14), w9, sigma0(w1))));
+    Round(h, a, b, c, d, e, f, g, Add(K(0x2e1b2138ul), Inc(w1, sigma1(w15), w10, sigma0(w2))));
+    Round(g, h, a, b, c, d, e, f, Add(K(0x4d2c6dfcul), Inc(w2, sigma1(w0), w11, sigma0(w3))));
+    Round(f, g, h, a, b, c, d, e, Add(K(0x53380d13ul), Inc(w3, sigma1(w1), w12, sigma0(w4))));
+    Round(e, f, g, h, a, b, c, d, Add(K(0x650a7354ul), Inc(w4, sigma1(w2), w13, sigma0(w5))));
+    Round(d, e, f, g, h, a, b, c, Add(K(0x766a0abbul), Inc(w5, sigma1(w3), w14, sigma0(w6))));
+    Round(c, d, e, f, g, h, a, b, Add(K(0x81c2c92eul), Inc(w6, sigma1(w4), w15, sigma0(w7))));
+    Round(b, c, d, e, f, g, h, a, Add(K(0x92722c85ul), Inc(w7, sigma1(w5), w0, sigma0(w8))));
+    Round(a, b, c, d, e, f, g, h, Add(K(0xa2bfe8a1ul), Inc(w8, sigma1(w6), w1, sigma0(w9))));
+    Round(h, a, b, c, d, e, f, g, Add(K(0xa81a664bul), Inc(w9, sigma1(w7), w2, sigma0(w10))));
+    Round(g, h, a, b, c, d, e, f, Add(K(0xc24b8b70ul), Inc(w10, sigma1(w8), w3, sigma0(w11))));
+    Round(f, g, h, a, b, c, d, e, Add(K(0xc76c51a3ul), Inc(w11, sigma1(w9), w4, sigma0(w12))));
+    Round(e, f, g, h, a, b, c, d, Add(K(0xd192e819ul), Inc(w12, sigma1(w10), w5, sigma0(w13))));
+    Round(d, e, f, g, h, a, b, c, Add(K(0xd6990624ul), Inc(w13, sigma1(w11), w6, sigma0(w14))));
+    Round(c, d, e, f, g, h, a, b, Add(K(0xf40e3585ul), Inc(w14, sigma1(w12), w7, sigma0(w15))));
+    Round(b, c, d, e, f, g, h, a, Add(K(0x106aa070ul), Inc(w15, sigma1(w13), w8, sigma0(w0))));
+    Round(a, b, c, d, e, f, g, h, Add(K(0x19a4c116ul), Inc(w0, sigma1(w14), w9, sigma0(w1))));
+    Round(h, a, b, c, d, e, f, g, Add(K(0x1e376c08ul), Inc(w1, sigma1(w15), w10, sigma0(w2))));
+    Round(g, h, a, b, c, d, e, f, Add(K(0x2748774cul), Inc(w2, sigma1(w0), w11, sigma0(w3))));
+    Round(f, g, h, a, b, c, d, e, Add(K(0x34b0bcb5ul), Inc(w3, sigma1(w1), w12, sigma0(w4))));
+    Round(e, f, g, h, a, b, c, d, Add(K(0x391c0cb3ul), Inc(w4, sigma1(w2), w13, sigma0(w5))));
+    Round(d, e, f, g, h, a, b, c, Add(K(0x4ed8aa4aul), Inc(w5, sigma1(w3), w14, sigma0(w6))));
+    Round(c, d, e, f, g, h, a, b, Add(K(0x5b9cca4ful), Inc(w6, sigma1(w4), w15, sigma0(w7))));
+    Round(b, c, d, e, f, g, h, a, Add(K(0x682e6ff3ul), Inc(w7, sigma1(w5), w0, sigma0(w8))));
+    Round(a, b, c, d, e, f, g, h, Add(K(0x748f82eeul), Inc(w8, sigma1(w6), w1, sigma0(w9))));
+    Round(h, a, b, c, d, e, f, g, Add(K(0x78a5636ful), Inc(w9, sigma1(w7), w2, sigma0(w10))));
+    Round(g, h, a, b, c, d, e, f, Add(K(0x84c87814ul), Inc(w10, sigma1(w8), w3, sigma0(w11))));
+    Round(f, g, h, a, b, c, d, e, Add(K(0x8cc70208ul), Inc(w11, sigma1(w9), w4, sigma0(w12))));
+    Round(e, f, g, h, a, b, c, d, Add(K(0x90befffaul), Inc(w12, sigma1(w10), w5, sigma0(w13))));
+    Round(d, e, f, g, h, a, b, c, Add(K(0xa4506cebul), Inc(w13, sigma1(w11), w6, sigma0(w14))));
+    Round(c, d, e, f, g, h, a, b, Add(K(0xbef9a3f7ul), Inc(w14, sigma1(w12), w7, sigma0(w15))));
+    Round(b, c, d, e, f, g, h, a, Add(K(0xc67178f2ul), Inc(w15, sigma1(w13), w8, sigma0(w0))));
+
+    _mm256_storeu_si256(state + 0, Add(a, _mm256_loadu_si256(state + 0)));
+    _mm256_storeu_si256(state + 1, Add(b, _mm256_loadu_si256(state + 1)));
+    _mm256_storeu_si256(state + 2, Add(c, _mm256_loadu_si256(state + 2)));
+    _mm256_storeu_si256(state + 3, Add(d, _mm256_loadu_si256(state + 3)));
+    _mm256_storeu_si256(state + 4, Add(e, _mm256_loadu_si256(state + 4)));
+    _mm256_storeu_si256(state + 5, Add(f, _mm256_loadu_si256(state + 5)));
+    _mm256_storeu_si256(state + 6, Add(g, _mm256_loadu_si256(state + 6)));
+    _mm256_storeu_si256(state + 7, Add(h, _mm256_loadu_si256(state + 7)));
+}
+
+} // namespace sha256_avx2
+
+#endif
@@ -0,0 +1,163 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// SHA-256 compression of 16 independent blocks at once, one per 32 bit lane of the AVX-512
+// registers. Built with -mavx512f, only called after the CPU has been checked for support.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__AVX512F__) && defined(__x86_64__)
+// GCC 12 warns about the undefined pass-through operands inside its own AVX-512 headers
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#endif
+#include <immintrin.h>
+
+namespace sha256_avx512
+{
+namespace
+{
+
+inline __m512i K(uint32_t x) { return _mm512_set1_epi32(x); }
+
+inline __m512i Add(__m512i x, __m512i y) { return _mm512_add_epi32(x, y); }
+inline __m512i Add(__m512i x, __m512i y, __m512i z) { return Add(Add(x, y), z); }
+inline __m512i Add(__m512i x, __m512i y, __m512i z, __m512i w) { return Add(Add(x, y), Add(z, w)); }
+inline __m512i Add(__m512i x, __m512i y, __m512i z, __m512i w, __m512i v) { return Add(Add(x, y, z), Add(w, v)); }
+inline __m512i Inc(__m512i& x, __m512i y) { x = Add(x, y); return x; }
+inline __m512i Inc(__m512i& x, __m512i y, __m512i z) { x = Add(x, y, z); return x; }
+inline __m512i Inc(__m512i& x, __m512i y, __m512i z, __m512i w) { x = Add(x, y, z, w); return x; }
+inline __m512i Xor(__m512i x, __m512i y, __m512i z) { return _mm512_ternarylogic_epi32(x, y, z, 0x96); }
+template <int n> inline __m512i Ror(__m512i x) { return _mm512_ror_epi32(x, n); }
+inline __m512i ShR(__m512i x, int n) { return _mm512_srli_epi32(x, n); }
+
+// Bitwise x ? y : z and majority as single ternary logic ops
+inline __m512i Ch(__m512i x, __m512i y, __m512i z) { return _mm512_ternarylogic_epi32(x, y, z, 0xca); }
+inline __m512i Maj(__m512i x, __m512i y, __m512i z) { return _mm512_ternarylogic_epi32(x, y, z, 0xe8); }
+inline __m512i Sigma0(__m512i x) { return Xor(Ror<2>(x), Ror<13>(x), Ror<22>(x)); }
+inline __m512i Sigma1(__m512i x) { return Xor(Ror<6>(x), Ror<11>(x), Ror<25>(x)); }
+inline __m512i sigma0(__m512i x) { return Xor(Ror<7>(x), Ror<18>(x), ShR(x, 3)); }
+inline __m512i sigma1(__m512i x) { return Xor(Ror<17>(x), Ror<19>(x), ShR(x, 10)); }
+
+/** One round of SHA-256, k already includes the message word. */
+inline void Round(__m512i a, __m512i b, __m512i c, __m512i& d, __m512i e, __m512i f, __m512i g, __m512i& h, __m512i k)
+{
+    __m512i t1 = Add(h, Sigma1(e), Ch(e, f, g), k);
+    __m512i t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+/** Loads the words of the 16 blocks, transposed so w[i] holds word i of every block. */
+inline void Load(__m512i* w, const unsigned char* const* blocks)
+{
+    // Gathered straight from the blocks by address, 8 lanes per gather
+    const __m512i lo = _mm512_loadu_si512(reinterpret_cast<const void*>(blocks));
+    const __m512i hi = _mm512_loadu_si512(reinterpret_cast<const void*>(blocks + 8));
+    const __m512i lowBytes = _mm512_set1_epi32(0x00ff00ff);
+    const __m256i zero = _mm256_setzero_si256();
+    for (int i = 0; i < 16; ++i) {
+        const __m512i offset = _mm512_set1_epi64(4 * i);
+        __m256i const wlo = _mm512_mask_i64gather_epi32(zero, 0xff, _mm512_add_epi64(lo, offset), nullptr, 1);
+        __m256i const whi = _mm512_mask_i64gather_epi32(zero, 0xff, _mm512_add_epi64(hi, offset), nullptr, 1);
+        __m512i x = _mm512_mask_broadcast_i64x4(_mm512_maskz_broadcast_i64x4(0x0f, wlo), 0xf0, whi);
+        // Byte swap without AVX512BW
+        w[i] = _mm512_or_si512(Ror<8>(_mm512_and_si512(x, lowBytes)), _mm512_rol_epi32(_mm512_andnot_si512(lowBytes, x), 8));
+    }
+}
+
+} // namespace
+
+void Transform_16way(uint32_t* s, const unsigned char* const* blocks)
+{
+    __m512i w[16];
+    Load(w, blocks);
+    __m512i w0 = w[0], w1 = w[1], w2 = w[2], w3 = w[3], w4 = w[4], w5 = w[5], w6 = w[6], w7 = w[7];
+    __m512i w8 = w[8], w9 = w[9], w10 = w[10], w11 = w[11], w12 = w[12], w13 = w[13], w14 = w[14], w15 = w[15];
+
+    __m512i* state = reinterpret_cast<__m512i*>(s);
+    __m512i a = _mm512_loadu_si512(state + 0), b = _mm512_loadu_si512(state + 1);
+    __m512i c = _mm512_loadu_si512(state + 2), d = _mm512_loadu_si512(state + 3);
+    __m512i e = _mm512_loadu_si512(state + 4), f = _mm512_loadu_si512(state + 5);
+    __m512i g = _mm512_loadu_si512(state + 6), h = _mm512_loadu_si512(state + 7);
+
+    Round(a, b, c, d, e, f, g, h, Add(K(0x428a2f98ul), w0));
+    Round(h, a, b, c, d, e, f, g, Add(K(0x71374491ul), w1));
+    Round(g, h, a, b, c, d, e, f, Add(K(0xb5c0fbcful), w2));
+    Round(f, g, h, a, b, c, d, e, Add(K(0xe9b5dba5ul), w3));
+    Round(e, f, g, h, a, b, c, d, Add(K(0x3956c25bul), w4));
+    Round(d, e, f, g, h, a, b, c, Add(K(0x59f111f1ul), w5));
+    Round(c, d, e, f, g, h, a, b, Add(K(0x923f82a4ul), w6));
+    Round(b, c, d, e, f, g, h, a, Add(K(0xab1c5ed5ul), w7));
+    Round(a, b, c, d, e, f, g, h, Add(K(0xd807aa98ul), w8));
+    Round(h, a, b, c, d, e, f, g, Add(K(0x12835b01ul), w9));
+    Round(g, h, a, b, c, d, e, f, Add(K(0x243185beul), w10));
+    Round(f, g, h, a, b, c, d, e, Add(K(0x550c7dc3ul), w11));
+    Round(e, f, g, h, a, b, c, d, Add(K(0x72be5d74ul), w12));
+    Round(d, e, f, g, h, a, b, c, Add(K(0x80deb1feul), w13));
+    Round(c, d, e, f, g, h, a, b, Add(K(0x9bdc06a7ul), w14));
+    Round(b, c, d, e, f, g, h, a, Add(K(0xc19bf174ul), w15));
+    Round(a, b, c, d, e, f, g, h, Add(K(0xe49b69c1ul), Inc(w0, sigma1(w14), w9, sigma0(w1))));
+    Round(h, a, b, c, d, e, f, g, Add(K(0xefbe4786ul), Inc(w1, sigma1(w15), w10, sigma0(w2))));
+    Round(g, h, a, b, c, d, e, f, Add(K(0x0fc19dc6ul), Inc(w2, sigma1(w0), w11, sigma0(w3))));
+    Round(f, g, h, a, b, c, d, e, Add(K(0x240ca1ccul), Inc(w3, sigma1(w1), w12, sigma0(w4))));
+    Round(e, f, g, h, a, b, c, d, Add(K(0x2de92c6ful), Inc(w4, sigma1(w2), w13, sigma0(w5))));
+    Round(d, e, f, g, h, a, b, c, Add(K(0x4a7484aaul), Inc(w5, sigma1(w3), w14, sigma0(w6))));
+    Round(c, d, e, f, g, h, a, b, Add(K(0x5cb0a9dcul), Inc(w6, sigma1(w4), w15, sigma0(w7))));
+    Round(b, c, d, e, f, g, h, a, Add(K(0x76f988daul), Inc(w7, sigma1(w5), w0, sigma0(w8))));
+    Round(a, b, c, d, e, f, g, h, Add(K(0x983e5152ul), Inc(w8, sigma1(w6), w1, sigma0(w9))));
+    Round(h, a, b, c, d, e, f, g, Add(K(0xa831c66dul), Inc(w9, sigma1(w7), w2, sigma0(w10))));
+    Round(g, h, a, b, c, d, e, f, Add(K(0xb00327c8ul), Inc(w10, sigma1(w8), w3, sigma0(w11))));
+    Round(f, g, h, a, b, c, d, e, Add(K(0xbf597fc7ul), Inc(w11, sigma1(w9), w4, sigma0(w12))));
+    Round(e, f, g, h, a, b, c, d, Add(K(0xc6e00bf3ul), Inc(w12, sigma1(w10), w5, sigma0(w13))));
+    Round(d, e, f, g, h, a, b, c, Add(K(0xd5a79147ul), Inc(w13, sigma1(w11), w6, sigma0(w14))));
+    Round(c, d, e, f, g, h, a, b, Add(K(0x06ca6351ul), Inc(w14, sigma1(w12), w7, sigma0(w15))));
+    Round(b, c, d, e, f, g, h, a, Add(K(0x14292967ul), Inc(w15, sigma1(w13), w8, sigma0(w0))));
+    Round(a, b, c, d, e, f, g, h, Add(K(0x27b70a85ul), Inc(w0, sigma1(w14), w9, sigma0(w1))));
+    Round(h, a, b, c, d, e, f, g, Add(K(0x2e1b2138ul), Inc(w1, sigma1(w15), w10, sigma0(w2))));
+    Round(g, h, a, b, c, d, e, f, Add(K(0x4d2c6dfcul), Inc(w2, sigma1(w0), w11, sigma0(w3))));
+    Round(f, g, h, a, b, c, d, e, Add(K(0x53380d13ul), Inc(w3, sigma1(w1), w12, sigma0(w4))));
+    Round(e, f, g, h, a, b, c, d, Add(K(0x650a7354ul), Inc(w4, sigma1(w2), w13, sigma0(w5))));
+    Round(d, e, f, g, h, a, b, c, Add(K(0x766a0abbul), Inc(w5, sigma1(w3), w14, sigma0(w6))));
+    Round(c, d, e, f, g, h, a, b, Add(K(0x81c2c92eul), Inc(w6, sigma1(w4), w15, sigma0(w7))));
+    Round(b, c, d, e, f, g, h, a, Add(K(0x92722c85ul), Inc(w7, sigma1(w5), w0, sigma0(w8))));
+    Round(a, b, c, d, e, f, g, h, Add(K(0xa2bfe8a1ul), Inc(w8, sigma1(w6), w1, sigma0(w9))));
+    Round(h, a, b, c, d, e, f, g, Add(K(0xa81a664bul), Inc(w9, sigma1(w7), w2, sigma0(w10))));
+    Round(g, h, a, b, c, d, e, f, Add(K(0xc24b8b70ul), Inc(w10, sigma1(w8), w3, sigma0(w11))));
+    Round(f, g, h, a, b, c, d, e, Add(K(0xc76c51a3ul), Inc(w11, sigma1(w9), w4, sigma0(w12))));
+    Round(e, f, g, h, a, b, c, d, Add(K(0xd192e819ul), Inc(w12, sigma1(w10), w5, sigma0(w13))));
+    Round(d, e, f, g, h, a, b, c, Add(K(0xd6990624ul), Inc(w13, sigma1(w11), w6, sigma0(w14))));
+    Round(c, d, e, f, g, h, a, b, Add(K(0xf40e3585ul), Inc(w14, sigma1(w12), w7, sigma0(w15))));
+    Round(b, c, d, e, f, g, h, a, Add(K(0x106aa070ul), Inc(w15, sigma1(w13), w8, sigma0(w0))));
+    Round(a, b, c, d, e, f, g, h, Add(K(0x19a4c116ul), Inc(w0, sigma1(w14), w9, sigma0(w1))));
+    Round(h, a, b, c, d, e, f, g, Add(K(0x1e376c08ul), Inc(w1, sigma1(w15), w10, sigma0(w2))));
+    Round(g, h, a, b, c, d, e, f, Add(K(0x2748774cul), Inc(w2, sigma1(w0), w11, sigma0(w3))));
+    Round(f, g, h, a, b, c, d, e, Add(K(0x34b0bcb5ul), Inc(w3, sigma1(w1), w12, sigma0(w4))));
+    Round(e, f, g, h, a, b, c, d, Add(K(0x391c0cb3ul), Inc(w4, sigma1(w2), w13, sigma0(w5))));
+    Round(d, e, f, g, h, a, b, c, Add(K(0x4ed8aa4aul), Inc(w5, sigma1(w3), w14, sigma0(w6))));
+    Round(c, d, e, f, g, h, a, b, Add(K(0x5b9cca4ful), Inc(w6, sigma1(w4), w15, sigma0(w7))));
+    Round(b, c, d, e, f, g, h, a, Add(K(0x682e6ff3ul), Inc(w7, sigma1(w5), w0, sigma0(w8))));
+    Round(a, b, c, d, e, f, g, h, Add(K(0x748f82eeul), Inc(w8, sigma1(w6), w1, sigma0(w9))));
+    Round(h, a, b, c, d, e, f, g, Add(K(0x78a5636ful), Inc(w9, sigma1(w7), w2, sigma0(w10))));
+    Round(g, h, a, b, c, d, e, f, Add(K(0x84c87814ul), Inc(w10, sigma1(w8), w3, sigma0(w11))));
+    Round(f, g, h, a, b, c, d, e, Add(K(0x8cc70208ul), Inc(w11, sigma1(w9), w4, sigma0(w12))));
+    Round(e, f, g, h, a, b, c, d, Add(K(0x90befffaul), Inc(w12, sigma1(w10), w5, sigma0(w13))));
+    Round(d, e, f, g, h, a, b, c, Add(K(0xa4506cebul), Inc(w13, sigma1(w11), w6, sigma0(w14))));
+    Round(c, d, e, f, g, h, a, b, Add(K(0xbef9a3f7ul), Inc(w14, sigma1(w12), w7, sigma0(w15))));
+    Round(b, c, d, e, f, g, h, a, Add(K(0xc67178f2ul), Inc(w15, sigma1(w13), w8, sigma0(w0))));
+
+    _mm512_storeu_si512(state + 0, Add(a, _mm512_loadu_si512(state + 0)));
+    _mm512_storeu_si512(state + 1, Add(b, _mm512_loadu_si512(state + 1)));
+    _mm512_storeu_si512(state + 2, Add(c, _mm512_loadu_si512(state + 2)));
+    _mm512_storeu_si512(state + 3, Add(d, _mm512_loadu_si512(state + 3)));
+    _mm512_storeu_si512(state + 4, Add(e, _mm512_loadu_si512(state + 4)));
+    _mm512_storeu_si512(state + 5, Add(f, _mm512_loadu_si512(state + 5)));
+    _mm512_storeu_si512(state + 6, Add(g, _mm512_loadu_si512(state + 6)));
+    _mm512_storeu_si512(state + 7, Add(h, _mm512_loadu_si512(state + 7)));
+}
+
+} // namespace sha256_avx512
+
+#endif
@@ -9,26 +9,45 @@
 #include "common/common.h"
 #include "common/Log.h"
 
-#include <sstream>
-
 using namespace energi;
 
 std::string Solution::getBlockTransaction() const
 {
-    if (!m_work.isValid()) {
+    if (!isValid()) {
         throw WorkException("Invalid work, solution must be wrong!");
     }
-    return m_work.getBlockTransaction();
+    return m_work->getBlockTransaction();
 }
 
 std::string Solution::getSubmitBlockData() const
 {
-    if (!m_work.isValid()) {
+    if (!isValid()) {
         throw WorkException("Invalid work, solution must be wrong!");
     }
-    std::stringstream ss;
-    //! TODO check and provid correct nType and nVersion for this operation
-    m_work.Serialize(ss, (1 << 0), 70208);
-    return strToHex(ss.str());
+    BlockHeader header(*m_work);
+    header.nNonce = m_nonce;
+    header.hashMix = m_hashMix;
+    // Only the header, the transaction count and the coinbase are encoded here, the other
+    // transactions were hex encoded when the GBT template arrived
+    CDataStream ss(SER_NETWORK, 70208);
+    ss << header;
+    WriteCompactSize(ss, m_work->transactionCount());
+    for (const auto& tx : m_work->vtx) {
+        ss << tx;
+    }
+    const RawTransactions* raw = m_work->rawTransactions.get();
+    std::size_t const rawSize = raw ? raw->bytes().size() : 0;
+
+    std::string data;
+    data.reserve(2 * (ss.size() + rawSize));
+    data.resize(2 * ss.size());
+    hex::encode(reinterpret_cast<const uint8_t*>(&ss[0]), ss.size(), &data[0]);
+    if (raw && raw->hex().size() == 2 * rawSize) {
+        data.append(raw->hex());
+    } else if (rawSize) {
+        data.resize(2 * (ss.size() + rawSize));
+        hex::encode(raw->bytes().data(), rawSize, &data[2 * ss.size()]);
+    }
+    return data;
 }
 
@@ -8,24 +8,36 @@
 #ifndef ENERGIMINER_SOLUTION_H_
 #define ENERGIMINER_SOLUTION_H_
 
+#include <chrono>
 #include <functional>
 #include <iostream>
+#include <memory>
 
+#include "common/HexCodec.h"
 #include "nrghash/nrghash.h"
 #include "uint256.h"
 #include "work.h"
 
 namespace energi {
 
+/**
+ * @brief A found nonce. Holds the work it was found for as a shared snapshot, which all the
+ * solutions of the same work share, so creating and passing one around copies no block data.
+ */
 class Solution
 {
 public:
     Solution()
     {}
 
-    Solution(Work work, unsigned extraNonce)
+    Solution(std::shared_ptr<const Work> work, uint64_t nonce, const uint256& hashMix,
+             unsigned extraNonce, const std::string& miner = std::string())
         : m_extraNonce(extraNonce)
-        , m_work(work)
+        , m_work(std::move(work))
+        , m_nonce(nonce)
+        , m_hashMix(hashMix)
+        , m_miner(miner)
+        , m_found(std::chrono::steady_clock::now())
     {}
 
     std::string getSubmitBlockData() const;
@@ -33,56 +45,80 @@ public:
 
     inline const std::string& getJobName() const
     {
-        return m_work.getJobName();
+        static const std::string noJob;
+        return m_work ? m_work->getJobName() : noJob;
     }
 
     inline std::string getTime() const
     {
-        std::stringstream stream;
-        stream << std::setfill ('0') << std::setw(sizeof(m_work.nTime)*2)
-               << std::hex << m_work.nTime;
-        return stream.str();
+        std::string time(sizeof(uint32_t) * 2, '0');
+        hex::encodeUint32(m_work ? m_work->nTime : 0, &time[0]);
+        return time;
     }
 
     inline std::string getExtraNonce() const
     {
-        std::stringstream stream;
-        stream << std::setfill ('0') << std::setw(sizeof(m_extraNonce)*2)
-               << std::hex << m_extraNonce;
-        return stream.str();
+        std::string extraNonce(sizeof(m_extraNonce) * 2, '0');
+        hex::encodeUint32(m_extraNonce, &extraNonce[0]);
+        return extraNonce;
     }
 
+    /// The work the solution was found for, its nonce and mix hash are not the solution's
     const Work& getWork() const
     {
-        return m_work;
+        static const Work noWork;
+        return m_work ? *m_work : noWork;
+    }
+
+    /// Name of the miner which found the solution
+    const std::string& getMiner() const
+    {
+        return m_miner;
     }
 
     uint64_t getNonce() const
     {
-        return m_work.getNonce();
+        return m_nonce;
     }
 
     const uint256& getHashMix() const
     {
-        return m_work.getHashMix();
+        return m_hashMix;
     }
 
     const uint256& getMerkleRoot() const
     {
-        return m_work.getMerkleRoot();
+        return getWork().getMerkleRoot();
+    }
+
+    /// When the miner found the solution
+    std::chrono::steady_clock::time_point getFound() const
+    {
+        return m_found;
     }
 
     void reset()
     {
         m_extraNonce = 0;
         m_work.reset();
+        m_nonce = 0;
+        m_hashMix.SetNull();
     }
 
 public:
-    unsigned m_extraNonce;
+    unsigned m_extraNonce = 0;
 
 private:
-    Work m_work;
+    bool isValid() const
+    {
+        return m_work && m_work->isValid();
+    }
+
+    std::shared_ptr<const Work> m_work;
+    uint64_t m_nonce = 0;
+    uint256 m_hashMix;
+    std::string m_miner;
+    std::chrono::steady_clock::time_point m_found;
 };
 
 using SolutionFoundCallback = std::function<void(const Solution&)>;
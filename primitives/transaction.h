@@ -13,6 +13,7 @@
 #include "common/serialize.h"
 #include "common/streams.h"
 #include "common/utilstrencodings.h"
+#include "common/HexCodec.h"
 
 // TODO: This only supports P2PKH addresses. This should support all address types. (issue #14)
 CScript GetScriptForDestination(const CKeyID& keyID);
@@ -378,12 +379,15 @@ struct CompareOutputBIP69
 
 inline bool DecodeHexTx(CTransaction& tx, const std::string& strHexTx)
 {
-    if (!IsHex(strHexTx)) {
+    // Checks and converts in one pass, same as IsHex followed by ParseHex
+    if (strHexTx.empty() || strHexTx.size() % 2 != 0) {
         return false;
     }
-
-    std::vector<unsigned char> txData(ParseHex(strHexTx));
-    CDataStream ssData(txData, SER_NETWORK, 70208);
+    std::vector<unsigned char> txData(strHexTx.size() / 2);
+    if (!hex::decode(strHexTx.data(), txData.size(), txData.data())) {
+        return false;
+    }
+    CByteReader ssData(txData.data(), txData.size(), SER_NETWORK, 70208);
     try {
         ssData >> tx;
     } catch (const std::exception&) {
@@ -0,0 +1,123 @@
+/*
+ * txidcache.cpp
+ *
+ * Txids of the raw transactions shared by consecutive templates.
+ */
+
+#include "txidcache.h"
+
+#include <cstring>
+
+namespace energi {
+
+const std::size_t TxidCache::c_defaultCapacity;
+
+TxidCache& TxidCache::instance()
+{
+    static TxidCache s_instance;
+    return s_instance;
+}
+
+uint64_t TxidCache::key(const unsigned char* raw, std::size_t size)
+{
+    // Only picks the slot, hits compare the bytes
+    uint64_t hash = 0x9e3779b97f4a7c15ull ^ size;
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, raw + i, 8);
+        hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ raw[i]) * 0x100000001b3ull;
+    }
+    return hash ^ (hash >> 29);
+}
+
+std::vector<std::size_t> TxidCache::lookup(const unsigned char* const* raws, const std::size_t* sizes,
+                                           uint256* txids, std::size_t count)
+{
+    std::vector<uint64_t> keys(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        keys[i] = key(raws[i], sizes[i]);
+    }
+
+    std::vector<std::size_t> missed;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (std::size_t i = 0; i < count; ++i) {
+        auto const found = m_index.find(keys[i]);
+        if (found == m_index.end()) {
+            missed.push_back(i);
+            continue;
+        }
+        const Entry& entry = *found->second;
+        if (entry.raw.size() != sizes[i] || std::memcmp(entry.raw.data(), raws[i], sizes[i]) != 0) {
+            missed.push_back(i);
+            continue;
+        }
+        txids[i] = entry.txid;
+        m_entries.splice(m_entries.begin(), m_entries, found->second);
+    }
+    m_hits.fetch_add(count - missed.size(), std::memory_order_relaxed);
+    m_misses.fetch_add(missed.size(), std::memory_order_relaxed);
+    return missed;
+}
+
+void TxidCache::store(const unsigned char* const* raws, const std::size_t* sizes, const uint256* txids,
+                      std::size_t count)
+{
+    std::vector<uint64_t> keys(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        keys[i] = key(raws[i], sizes[i]);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_capacity == 0) {
+        return;
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+        // A transaction colliding with a cached one is not cached
+        if (m_index.count(keys[i])) {
+            continue;
+        }
+        m_entries.push_front(Entry{keys[i], std::vector<unsigned char>(raws[i], raws[i] + sizes[i]), txids[i]});
+        m_index[keys[i]] = m_entries.begin();
+    }
+    evict();
+}
+
+void TxidCache::setCapacity(std::size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_capacity = capacity;
+    evict();
+}
+
+void TxidCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_index.clear();
+    m_entryCount.store(0, std::memory_order_relaxed);
+}
+
+TxidCache::Stats TxidCache::stats() const
+{
+    Stats stats;
+    stats.hits = m_hits.load(std::memory_order_relaxed);
+    stats.misses = m_misses.load(std::memory_order_relaxed);
+    stats.entries = m_entryCount.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void TxidCache::evict()
+{
+    while (m_entries.size() > m_capacity) {
+        m_index.erase(m_entries.back().key);
+        m_entries.pop_back();
+    }
+    m_entryCount.store(m_entries.size(), std::memory_order_relaxed);
+}
+
+} /* namespace energi */
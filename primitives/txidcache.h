@@ -0,0 +1,91 @@
+/*
+ * txidcache.h
+ *
+ * Txids of the raw transactions shared by consecutive templates.
+ */
+
+#ifndef ENERGIMINER_TXIDCACHE_H_
+#define ENERGIMINER_TXIDCACHE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "uint256.h"
+
+namespace energi {
+
+/**
+ * @brief Bounded cache of the txids hashed from raw transactions.
+ *
+ * Consecutive templates mostly carry the same transactions. The cache keeps the txids of the
+ * recently hashed ones, keyed by their raw bytes, so only the transactions new to a template
+ * are hashed. A hit compares the whole transaction, never just a hash of it. The least
+ * recently used entries are evicted once the capacity is reached. Hits and misses are counted
+ * for the metrics.
+ */
+class TxidCache
+{
+public:
+    static const std::size_t c_defaultCapacity = 8192;
+
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t entries = 0;
+    };
+
+    static TxidCache& instance();
+
+    /**
+     * @brief Looks up the txids of the count transactions at raws, with the given sizes.
+     * @return indexes of the ones not cached, the txids of the others are set
+     */
+    std::vector<std::size_t> lookup(const unsigned char* const* raws, const std::size_t* sizes,
+                                    uint256* txids, std::size_t count);
+
+    /// Caches the txids of the count transactions at raws, hashed by the caller
+    void store(const unsigned char* const* raws, const std::size_t* sizes, const uint256* txids,
+               std::size_t count);
+
+    void setCapacity(std::size_t capacity);
+    void clear();
+
+    /// Lookups so far and the transactions cached, read without waiting for the cache
+    Stats stats() const;
+
+private:
+    TxidCache() = default;
+    TxidCache(const TxidCache&) = delete;
+    TxidCache& operator=(const TxidCache&) = delete;
+
+    struct Entry
+    {
+        uint64_t key;
+        std::vector<unsigned char> raw;
+        uint256 txid;
+    };
+    typedef std::list<Entry> Entries;
+
+    static uint64_t key(const unsigned char* raw, std::size_t size);
+    void evict();
+
+    std::mutex m_mutex;
+    std::size_t m_capacity = c_defaultCapacity;
+    // Most recently used first
+    Entries m_entries;
+    std::unordered_map<uint64_t, Entries::iterator> m_index;
+
+    std::atomic<uint64_t> m_hits = {0};
+    std::atomic<uint64_t> m_misses = {0};
+    std::atomic<uint64_t> m_entryCount = {0};
+};
+
+} /* namespace energi */
+
+#endif /* ENERGIMINER_TXIDCACHE_H_ */
@@ -1,5 +1,7 @@
 #include <assert.h>
+#include <algorithm>
 #include "common/utilstrencodings.h"
+#include "common/HexCodec.h"
 
 #include "uint256.h"
 
@@ -59,10 +61,8 @@ base_blob<BITS>::base_blob(const std::vector<unsigned char>& vch)
 template <unsigned int BITS>
 std::string base_blob<BITS>::GetHex() const
 {
-    char psz[sizeof(data) * 2 + 1];
-    for (unsigned int i = 0; i < sizeof(data); ++i) {
-        sprintf(psz + i * 2, "%02x", data[sizeof(data) - i - 1]);
-    }
+    char psz[sizeof(data) * 2];
+    hex::encodeReversed(data, sizeof(data), psz);
     return std::string(psz, psz + sizeof(data) * 2);
 }
 
@@ -81,9 +81,15 @@ void base_blob<BITS>::SetHex(const char* psz)
     }
     // hex string to uint
     const char* pbegin = psz;
-    while (::HexDigit(*psz) != -1){
-        psz++;
+    std::size_t const digits = hex::scan(psz, std::strlen(psz));
+    if (digits == sizeof(data) * 2) {
+        unsigned char bytes[sizeof(data)];
+        if (hex::decode(psz, sizeof(data), bytes)) {
+            std::reverse_copy(bytes, bytes + sizeof(data), data);
+            return;
+        }
     }
+    psz += digits;
     psz--;
     unsigned char* p1 = (unsigned char*)data;
     unsigned char* pend = p1 + WIDTH;
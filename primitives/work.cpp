@@ -16,10 +16,17 @@ CScript COINBASE_FLAGS;
 
 Work::Work(const Json::Value& gbt,
            const std::string& extraNonce, bool)
-    : Block(gbt, extraNonce, true)
+    : Work(StratumJob(gbt), extraNonce)
+{
+}
+
+Work::Work(const StratumJob& job,
+           const std::string& extraNonce,
+           bool withTransactions)
+    : Block(job, extraNonce, withTransactions)
     , m_extraNonce(extraNonce)
 {
-    m_jobName = gbt.get((Json::Value::ArrayIndex)0, "").asString();
+    m_jobName = job.jobName;
     hashTarget = arith_uint256().SetCompact(this->nBits);
 }
 
@@ -41,8 +48,19 @@ void Work::incrementExtraNonce()
     CMutableTransaction txCoinbase(this->vtx[0]);
     txCoinbase.vin[0].scriptSig = (CScript() << this->nHeight << CScriptNum(m_secondaryExtraNonce)) + COINBASE_FLAGS;
 
-   this->vtx[0] = txCoinbase;
-   this->hashMerkleRoot = BlockMerkleRoot(*this);
+   this->vtx[0] = CTransaction(txCoinbase);
+   if (m_hasMerkleBranch) {
+       this->hashMerkleRoot = ComputeMerkleRootFromBranch(this->vtx[0].GetHash(), m_merkleBranch, 0);
+   } else {
+       this->hashMerkleRoot = BlockMerkleRoot(*this);
+   }
+}
+
+void Work::prepareMerkleBranch()
+{
+    m_merkleBranch = BlockMerkleBranch(*this, 0);
+    m_hasMerkleBranch = true;
+    this->hashMerkleRoot = ComputeMerkleRootFromBranch(this->vtx[0].GetHash(), m_merkleBranch, 0);
 }
 
 void Work::updateTimestamp()
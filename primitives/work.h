@@ -39,6 +39,10 @@ struct Work : public Block
     Work(const Json::Value& gbt,
          const std::string& extraNonce, bool);
 
+    Work(const StratumJob& job,
+         const std::string& extraNonce,
+         bool withTransactions = true);
+
     Work(const Json::Value& gbt,
          const std::string& coinbase_addr); // -> coinbase to transfer miners reward
 
@@ -59,6 +63,8 @@ struct Work : public Block
         SetNull();
         m_jobName = std::string();
         m_extraNonce = std::string();
+        m_merkleBranch.clear();
+        m_hasMerkleBranch = false;
     }
 
     bool isValid() const
@@ -80,6 +86,10 @@ struct Work : public Block
 
     void incrementExtraNonce();
 
+    /// Computes the merkle branch of the coinbase once, so that a changed coinbase only
+    /// needs to be hashed up along the branch instead of rebuilding the whole tree
+    void prepareMerkleBranch();
+
     void updateTimestamp();
 
     ADD_SERIALIZE_METHODS
@@ -113,6 +123,8 @@ struct Work : public Block
     std::string    m_jobName;
     std::string    m_extraNonce;
     arith_uint256  hashTarget;
+    std::vector<uint256> m_merkleBranch;
+    bool           m_hasMerkleBranch = false;
 
     std::string ToString() const
     {
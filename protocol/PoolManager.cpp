@@ -5,6 +5,16 @@
 
 using namespace energi;
 
+namespace
+{
+// Seconds between two evaluations of the latency scores
+const unsigned c_scoreInterval = 30;
+// Evaluations in a row a better pool has to win before switching to it
+const unsigned c_switchRounds = 2;
+// Least time spent on a pool before switching away for latency
+const std::chrono::minutes c_minDwell(5);
+}
+
 PoolManager::PoolManager(boost::asio::io_service& io_service,
                          PoolClient* client,
                          energi::MinePlant &farm,
@@ -21,19 +31,53 @@ PoolManager::PoolManager(boost::asio::io_service& io_service,
     m_maxConnectionAttempts = maxTries;
     m_failoverTimeout = failoverTimeout;
 
-	p_client->onConnected([&]()
+    setupClient(p_client);
+
+	m_farm.onSolutionFound([&](const Solution& sol)
 	{
-        m_connectionAttempt = 0;
-        m_activeConnectionHost = m_connections[m_activeConnectionIdx].Host();
-        cnote << "Connected to " << m_connections[m_activeConnectionIdx].Host() << p_client->ActiveEndPoint();
-        // Rough implementation to return to primary pool
-        // after specified amount of time
-        if (m_activeConnectionIdx != 0 && m_failoverTimeout > 0) {
-            m_failovertimer.expires_from_now(boost::posix_time::minutes(m_failoverTimeout));
-            m_failovertimer.async_wait(m_io_strand.wrap(boost::bind(&PoolManager::check_failover_timeout, this, boost::asio::placeholders::error)));
+        // Solution should passthrough only if client is
+        // properly connected. Otherwise we'll have the bad behavior
+        // to log nonce submission but receive no response
+        std::lock_guard<std::recursive_mutex> lock(m_clientMutex);
+        if (p_client->isConnected()) {
+            p_client->submitSolution(sol);
         } else {
-            m_failovertimer.cancel();
+            cnote << std::string(EthRed "Nonce ") + std::to_string(sol.getNonce()) << " wasted. Waiting for connection ...";
         }
+    return false;
+	});
+	m_farm.onMinerRestart([&]() {
+        setThreadName("main");
+		cnote << "Restart miners...";
+		if (m_farm.isMining()) {
+			cnote << "Shutting down miners...";
+			m_farm.stop();
+		}
+        auto vEngineModes = getEngineModes(m_minerType);
+        m_farm.start(vEngineModes);
+	});
+}
+
+void PoolManager::setupClient(PoolClient* client)
+{
+	client->onConnected([this, client]()
+	{
+        std::lock_guard<std::recursive_mutex> lock(m_clientMutex);
+        int const connection = connectionOf(client);
+        if (connection >= 0) {
+            m_scores.connected(connection);
+        }
+        if (client != p_client) {
+            if (Standby* standby = standbyOf(client)) {
+                standby->attempts = 0;
+            }
+            cnote << "Standby connected to " << hostOf(client) << client->ActiveEndPoint();
+            return;
+        }
+        m_connectionAttempt = 0;
+        m_activeConnectionHost = m_connections[m_activeConnectionIdx].Host();
+        cnote << "Connected to " << m_connections[m_activeConnectionIdx].Host() << client->ActiveEndPoint();
+        arm_failover_timer();
 
         if (!m_farm.isMining()) {
             cnote << "Spinning up miners...";
@@ -41,63 +85,316 @@ PoolManager::PoolManager(boost::asio::io_service& io_service,
             m_farm.start(vEngineModes);
     }
 	});
-	p_client->onResetWork([&]()
+	client->onResetWork([this, client]()
 	{
-        m_farm.resetWork();
+        std::lock_guard<std::recursive_mutex> lock(m_clientMutex);
+        if (client == p_client) {
+            m_farm.resetWork();
+        }
 	});
-	p_client->onDisconnected([&]()
+	client->onDisconnected([this, client]()
 	{
         setThreadName("main");
-        cnote << "Disconnected from " + m_activeConnectionHost << p_client->ActiveEndPoint();
+        std::lock_guard<std::recursive_mutex> lock(m_clientMutex);
+        if (client != p_client) {
+            if (Standby* standby = standbyOf(client)) {
+                standby->hasWork = false;
+            }
+            cnote << "Standby disconnected from " << hostOf(client) << client->ActiveEndPoint();
+            return;
+        }
+        cnote << "Disconnected from " + m_activeConnectionHost << client->ActiveEndPoint()
+              << (m_disconnectReason == DisconnectReason::ReturnToPrimary ? " to return to the primary pool" : "");
         // Do not stop mining here
-        // Workloop will determine if we're trying a fast reconnect to same pool
-        // or if we're switching to failover(s)
+        // With a standby at hand the miners switch to its job right away,
+        // otherwise workloop will determine if we're trying a fast reconnect to same pool
+        // or if we're switching to failover(s). Returning to the primary pool reconnects to it
+        if (m_disconnectReason == DisconnectReason::Lost) {
+            promoteStandby();
+        }
 	});
-    p_client->onWorkReceived([&](const Work& wp)
+    client->onWorkReceived([this, client](const Work& wp)
     {
-        m_farm.setWork(wp);
+        std::lock_guard<std::recursive_mutex> lock(m_clientMutex);
+        int const connection = connectionOf(client);
+        if (connection >= 0) {
+            m_scores.jobReceived(connection, wp.nHeight);
+        }
+        if (client == p_client) {
+            setFarmWork(wp);
+        } else if (Standby* standby = standbyOf(client)) {
+            standby->work = wp;
+            standby->hasWork = true;
+        }
     });
-	p_client->onSolutionAccepted([&](const bool& stale, const std::chrono::milliseconds& elapsedMs)
+	// Shares sent before a switch are still answered by their pool
+	client->onSolutionAccepted([this, client](const bool& stale, const std::chrono::milliseconds& elapsedMs)
 	{
 		using namespace std::chrono;
 		std::stringstream ss;
 		ss << std::setw(4) << std::setfill(' ') << elapsedMs.count();
-		ss << " ms." << "   " << m_connections[m_activeConnectionIdx].Host() + p_client->ActiveEndPoint();
+		ss << " ms." << "   " << hostOf(client) + client->ActiveEndPoint();
+		scoreSubmit(client, elapsedMs);
 		cnote << EthLime "**Accepted  " EthReset << (stale ? "(stale)" : "") << ss.str();
 		m_farm.acceptedSolution(stale);
 	});
-	p_client->onSolutionRejected([&](const bool& stale, std::chrono::milliseconds const& elapsedMs)
+	client->onSolutionRejected([this, client](const bool& stale, std::chrono::milliseconds const& elapsedMs)
 	{
 		using namespace std::chrono;
 		std::stringstream ss;
 		ss << std::setw(4) << std::setfill(' ') << elapsedMs.count();
-		ss << " ms." << "   " << m_connections[m_activeConnectionIdx].Host() + p_client->ActiveEndPoint();
+		ss << " ms." << "   " << hostOf(client) + client->ActiveEndPoint();
+		scoreSubmit(client, elapsedMs);
 		cwarn << EthRed "**Rejected  " EthReset << (stale ? "(stale)" : "") << ss.str();
 		m_farm.rejectedSolution();
 	});
+}
 
-	m_farm.onSolutionFound([&](const Solution& sol)
-	{
-        // Solution should passthrough only if client is
-        // properly connected. Otherwise we'll have the bad behavior
-        // to log nonce submission but receive no response
-        if (p_client->isConnected()) {
-            p_client->submitSolution(sol);
-        } else {
-            cnote << std::string(EthRed "Nonce ") + std::to_string(sol.getNonce()) << " wasted. Waiting for connection ...";
+void PoolManager::addStandbyClient(PoolClient* client)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_clientMutex);
+    Standby standby;
+    standby.client = client;
+    m_standbys.push_back(standby);
+    setupClient(client);
+}
+
+PoolManager::Standby* PoolManager::standbyOf(PoolClient* client)
+{
+    for (auto& standby : m_standbys) {
+        if (standby.client == client) {
+            return &standby;
+        }
+    }
+    return nullptr;
+}
+
+int PoolManager::connectionOf(PoolClient* client)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_clientMutex);
+    int connection = m_activeConnectionIdx;
+    if (client != p_client) {
+        Standby* standby = standbyOf(client);
+        connection = standby ? standby->connection : -1;
+    }
+    if (connection < 0 || unsigned(connection) >= m_connections.size()) {
+        return -1;
+    }
+    return connection;
+}
+
+std::string PoolManager::hostOf(PoolClient* client)
+{
+    int const connection = connectionOf(client);
+    return connection < 0 ? std::string() : m_connections[connection].Host();
+}
+
+void PoolManager::scoreSubmit(PoolClient* client, const std::chrono::milliseconds& elapsed)
+{
+    std::lock_guard<std::recursive_mutex> lock(m_clientMutex);
+    int const connection = connectionOf(client);
+    if (connection >= 0) {
+        m_scores.submitAnswered(connection, elapsed);
+    }
+}
+
+bool PoolManager::isHeldByStandby(unsigned idx, const Standby* except) const
+{
+    for (auto const& standby : m_standbys) {
+        if (&standby != except && standby.connection == int(idx)) {
+            return true;
         }
+    }
     return false;
-	});
-	m_farm.onMinerRestart([&]() {
-        setThreadName("main");
-		cnote << "Restart miners...";
-		if (m_farm.isMining()) {
-			cnote << "Shutting down miners...";
-			m_farm.stop();
-		}
-        auto vEngineModes = getEngineModes(m_minerType);
-        m_farm.start(vEngineModes);
-	});
+}
+
+int PoolManager::freeConnection(int from, const Standby& standby)
+{
+    unsigned const count = m_connections.size();
+    unsigned const start = from < 0 ? m_activeConnectionIdx : unsigned(from);
+    for (unsigned i = 1; i <= count; ++i) {
+        unsigned const idx = (start + i) % count;
+        if (idx == m_activeConnectionIdx || isHeldByStandby(idx, &standby) ||
+                m_connections[idx].Host() == "exit" || m_connections[idx].IsUnrecoverable()) {
+            continue;
+        }
+        return idx;
+    }
+    return -1;
+}
+
+bool PoolManager::promoteStandby(int connection)
+{
+    using namespace std::chrono;
+    steady_clock::time_point const start = steady_clock::now();
+
+    // Prefer the pool configured first among the ready ones, or the best scored one
+    Standby* ready = nullptr;
+    for (auto& standby : m_standbys) {
+        if (!standby.hasWork || !standby.client->isConnected() || standby.connection < 0 ||
+                (connection >= 0 && standby.connection != connection)) {
+            continue;
+        }
+        if (!ready) {
+            ready = &standby;
+        } else if (m_latencySelection) {
+            const PoolScoreBoard::Score* score = m_scores.score(standby.connection);
+            const PoolScoreBoard::Score* best = m_scores.score(ready->connection);
+            if (score && score->measured() && (!best || !best->measured() || score->value(false) < best->value(false))) {
+                ready = &standby;
+            }
+        } else if (standby.connection < ready->connection) {
+            ready = &standby;
+        }
+    }
+    if (!ready) {
+        return false;
+    }
+
+    Work work = std::move(ready->work);
+    PoolClient* previous = p_client;
+    unsigned const previousIdx = m_activeConnectionIdx;
+    p_client = ready->client;
+    m_activeConnectionIdx = ready->connection;
+    // The previous client stays with its pool as a standby
+    ready->client = previous;
+    ready->connection = previousIdx;
+    ready->attempts = 0;
+    ready->hasWork = false;
+    ready->work = Work();
+
+    m_connectionAttempt = 0;
+    m_lastSwitch = steady_clock::now();
+    m_candidate = -1;
+    m_candidateRounds = 0;
+    m_activeConnectionHost = m_connections[m_activeConnectionIdx].Host();
+    m_farm.set_pool_addresses(m_connections[m_activeConnectionIdx].Host(), m_connections[m_activeConnectionIdx].Port());
+    setFarmWork(work);
+    cnote << "Switched to standby " << m_activeConnectionHost << p_client->ActiveEndPoint() << " in "
+          << duration_cast<microseconds>(steady_clock::now() - start).count() << " us";
+    arm_failover_timer();
+    return true;
+}
+
+void PoolManager::maintainStandbys()
+{
+    for (auto& standby : m_standbys) {
+        if (standby.client->isPendingState() || standby.client->isConnected()) {
+            continue;
+        }
+        if (standby.connection < 0 || standby.attempts >= m_maxConnectionAttempts ||
+                unsigned(standby.connection) == m_activeConnectionIdx ||
+                m_connections[standby.connection].IsUnrecoverable()) {
+            standby.connection = freeConnection(standby.connection, standby);
+            standby.attempts = 0;
+            if (standby.connection < 0) {
+                continue;
+            }
+        }
+        standby.attempts++;
+        m_scores.connecting(standby.connection);
+        standby.client->setConnection(m_connections[standby.connection]);
+        cnote << "Standby pool " << (m_connections[standby.connection].Host() + ":" + toString(m_connections[standby.connection].Port()));
+        standby.client->connect();
+    }
+}
+
+void PoolManager::setFarmWork(const Work& work)
+{
+    using namespace std::chrono;
+    if (m_idle && work.isValid()) {
+        milliseconds const idle = duration_cast<milliseconds>(steady_clock::now() - m_idleSince);
+        m_idleTotal += idle;
+        m_idle = false;
+        cnote << "Miners were idle for " << idle.count() << " ms, " << m_idleTotal.count() << " ms in total";
+    }
+    m_farm.setWork(work);
+}
+
+void PoolManager::suspendMining()
+{
+    if (!m_idle) {
+        m_idle = true;
+        m_idleSince = std::chrono::steady_clock::now();
+    }
+    m_farm.setWork({});//
+}
+
+void PoolManager::arm_failover_timer()
+{
+    // Rough implementation to return to primary pool
+    // after specified amount of time, the latency selection supersedes it
+    if (m_activeConnectionIdx != 0 && m_failoverTimeout > 0 && !m_latencySelection) {
+        m_failovertimer.expires_from_now(boost::posix_time::minutes(m_failoverTimeout));
+        m_failovertimer.async_wait(m_io_strand.wrap(boost::bind(&PoolManager::check_failover_timeout, this, boost::asio::placeholders::error)));
+    } else {
+        m_failovertimer.cancel();
+    }
+}
+
+void PoolManager::selectByLatency()
+{
+    using namespace std::chrono;
+    if (!p_client->isConnected() || steady_clock::now() - m_lastSwitch < c_minDwell) {
+        return;
+    }
+
+    int best = -1;
+    for (auto const& standby : m_standbys) {
+        if (!standby.hasWork || !standby.client->isConnected() || standby.connection < 0 ||
+                !m_scores.prefers(standby.connection, m_activeConnectionIdx)) {
+            continue;
+        }
+        if (best < 0 || m_scores.prefers(standby.connection, best)) {
+            best = standby.connection;
+        }
+    }
+
+    // A pool has to stay ahead for a while, so a single slow job does not flap the selection
+    if (best < 0 || best != m_candidate) {
+        m_candidate = best;
+        m_candidateRounds = best < 0 ? 0 : 1;
+        return;
+    }
+    if (++m_candidateRounds < c_switchRounds) {
+        return;
+    }
+    const PoolScoreBoard::Score* from = m_scores.score(m_activeConnectionIdx);
+    const PoolScoreBoard::Score* to = m_scores.score(best);
+    cnote << "Switching to " << m_connections[best].Host() << " for latency, score "
+          << std::fixed << std::setprecision(1) << (from ? from->value(false) : 0.0) << " ms -> "
+          << to->value(false) << " ms";
+    promoteStandby(best);
+}
+
+void PoolManager::logScores()
+{
+    for (auto const& score : currentScores()) {
+        cnote << "Pool " << score.host << (score.active ? " (active)" : "") << std::fixed << std::setprecision(1)
+              << ": score " << score.value() << " ms, connect " << score.connectMs << " ms, propagation "
+              << score.propagationMs << " ms over " << score.jobs << " jobs, submit " << score.submitMs
+              << " ms over " << score.shares << " shares";
+    }
+}
+
+std::vector<PoolScoreBoard::Score> PoolManager::poolScores() const
+{
+    auto const scores = std::atomic_load(&m_publishedScores);
+    return scores ? *scores : std::vector<PoolScoreBoard::Score>();
+}
+
+std::vector<PoolScoreBoard::Score> PoolManager::currentScores() const
+{
+    std::lock_guard<std::recursive_mutex> lock(m_clientMutex);
+    std::vector<PoolScoreBoard::Score> scores = m_scores.scores();
+    for (auto& score : scores) {
+        if (score.connection < m_connections.size()) {
+            score.host = m_connections[score.connection].Host();
+            score.port = m_connections[score.connection].Port();
+        }
+        score.active = score.connection == m_activeConnectionIdx;
+    }
+    return scores;
 }
 
 void PoolManager::stop()
@@ -107,8 +404,18 @@ void PoolManager::stop()
         m_running.store(false, std::memory_order_relaxed);
         m_failovertimer.cancel();
 
-        if (p_client->isConnected()) {
-            p_client->disconnect();
+        std::vector<PoolClient*> clients;
+        {
+            std::lock_guard<std::recursive_mutex> lock(m_clientMutex);
+            clients.push_back(p_client);
+            for (auto const& standby : m_standbys) {
+                clients.push_back(standby.client);
+            }
+        }
+        for (auto client : clients) {
+            if (client->isConnected()) {
+                client->disconnect();
+            }
         }
         if (m_farm.isMining()) {
             cnote << "Shutting down miners...";
@@ -121,33 +428,48 @@ void PoolManager::trun()
 {
     setThreadName("main");
     while (m_running.load(std::memory_order_relaxed)) {
+        std::unique_lock<std::recursive_mutex> lock(m_clientMutex);
         // Take action only if not pending state (connecting/disconnecting)
         // Otherwise do nothing and wait until connection state is NOT pending
         if (!p_client->isPendingState()) {
-            if (!p_client->isConnected()) {
+            if (!p_client->isConnected() &&
+                    (m_disconnectReason == DisconnectReason::ReturnToPrimary || !promoteStandby())) {
+                m_disconnectReason = DisconnectReason::Lost;
                 // If this connection is marked Unrecoverable then discard it
                 if (m_connections[m_activeConnectionIdx].IsUnrecoverable()) {
-                    m_connections.erase(m_connections.begin() + m_activeConnectionIdx);
-                    if (m_activeConnectionIdx >= m_connections.size()) {
-                        m_activeConnectionIdx = 0;
+                    if (m_standbys.empty()) {
+                        m_connections.erase(m_connections.begin() + m_activeConnectionIdx);
+                        m_scores.erase(m_activeConnectionIdx);
+                        if (m_activeConnectionIdx >= m_connections.size()) {
+                            m_activeConnectionIdx = 0;
+                        }
+                        m_connectionAttempt = 0;
+                    } else {
+                        // Standbys refer to their connections, skip it instead
+                        m_connectionAttempt = m_maxConnectionAttempts;
                     }
-                    m_connectionAttempt = 0;
                 }
                 // Rotate connections if above max attempts threshold
                 if (m_connectionAttempt >= m_maxConnectionAttempts) {
                     m_connectionAttempt = 0;
-                    m_activeConnectionIdx++;
-                    if (m_activeConnectionIdx == m_connections.size()) {
-                        m_activeConnectionIdx = 0;
+                    for (unsigned i = 0; i < m_connections.size(); ++i) {
+                        m_activeConnectionIdx++;
+                        if (m_activeConnectionIdx == m_connections.size()) {
+                            m_activeConnectionIdx = 0;
+                        }
+                        if (!isHeldByStandby(m_activeConnectionIdx) && !m_connections[m_activeConnectionIdx].IsUnrecoverable()) {
+                            break;
+                        }
                     }
 
                     // Suspend mining if applicable as we're switching
                     if (m_farm.isMining()) {
                         cnote << "Suspend mining due connection change...";
-                        m_farm.setWork({});//
+                        suspendMining();
                     }
                 }
-                if (m_connections[m_activeConnectionIdx].Host() != "exit"  && m_connections.size() > 0) {
+                if (m_connections[m_activeConnectionIdx].Host() != "exit"  && m_connections.size() > 0 &&
+                        !m_connections[m_activeConnectionIdx].IsUnrecoverable()) {
                     // Count connectionAttempts
                     m_connectionAttempt++;
 
@@ -155,6 +477,7 @@ void PoolManager::trun()
                     p_client->setConnection(m_connections[m_activeConnectionIdx]);
                     m_farm.set_pool_addresses(m_connections[m_activeConnectionIdx].Host(), m_connections[m_activeConnectionIdx].Port());
                     cnote << "Selected pool" << (m_connections[m_activeConnectionIdx].Host() + ":" + toString(m_connections[m_activeConnectionIdx].Port()));
+                    m_scores.connecting(m_activeConnectionIdx);
                     p_client->connect();
 
                 } else {
@@ -171,6 +494,20 @@ void PoolManager::trun()
             }
 
         }
+        maintainStandbys();
+        if (++m_scoreTimePassed >= c_scoreInterval) {
+            m_scoreTimePassed = 0;
+            if (m_latencySelection) {
+                selectByLatency();
+            }
+            if (m_latencySelection || g_logVerbosity >= 6) {
+                logScores();
+            }
+        }
+        std::atomic_store(&m_publishedScores,
+                std::shared_ptr<const std::vector<PoolScoreBoard::Score>>(
+                    std::make_shared<std::vector<PoolScoreBoard::Score>>(currentScores())));
+        lock.unlock();
 
         // Hashrate reporting
         m_hashrateReportingTimePassed++;
@@ -199,10 +536,25 @@ void PoolManager::addConnection(URI &conn)
 
 void PoolManager::clearConnections()
 {
-    m_connections.clear();
-    m_farm.set_pool_addresses("", 0);
-    if (p_client && p_client->isConnected()) {
-        p_client->disconnect();
+    std::vector<PoolClient*> clients;
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_clientMutex);
+        m_connections.clear();
+        m_scores.clear();
+        m_farm.set_pool_addresses("", 0);
+        if (p_client) {
+            clients.push_back(p_client);
+        }
+        for (auto& standby : m_standbys) {
+            standby.connection = -1;
+            standby.hasWork = false;
+            clients.push_back(standby.client);
+        }
+    }
+    for (auto client : clients) {
+        if (client->isConnected()) {
+            client->disconnect();
+        }
     }
 }
 
@@ -225,12 +577,20 @@ void PoolManager::check_failover_timeout(const boost::system::error_code& ec)
 
     if (!ec) {
         if (m_running.load(std::memory_order_relaxed)) {
-            if (m_activeConnectionIdx != 0) {
-                p_client->disconnect();
-                m_activeConnectionIdx = 0;
-                m_connectionAttempt = 0;
+            PoolClient* client = nullptr;
+            {
+                std::lock_guard<std::recursive_mutex> lock(m_clientMutex);
+                // A standby on the primary pool takes over without a reconnect
+                if (m_activeConnectionIdx != 0 && !promoteStandby(0)) {
+                    client = p_client;
+                    m_activeConnectionIdx = 0;
+                    m_connectionAttempt = 0;
+                    m_disconnectReason = DisconnectReason::ReturnToPrimary;
+                }
+            }
+            if (client) {
+                client->disconnect();
             }
         }
     }
 }
-
@@ -1,11 +1,15 @@
 #pragma once
 
+#include <chrono>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <primitives/worker.h>
 #include <nrgcore/mineplant.h>
 #include <nrgcore/miner.h>
 
 #include "PoolClient.h"
+#include "PoolScore.h"
 
 class PoolManager : public energi::Worker
 {
@@ -18,10 +22,27 @@ public:
                 unsigned failovertimeout);
     void addConnection(URI &conn);
     void clearConnections();
+    /**
+     * @brief Adds a client kept connected to a failover pool in the background.
+     * When the active pool drops the miners continue on the latest job of a standby
+     * right away, the standby becomes the active client.
+     */
+    void addStandbyClient(PoolClient* client);
+    /**
+     * @brief Lets the pool with the best latency score become the active one.
+     * Needs standby clients, the switch happens by promoting the standby connected to it.
+     */
+    void setLatencySelection(bool enabled) { m_latencySelection = enabled; }
+    /// Latency scores of the pools measured so far, as of the last second. Takes no lock
+    std::vector<PoolScoreBoard::Score> poolScores() const;
     bool start();
     void stop();
 
-    bool isConnected() { return p_client->isConnected(); };
+    bool isConnected()
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_clientMutex);
+        return p_client->isConnected();
+    };
     bool isRunning() { return m_running; };
 
 private:
@@ -30,6 +51,39 @@ private:
     // After this amount of time in minutes of mining on a failover pool return to "primary"
     unsigned m_failoverTimeout = 0;
     void check_failover_timeout(const boost::system::error_code& ec);
+    void arm_failover_timer();
+
+    // Why the active client went away, a standby only takes over from a lost pool
+    enum class DisconnectReason
+    {
+        Lost,
+        ReturnToPrimary
+    };
+    DisconnectReason m_disconnectReason = DisconnectReason::Lost;
+
+    struct Standby
+    {
+        PoolClient* client = nullptr;
+        int connection = -1;
+        unsigned attempts = 0;
+        bool hasWork = false;
+        energi::Work work;
+    };
+
+    void setupClient(PoolClient* client);
+    Standby* standbyOf(PoolClient* client);
+    int connectionOf(PoolClient* client);
+    std::string hostOf(PoolClient* client);
+    void scoreSubmit(PoolClient* client, const std::chrono::milliseconds& elapsed);
+    bool isHeldByStandby(unsigned idx, const Standby* except = nullptr) const;
+    int freeConnection(int from, const Standby& standby);
+    bool promoteStandby(int connection = -1);
+    void maintainStandbys();
+    void setFarmWork(const energi::Work& work);
+    void suspendMining();
+    void selectByLatency();
+    void logScores();
+    std::vector<PoolScoreBoard::Score> currentScores() const;
 
     std::atomic<bool> m_running = { false };
     void trun() override;
@@ -43,7 +97,23 @@ private:
 
     boost::asio::io_service::strand m_io_strand;
     boost::asio::deadline_timer m_failovertimer;
+    // Guards the client roles, never held while disconnecting a client
+    mutable std::recursive_mutex m_clientMutex;
     PoolClient *p_client;
+    std::vector<Standby> m_standbys;
+    // Time the miners spent without work because of connection changes
+    bool m_idle = false;
+    std::chrono::steady_clock::time_point m_idleSince;
+    std::chrono::milliseconds m_idleTotal{0};
+    PoolScoreBoard m_scores;
+    // Copy of the scores for readers which must not wait for the client mutex, swapped atomically
+    std::shared_ptr<const std::vector<PoolScoreBoard::Score>> m_publishedScores;
+    bool m_latencySelection = false;
+    // Hysteresis of the latency selection
+    std::chrono::steady_clock::time_point m_lastSwitch;
+    int m_candidate = -1;
+    unsigned m_candidateRounds = 0;
+    unsigned m_scoreTimePassed = 0;
     energi::MinePlant &m_farm;
     MinerExecutionMode m_minerType;
 };
@@ -0,0 +1,128 @@
+#include "PoolScore.h"
+
+#include <algorithm>
+
+namespace
+{
+// Moving averages weigh the last samples like a window of this size
+const unsigned c_window = 8;
+// Heights kept for comparing the notifies of the pools
+const uint32_t c_heightsKept = 16;
+// A late notify beyond this is a stalled pool rather than propagation, don't let it dominate
+const double c_maxPropagationMs = 10000.0;
+}
+
+const unsigned PoolScoreBoard::c_minJobs;
+
+bool PoolScoreBoard::Score::measured() const
+{
+    return jobs >= c_minJobs && connects > 0;
+}
+
+double PoolScoreBoard::Score::value(bool bySubmit) const
+{
+    return propagationMs + (bySubmit && shares > 0 ? submitMs : connectMs);
+}
+
+void PoolScoreBoard::average(double& value, double sample, unsigned count)
+{
+    value += (sample - value) / std::min(count, c_window);
+}
+
+void PoolScoreBoard::connecting(unsigned connection, Clock::time_point when)
+{
+    Entry& entry = m_entries[connection];
+    entry.connectStart = when;
+    entry.connecting = true;
+    entry.fresh = true;
+}
+
+void PoolScoreBoard::connected(unsigned connection, Clock::time_point when)
+{
+    using namespace std::chrono;
+    Entry& entry = m_entries[connection];
+    if (!entry.connecting) {
+        return;
+    }
+    entry.connecting = false;
+    double const ms = duration_cast<microseconds>(when - entry.connectStart).count() / 1000.0;
+    average(entry.score.connectMs, ms, ++entry.score.connects);
+}
+
+void PoolScoreBoard::jobReceived(unsigned connection, uint32_t height, Clock::time_point when)
+{
+    using namespace std::chrono;
+    Entry& entry = m_entries[connection];
+    if (height == 0 || height == entry.lastHeight) {
+        return;
+    }
+    entry.lastHeight = height;
+
+    auto first = m_firstSeen.find(height);
+    if (first == m_firstSeen.end()) {
+        first = m_firstSeen.emplace(height, when).first;
+        while (!m_firstSeen.empty() && m_firstSeen.begin()->first + c_heightsKept < height) {
+            m_firstSeen.erase(m_firstSeen.begin());
+        }
+    }
+    if (entry.fresh) {
+        entry.fresh = false;
+        return;
+    }
+    double const ms = duration_cast<microseconds>(when - first->second).count() / 1000.0;
+    average(entry.score.propagationMs, std::min(ms, c_maxPropagationMs), ++entry.score.jobs);
+}
+
+void PoolScoreBoard::submitAnswered(unsigned connection, std::chrono::milliseconds elapsed)
+{
+    Entry& entry = m_entries[connection];
+    average(entry.score.submitMs, double(elapsed.count()), ++entry.score.shares);
+}
+
+void PoolScoreBoard::erase(unsigned connection)
+{
+    m_entries.erase(connection);
+    for (auto it = m_entries.upper_bound(connection); it != m_entries.end();) {
+        m_entries[it->first - 1] = std::move(it->second);
+        it = m_entries.erase(it);
+    }
+}
+
+void PoolScoreBoard::clear()
+{
+    m_entries.clear();
+    m_firstSeen.clear();
+}
+
+const PoolScoreBoard::Score* PoolScoreBoard::score(unsigned connection) const
+{
+    auto it = m_entries.find(connection);
+    return it == m_entries.end() ? nullptr : &it->second.score;
+}
+
+bool PoolScoreBoard::prefers(unsigned candidate, unsigned current) const
+{
+    const Score* challenger = score(candidate);
+    if (!challenger || !challenger->measured()) {
+        return false;
+    }
+    const Score* incumbent = score(current);
+    if (!incumbent || !incumbent->measured()) {
+        return true;
+    }
+    // Only the active pool gets shares, compare round trips on the same footing
+    bool const bySubmit = challenger->shares > 0 && incumbent->shares > 0;
+    double const gain = incumbent->value(bySubmit) - challenger->value(bySubmit);
+    return gain > c_minGainMs && gain > incumbent->value(bySubmit) * c_margin;
+}
+
+std::vector<PoolScoreBoard::Score> PoolScoreBoard::scores() const
+{
+    std::vector<Score> result;
+    result.reserve(m_entries.size());
+    for (auto const& entry : m_entries) {
+        result.push_back(entry.second.score);
+        result.back().connection = entry.first;
+    }
+    return result;
+}
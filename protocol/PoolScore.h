@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Latency scores of the configured pools, indexed like the connections of PoolManager.
+ *
+ * Three delays are tracked as moving averages: the time from starting a connection until it is
+ * usable, the job propagation delay (how much later than the first pool a pool notified a new
+ * height) and the submit round trip. The score of a pool is its propagation delay plus its round
+ * trip, the connect time standing in for the latter until a share was answered. Lower is better.
+ * Not thread safe, PoolManager guards it with its client mutex.
+ */
+class PoolScoreBoard
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Score
+    {
+        unsigned connection = 0;
+        std::string host;
+        unsigned short port = 0;
+        bool active = false;
+        unsigned connects = 0;
+        unsigned jobs = 0;
+        unsigned shares = 0;
+        double connectMs = 0;
+        double propagationMs = 0;
+        double submitMs = 0;
+
+        bool measured() const;
+        double value(bool bySubmit = true) const;
+    };
+
+    /// Samples a pool needs before its score is trusted
+    static const unsigned c_minJobs = 3;
+    /// Relative and absolute margin a pool has to beat the current one by
+    static constexpr double c_margin = 0.2;
+    static constexpr double c_minGainMs = 5.0;
+
+    void connecting(unsigned connection, Clock::time_point when = Clock::now());
+    void connected(unsigned connection, Clock::time_point when = Clock::now());
+    void jobReceived(unsigned connection, uint32_t height, Clock::time_point when = Clock::now());
+    void submitAnswered(unsigned connection, std::chrono::milliseconds elapsed);
+    /// Drops the score of a removed connection, the ones after it move down like the connections
+    void erase(unsigned connection);
+    void clear();
+
+    const Score* score(unsigned connection) const;
+
+    /// True if candidate scores better than current by the hysteresis margin
+    bool prefers(unsigned candidate, unsigned current) const;
+
+    std::vector<Score> scores() const;
+
+private:
+    struct Entry
+    {
+        Score score;
+        Clock::time_point connectStart;
+        bool connecting = false;
+        // The first job after connecting is the current one, not a fresh notify
+        bool fresh = true;
+        uint32_t lastHeight = 0;
+    };
+
+    static void average(double& value, double sample, unsigned count);
+
+    std::map<unsigned, Entry> m_entries;
+    // When each recent height was notified first by any pool
+    std::map<uint32_t, Clock::time_point> m_firstSeen;
+};
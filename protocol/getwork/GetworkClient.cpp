@@ -1,9 +1,13 @@
 #include <chrono>
+#include <memory>
 #include <boost/exception/diagnostic_information.hpp>
 
 #include "GetworkClient.h"
+#include "nrgcore/telemetry.h"
+#include "common/Trace.h"
 
 std::mutex GetworkClient::s_mutex;
+const long GetworkClient::c_longpollTimeoutMs;
 
 using namespace energi;
 
@@ -20,6 +24,18 @@ GetworkClient::GetworkClient(unsigned const & farmRecheckPeriod, const std::stri
 GetworkClient::~GetworkClient()
 {
 	p_client = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_submitMutex);
+        m_submitStop = true;
+    }
+    m_submitReady.notify_all();
+    if (m_submitThread.joinable()) {
+        m_submitThread.join();
+    }
+    // Returns at the latest after c_longpollTimeoutMs, when the pending long poll times out
+    if (m_longpollThread.joinable()) {
+        m_longpollThread.join();
+    }
 }
 
 void GetworkClient::connect()
@@ -28,6 +44,7 @@ void GetworkClient::connect()
     std::string uri = "http://" + m_conn->User() + ":" + m_conn->Pass() + "@" + m_conn->Host() + ":" + std::to_string(m_conn->Port());
     if (m_conn->Path().length())
         uri += m_conn->Path();
+    m_uri = uri;
     p_client = new ::JsonrpcGetwork(new jsonrpc::HttpClient(uri), m_coinbase);
 
     m_connected.store(true, std::memory_order_relaxed);
@@ -38,6 +55,9 @@ void GetworkClient::connect()
     // No need to worry about starting again.
     // Worker class prevents that
     startWorking();
+    if (!m_submitThread.joinable()) {
+        m_submitThread = std::thread(&GetworkClient::submitLoop, this);
+    }
 }
 
 void GetworkClient::disconnect()
@@ -58,38 +78,162 @@ void GetworkClient::submitHashrate(const std::string& rate)
 	m_currentHashrateToSubmit = rate;
 }
 
-void GetworkClient::submit()
+void GetworkClient::submit(JsonrpcGetwork& client, const Solution& solution,
+                           std::chrono::steady_clock::time_point found)
 {
-    std::lock_guard<std::mutex> lock(s_mutex);
-    if (m_connected.load(std::memory_order_relaxed)) {
-        try {
+    using namespace std::chrono;
+    if (!m_connected.load(std::memory_order_relaxed)) {
+        cwarn << "Block with nonce " << solution.getNonce() << " dropped, not connected";
+        return;
+    }
+    try {
+        {
+            std::lock_guard<std::mutex> workLock(m_workMutex);
             m_prevWork.reset();
-            std::chrono::steady_clock::time_point submit_start = std::chrono::steady_clock::now();
-            bool accepted = p_client->submitWork(m_solutionToSubmit);
-            std::chrono::milliseconds response_delay_ms =
-                std::chrono::duration_cast<std::chrono::milliseconds>(
-                        std::chrono::steady_clock::now() - submit_start);
+            m_prevTemplate.clear();
+        }
+        steady_clock::time_point submit_start = steady_clock::now();
+        bool accepted = client.submitWork(solution);
+        Trace::complete(Trace::c_submit, submit_start, steady_clock::now(), solution.getJobName());
+        steady_clock::time_point const answered = steady_clock::now();
+        milliseconds response_delay_ms = duration_cast<milliseconds>(answered - submit_start);
+        cnote << "Block answered " << duration_cast<milliseconds>(answered - found).count()
+              << " ms after it was found, queued " << duration_cast<milliseconds>(submit_start - found).count() << " ms";
+        if (DeviceTelemetry* device = Telemetry::instance().find(solution.getMiner())) {
+            device->submitRtt.record(answered - submit_start);
             if (accepted) {
-                if (m_onSolutionAccepted) {
-                    m_onSolutionAccepted(false, response_delay_ms);
-                }
+                device->shareAccepted(false);
             } else {
-                if (m_onSolutionRejected) {
-                    m_onSolutionRejected(false, response_delay_ms);
-                }
+                device->shareRejected();
             }
-        } catch (const jsonrpc::JsonRpcException& ex) {
-            cwarn << "Failed to submit solution.";
-            cwarn << boost::diagnostic_information(ex);
         }
+        if (accepted) {
+            if (m_onSolutionAccepted) {
+                m_onSolutionAccepted(false, response_delay_ms);
+            }
+        } else {
+            if (m_onSolutionRejected) {
+                m_onSolutionRejected(false, response_delay_ms);
+            }
+        }
+    } catch (const jsonrpc::JsonRpcException& ex) {
+        cwarn << "Failed to submit solution.";
+        cwarn << boost::diagnostic_information(ex);
     }
-    m_solutionToSubmit.reset();
 }
 
 void GetworkClient::submitSolution(const Solution& solution)
 {
-    std::lock_guard<std::mutex> lock(s_mutex);
-    m_solutionToSubmit = solution;
+    {
+        std::lock_guard<std::mutex> lock(m_submitMutex);
+        Submission submission;
+        submission.solution = solution;
+        submission.found = solution.getFound();
+        m_submitQueue.push_back(std::move(submission));
+    }
+    m_submitReady.notify_one();
+}
+
+void GetworkClient::submitLoop()
+{
+    // The connection is kept open between the submissions
+    std::string uri;
+    std::unique_ptr<jsonrpc::HttpClient> connector;
+    std::unique_ptr<JsonrpcGetwork> client;
+
+    while (true) {
+        Submission submission;
+        {
+            std::unique_lock<std::mutex> lock(m_submitMutex);
+            m_submitReady.wait(lock, [&]() { return m_submitStop || !m_submitQueue.empty(); });
+            if (m_submitStop) {
+                return;
+            }
+            submission = std::move(m_submitQueue.front());
+            m_submitQueue.pop_front();
+        }
+        {
+            std::lock_guard<std::mutex> lock(s_mutex);
+            if (!client || uri != m_uri) {
+                uri = m_uri;
+                client.reset();
+                connector.reset(new jsonrpc::HttpClient(uri));
+                client.reset(new JsonrpcGetwork(connector.get(), m_coinbase));
+            }
+        }
+        submit(*client, submission.solution, submission.found);
+    }
+}
+
+void GetworkClient::processTemplate(const Json::Value& gbt)
+{
+    // Work only changes with the previous block, skip building it for unchanged templates
+    std::string const id = gbt.get("previousblockhash", "").asString() + ":" + toString(gbt.get("height", 0).asUInt());
+    {
+        std::lock_guard<std::mutex> lock(m_workMutex);
+        if (id == m_prevTemplate) {
+            return;
+        }
+    }
+    auto const start = std::chrono::steady_clock::now();
+    energi::Work newWork(gbt, m_coinbase);
+    Trace::complete(Trace::c_workBuild, start, std::chrono::steady_clock::now(), newWork.getJobName());
+    if (std::size_t const mismatched = newWork.rawTransactions ? newWork.rawTransactions->mismatchedTxids() : 0) {
+        cwarn << mismatched << " txids sent by the node don't match their transactions, using the hashed ones";
+    }
+
+    std::lock_guard<std::mutex> lock(m_workMutex);
+    // Check if header changes so the new workpackage is really new
+    if (id != m_prevTemplate && newWork != m_prevWork) {
+        m_prevTemplate = id;
+        m_prevWork = newWork;
+        if (m_onWorkReceived) {
+            m_onWorkReceived(m_prevWork);
+        }
+    }
+}
+
+void GetworkClient::longpoll(std::string longpollId)
+{
+    std::string uri;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        uri = m_uri;
+    }
+    using namespace std::chrono;
+    jsonrpc::HttpClient connector(uri);
+    connector.SetTimeout(c_longpollTimeoutMs);
+    JsonrpcGetwork client(&connector, m_coinbase);
+
+    steady_clock::time_point requested;
+    while (!shouldStop() && m_connected.load(std::memory_order_relaxed)) {
+        // A node answering right away despite the long poll id is not asked more often than
+        // without long polling
+        steady_clock::time_point const next = requested + milliseconds(m_farmRecheckPeriod);
+        if (next > steady_clock::now()) {
+            std::this_thread::sleep_until(next);
+            continue;
+        }
+        requested = steady_clock::now();
+        try {
+            Json::Value gbt = client.getBlockTemplate(longpollId);
+            longpollId = gbt.get("longpollid", "").asString();
+            processTemplate(gbt);
+            if (longpollId.empty()) {
+                break;
+            }
+        } catch (const jsonrpc::JsonRpcException&) {
+            // The template did not change while the request was held, ask again. A request
+            // failing earlier hands polling back to trun, which starts over.
+            if (steady_clock::now() - requested < milliseconds(c_longpollTimeoutMs)) {
+                break;
+            }
+        } catch (const std::exception& ex) {
+            cwarn << "Discarding block template: " << ex.what();
+            break;
+        }
+    }
+    m_longpolling.store(false, std::memory_order_relaxed);
 }
 
 // Handles all getwork communication.
@@ -99,15 +243,18 @@ void GetworkClient::trun()
         if (m_connected.load(std::memory_order_relaxed)) {
             // Get Work
             try {
-                if (m_solutionToSubmit.getNonce() > 0) {
-                    submit();
-                }
-                energi::Work newWork = p_client->getWork();
-                // Check if header changes so the new workpackage is really new
-                if (newWork != m_prevWork) {
-                    m_prevWork = newWork;
-                    if (m_onWorkReceived) {
-                        m_onWorkReceived(m_prevWork);
+                if (!m_longpolling.load(std::memory_order_relaxed)) {
+                    Json::Value gbt = p_client->getBlockTemplate();
+                    processTemplate(gbt);
+
+                    // Let the node tell about new templates from now on
+                    std::string longpollId = gbt.get("longpollid", "").asString();
+                    if (!longpollId.empty()) {
+                        if (m_longpollThread.joinable()) {
+                            m_longpollThread.join();
+                        }
+                        m_longpolling.store(true, std::memory_order_relaxed);
+                        m_longpollThread = std::thread(&GetworkClient::longpoll, this, longpollId);
                     }
                 }
             } catch (jsonrpc::JsonRpcException) {
@@ -1,7 +1,13 @@
 #pragma once
 
 #include <jsonrpccpp/client/connectors/httpclient.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <primitives/worker.h>
 #include "jsonrpc_getwork.h"
 #include "../PoolClient.h"
@@ -23,17 +29,47 @@ public:
 	void submitHashrate(const std::string& rate) override;
 	void submitSolution(const energi::Solution& solution) override;
 
-    void submit();
+    /**
+     * How long the node may hold a long poll before the request is repeated. Kept short since
+     * disconnecting and stopping wait for the pending long poll.
+     */
+    static const long c_longpollTimeoutMs = 10 * 1000;
 
 private:
 	void trun() override;
+	void longpoll(std::string longpollId);
+	void processTemplate(const Json::Value& gbt);
+	void submitLoop();
+	void submit(JsonrpcGetwork& client, const energi::Solution& solution,
+	            std::chrono::steady_clock::time_point found);
 	unsigned m_farmRecheckPeriod = 500;
 
 private:
-    energi::Solution m_solutionToSubmit;
     std::string m_coinbase;
     std::string m_currentHashrateToSubmit = "";
     JsonrpcGetwork *p_client = nullptr;
     energi::Work m_prevWork;
     static std::mutex s_mutex;
+
+    std::string m_uri;
+    // Previous block and height of the last template, checked before building its Work
+    std::string m_prevTemplate;
+    std::mutex m_workMutex;
+
+    // Waits for template changes while the node supports long polling, trun polls otherwise
+    std::thread m_longpollThread;
+    std::atomic<bool> m_longpolling = { false };
+
+    // Found blocks waiting for the submit thread, which sends them right away on its own
+    // connection, independently of the template polling
+    struct Submission
+    {
+        energi::Solution solution;
+        std::chrono::steady_clock::time_point found;
+    };
+    std::mutex m_submitMutex;
+    std::condition_variable m_submitReady;
+    std::deque<Submission> m_submitQueue;
+    bool m_submitStop = false;
+    std::thread m_submitThread;
 };
@@ -6,6 +6,7 @@
 #define JSONRPC_CPP_STUB_GETWORK_H_
 
 #include <jsonrpccpp/client.h>
+#include <chrono>
 #include <string>
 #include <primitives/solution.h>
 #include "common/Log.h"
@@ -19,7 +20,12 @@ public:
         this->m_client = new jsonrpc::Client(*conn, jsonrpc::JSONRPC_CLIENT_V1);
     }
 
-    Json::Value getBlockTemplate() throw (jsonrpc::JsonRpcException)
+    /**
+     * @brief Requests a block template.
+     * With the longpollid of the previous template the node holds the request (BIP22 long
+     * polling) until the template changes, e.g. because a new block arrived.
+     */
+    Json::Value getBlockTemplate(const std::string& longpollId = std::string()) throw (jsonrpc::JsonRpcException)
     {
         auto params = Json::Value(Json::arrayValue);
         auto object = Json::Value(Json::objectValue);
@@ -28,6 +34,9 @@ public:
         object["capabilities"].append("coinbasevalue");
         object["capabilities"].append("longpoll");
         object["capabilities"].append("workid");
+        if (!longpollId.empty()) {
+            object["longpollid"] = longpollId;
+        }
         params.append(object);
 
         Json::Value result = this->m_client->CallMethod("getblocktemplate", params);
@@ -46,8 +55,12 @@ public:
 
     bool submitWork(const energi::Solution &solution)
     {
+        using namespace std::chrono;
         Json::Value params(Json::arrayValue);
+        steady_clock::time_point const start = steady_clock::now();
         auto result1 = solution.getSubmitBlockData();
+        cnote << "Block payload of " << result1.size() / 2 << " bytes built in "
+              << duration_cast<microseconds>(steady_clock::now() - start).count() << " us";
         params.append(result1);
         Json::Value result = this->m_client->CallMethod("submitblock", params);
         auto resultStr = result.toStyledString();
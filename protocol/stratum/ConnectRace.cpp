@@ -0,0 +1,139 @@
+#include "ConnectRace.h"
+
+#include <boost/bind.hpp>
+
+#include <common/Log.h>
+#include <common/common.h>
+
+const unsigned ConnectRace::c_staggerMs;
+
+ConnectRace::ConnectRace(boost::asio::io_service& io_service, boost::asio::io_service::strand& strand,
+                         const std::vector<Endpoint>& endpoints, std::chrono::milliseconds timeout)
+    : m_io_service(io_service)
+    , m_io_strand(strand)
+    , m_staggerTimer(io_service)
+    , m_timeoutTimer(io_service)
+    , m_timeout(timeout)
+{
+    m_attempts.reserve(endpoints.size());
+    for (auto const& endpoint : endpoints) {
+        Attempt attempt;
+        attempt.endpoint = endpoint;
+        m_attempts.push_back(attempt);
+    }
+}
+
+void ConnectRace::start(const Handler& handler)
+{
+    m_handler = handler;
+    if (m_attempts.empty()) {
+        m_io_service.post(m_io_strand.wrap(boost::bind(&ConnectRace::finish, shared_from_this(),
+                        boost::asio::error::host_not_found, m_attempts.size())));
+        return;
+    }
+    m_timeoutTimer.expires_from_now(boost::posix_time::milliseconds(m_timeout.count()));
+    m_timeoutTimer.async_wait(m_io_strand.wrap(boost::bind(&ConnectRace::onTimeout, shared_from_this(),
+                    boost::asio::placeholders::error)));
+    m_io_service.post(m_io_strand.wrap(boost::bind(&ConnectRace::launch, shared_from_this())));
+}
+
+void ConnectRace::cancel()
+{
+    m_io_service.post(m_io_strand.wrap(boost::bind(&ConnectRace::abandon, shared_from_this())));
+}
+
+void ConnectRace::abandon()
+{
+    m_handler = Handler();
+    finish(boost::asio::error::operation_aborted, m_attempts.size());
+}
+
+void ConnectRace::launch()
+{
+    if (m_done || m_next >= m_attempts.size()) {
+        return;
+    }
+    std::size_t const index = m_next++;
+    Attempt& attempt = m_attempts[index];
+    attempt.socket = std::make_shared<Socket>(m_io_service);
+    m_pending++;
+    if (g_logVerbosity >= 6) {
+        cnote << ("Trying " + toString(attempt.endpoint) + " ...");
+    }
+    attempt.socket->async_connect(attempt.endpoint, m_io_strand.wrap(boost::bind(&ConnectRace::onConnect,
+                    shared_from_this(), index, boost::asio::placeholders::error)));
+
+    if (m_next < m_attempts.size()) {
+        m_staggerTimer.expires_from_now(boost::posix_time::milliseconds(c_staggerMs));
+        m_staggerTimer.async_wait(m_io_strand.wrap(boost::bind(&ConnectRace::onStagger, shared_from_this(),
+                        boost::asio::placeholders::error)));
+    }
+}
+
+void ConnectRace::onConnect(std::size_t index, const boost::system::error_code& ec)
+{
+    m_pending--;
+    if (m_done) {
+        return;
+    }
+    if (!ec) {
+        finish(ec, index);
+        return;
+    }
+
+    cwarn << ("Error  " + toString(m_attempts[index].endpoint) + " [ " + ec.message() + " ]");
+    boost::system::error_code ignored;
+    m_attempts[index].socket->close(ignored);
+    m_lastError = ec;
+    if (m_next < m_attempts.size()) {
+        // Don't wait for the stagger when the previous attempt failed already
+        m_staggerTimer.cancel();
+        launch();
+    } else if (m_pending == 0) {
+        finish(ec, m_attempts.size());
+    }
+}
+
+void ConnectRace::onStagger(const boost::system::error_code& ec)
+{
+    if (!ec) {
+        launch();
+    }
+}
+
+void ConnectRace::onTimeout(const boost::system::error_code& ec)
+{
+    if (!ec && !m_done) {
+        cwarn << "Timeout connecting after " << m_timeout.count() << " ms";
+        finish(boost::asio::error::timed_out, m_attempts.size());
+    }
+}
+
+void ConnectRace::finish(const boost::system::error_code& ec, std::size_t index)
+{
+    if (m_done) {
+        return;
+    }
+    m_done = true;
+    m_staggerTimer.cancel();
+    m_timeoutTimer.cancel();
+
+    // Close the losers, their handlers see the race done
+    for (std::size_t i = 0; i < m_attempts.size(); ++i) {
+        if (i != index && m_attempts[i].socket) {
+            boost::system::error_code ignored;
+            m_attempts[i].socket->close(ignored);
+        }
+    }
+
+    Handler handler;
+    handler.swap(m_handler);
+    if (!handler) {
+        return;
+    }
+    if (index < m_attempts.size()) {
+        handler(ec, m_attempts[index].socket, m_attempts[index].endpoint);
+    } else {
+        handler(ec ? ec : m_lastError, nullptr, Endpoint());
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+/**
+ * @brief Connects to the first reachable of several addresses (RFC 8305 "happy eyeballs").
+ *
+ * Attempts start in the order of the addresses, each one c_stagger after the previous or as soon
+ * as the previous failed, and run in parallel. The first established connection wins, the others
+ * are closed. All handlers run on the strand passed in, the race keeps itself alive until it
+ * completed, so the owner may drop it any time after calling start().
+ */
+class ConnectRace : public std::enable_shared_from_this<ConnectRace>
+{
+public:
+    using Endpoint = boost::asio::ip::tcp::endpoint;
+    using Socket = boost::asio::ip::tcp::socket;
+    /// Gets the connected socket and its address, or the last error and a null socket
+    using Handler = std::function<void(const boost::system::error_code&, std::shared_ptr<Socket>, const Endpoint&)>;
+
+    /// Delay before starting the next attempt while the previous ones are still pending
+    static const unsigned c_staggerMs = 250;
+
+    ConnectRace(boost::asio::io_service& io_service, boost::asio::io_service::strand& strand,
+                const std::vector<Endpoint>& endpoints, std::chrono::milliseconds timeout);
+
+    void start(const Handler& handler);
+    /// Abandons the race, the handler is not called anymore
+    void cancel();
+
+private:
+    struct Attempt
+    {
+        Endpoint endpoint;
+        std::shared_ptr<Socket> socket;
+    };
+
+    void abandon();
+    void launch();
+    void onConnect(std::size_t index, const boost::system::error_code& ec);
+    void onStagger(const boost::system::error_code& ec);
+    void onTimeout(const boost::system::error_code& ec);
+    void finish(const boost::system::error_code& ec, std::size_t index);
+
+    boost::asio::io_service& m_io_service;
+    boost::asio::io_service::strand& m_io_strand;
+    boost::asio::deadline_timer m_staggerTimer;
+    boost::asio::deadline_timer m_timeoutTimer;
+    std::chrono::milliseconds m_timeout;
+
+    std::vector<Attempt> m_attempts;
+    std::size_t m_next = 0;
+    unsigned m_pending = 0;
+    bool m_done = false;
+    boost::system::error_code m_lastError;
+    Handler m_handler;
+};
@@ -0,0 +1,101 @@
+#include "EndpointCache.h"
+
+#include <algorithm>
+
+EndpointCache& EndpointCache::instance()
+{
+    static EndpointCache cache;
+    return cache;
+}
+
+std::string EndpointCache::key(const std::string& host, unsigned short port)
+{
+    return host + ":" + std::to_string(port);
+}
+
+bool EndpointCache::lookup(const std::string& host, unsigned short port, std::vector<Endpoint>& endpoints)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(key(host, port));
+    if (it == m_entries.end() || it->second.endpoints.empty() || Clock::now() >= it->second.expires) {
+        return false;
+    }
+    Entry const& entry = it->second;
+
+    endpoints.clear();
+    endpoints.reserve(entry.endpoints.size());
+    if (entry.hasGood) {
+        endpoints.push_back(entry.good);
+    }
+    // Alternate the families, starting with the one of the preferred address if any
+    std::vector<Endpoint> v6, v4;
+    for (auto const& endpoint : entry.endpoints) {
+        if (entry.hasGood && endpoint == entry.good) {
+            continue;
+        }
+        (endpoint.address().is_v6() ? v6 : v4).push_back(endpoint);
+    }
+    bool v6First = entry.hasGood ? !entry.good.address().is_v6() : !v6.empty();
+    auto i6 = v6.begin();
+    auto i4 = v4.begin();
+    while (i6 != v6.end() || i4 != v4.end()) {
+        if ((v6First && i6 != v6.end()) || i4 == v4.end()) {
+            endpoints.push_back(*i6++);
+        } else {
+            endpoints.push_back(*i4++);
+        }
+        v6First = !v6First;
+    }
+    return true;
+}
+
+void EndpointCache::store(const std::string& host, unsigned short port, const std::vector<Endpoint>& endpoints)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Entry& entry = m_entries[key(host, port)];
+    entry.endpoints.clear();
+    for (auto const& endpoint : endpoints) {
+        if (std::find(entry.endpoints.begin(), entry.endpoints.end(), endpoint) == entry.endpoints.end()) {
+            entry.endpoints.push_back(endpoint);
+        }
+    }
+    if (entry.hasGood && std::find(entry.endpoints.begin(), entry.endpoints.end(), entry.good) == entry.endpoints.end()) {
+        entry.hasGood = false;
+    }
+    entry.expires = Clock::now() + m_ttl;
+}
+
+void EndpointCache::succeeded(const std::string& host, unsigned short port, const Endpoint& endpoint)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(key(host, port));
+    if (it != m_entries.end()) {
+        it->second.good = endpoint;
+        it->second.hasGood = true;
+    }
+}
+
+void EndpointCache::failed(const std::string& host, unsigned short port, const Endpoint& endpoint)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(key(host, port));
+    if (it != m_entries.end() && it->second.hasGood && it->second.good == endpoint) {
+        it->second.hasGood = false;
+    }
+}
+
+void EndpointCache::invalidate(const std::string& host, unsigned short port)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(key(host, port));
+    if (it != m_entries.end()) {
+        // Keep the known good address for when the host resolves again
+        it->second.expires = Clock::time_point();
+    }
+}
+
+void EndpointCache::setTtl(std::chrono::seconds ttl)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_ttl = ttl;
+}
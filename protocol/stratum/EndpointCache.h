@@ -0,0 +1,53 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/asio/ip/tcp.hpp>
+
+/**
+ * @brief Resolved addresses of the pool hosts, shared by all clients.
+ *
+ * The resolver does not report the record TTL, entries are kept for a fixed time instead.
+ * Addresses are handed out with the last one a connection succeeded to first, followed by the
+ * others alternating between IPv6 and IPv4 so a connection race tries both families early.
+ */
+class EndpointCache
+{
+public:
+    using Endpoint = boost::asio::ip::tcp::endpoint;
+    using Clock = std::chrono::steady_clock;
+
+    static EndpointCache& instance();
+
+    /// Fills endpoints with the cached addresses of host, false if there are none or they expired
+    bool lookup(const std::string& host, unsigned short port, std::vector<Endpoint>& endpoints);
+    /// Replaces the addresses of host, the known good one is kept if it is still among them
+    void store(const std::string& host, unsigned short port, const std::vector<Endpoint>& endpoints);
+
+    void succeeded(const std::string& host, unsigned short port, const Endpoint& endpoint);
+    void failed(const std::string& host, unsigned short port, const Endpoint& endpoint);
+    void invalidate(const std::string& host, unsigned short port);
+
+    void setTtl(std::chrono::seconds ttl);
+
+private:
+    EndpointCache() = default;
+
+    struct Entry
+    {
+        std::vector<Endpoint> endpoints;
+        Endpoint good;
+        bool hasGood = false;
+        Clock::time_point expires;
+    };
+
+    static std::string key(const std::string& host, unsigned short port);
+
+    std::mutex m_mutex;
+    std::map<std::string, Entry> m_entries;
+    std::chrono::seconds m_ttl{300};
+};
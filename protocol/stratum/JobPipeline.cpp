@@ -0,0 +1,195 @@
+#include "JobPipeline.h"
+
+#include <algorithm>
+
+#include <common/Log.h>
+#include <common/Trace.h>
+#include <nrgcore/telemetry.h>
+
+using namespace energi;
+
+const std::size_t JobPipeline::c_minChunk;
+const unsigned JobPipeline::c_maxThreads;
+
+JobPipeline::JobPipeline()
+{
+    unsigned const threads = std::max(1u, std::min(std::thread::hardware_concurrency(), c_maxThreads));
+    for (unsigned i = 1; i < threads; ++i) {
+        m_helpers.emplace_back(&JobPipeline::help, this);
+    }
+    m_thread = std::thread(&JobPipeline::run, this);
+}
+
+JobPipeline::~JobPipeline()
+{
+    m_stop.store(true, std::memory_order_relaxed);
+    m_generation++;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queued.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_taskMutex);
+        m_taskReady.notify_all();
+    }
+    m_thread.join();
+    for (auto& helper : m_helpers) {
+        helper.join();
+    }
+}
+
+void JobPipeline::submit(StratumJob& job, const std::string& extraNonce,
+                         const arith_uint256& target, int exSizeBits)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::swap(m_pending, job);
+        m_pendingExtraNonce = extraNonce;
+        m_pendingTarget = target;
+        m_pendingExSizeBits = exSizeBits;
+        m_pendingGeneration = ++m_generation;
+        m_pendingReceived = std::chrono::steady_clock::now();
+        m_hasPending = true;
+    }
+    m_queued.notify_one();
+}
+
+void JobPipeline::cancel()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_generation++;
+    m_hasPending = false;
+}
+
+void JobPipeline::run()
+{
+    using namespace std::chrono;
+    setThreadName("stratum");
+
+    StratumJob job;
+    std::string extraNonce;
+    arith_uint256 target;
+    int exSizeBits = -1;
+    uint64_t generation = 0;
+    steady_clock::time_point received;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_queued.wait(lock, [&]() { return m_stop.load(std::memory_order_relaxed) || m_hasPending; });
+            if (m_stop.load(std::memory_order_relaxed)) {
+                return;
+            }
+            std::swap(job, m_pending);
+            extraNonce.swap(m_pendingExtraNonce);
+            target = m_pendingTarget;
+            exSizeBits = m_pendingExSizeBits;
+            generation = m_pendingGeneration;
+            received = m_pendingReceived;
+            m_hasPending = false;
+        }
+
+        steady_clock::duration queued, decoding, preparing, publishing;
+        try {
+            // Decode stage
+            steady_clock::time_point const start = steady_clock::now();
+            Work work(job, extraNonce, false);
+            if (!decode(work, job, generation)) {
+                continue;
+            }
+            work.hashTarget = target;
+            work.exSizeBits = exSizeBits;
+            if (std::size_t const mismatched = work.rawTransactions ? work.rawTransactions->mismatchedTxids() : 0) {
+                cwarn << "Job " << job.jobName << ": " << mismatched
+                      << " txids sent by the pool don't match their transactions, using the hashed ones";
+            }
+            steady_clock::time_point const decoded = steady_clock::now();
+
+            // Prepare stage
+            work.prepareMerkleBranch();
+            steady_clock::time_point const prepared = steady_clock::now();
+            Trace::complete(Trace::c_workBuild, start, prepared, job.jobName);
+
+            // Publish stage, the handler takes the locks of the pool manager so none is held here
+            if (superseded(generation)) {
+                continue;
+            }
+            if (m_onPublish) {
+                m_onPublish(work);
+            }
+            steady_clock::time_point const published = steady_clock::now();
+
+            queued = start - received;
+            decoding = decoded - start;
+            preparing = prepared - decoded;
+            publishing = published - prepared;
+        } catch (const std::exception& ex) {
+            cwarn << "Discarding malformed job " << job.jobName << ": " << ex.what();
+            continue;
+        }
+
+        Telemetry& telemetry = Telemetry::instance();
+        telemetry.jobQueued.record(queued);
+        telemetry.jobDecode.record(decoding);
+        telemetry.jobPrepare.record(preparing);
+        telemetry.jobPublish.record(publishing);
+        if (g_logVerbosity >= 6) {
+            cnote << "Job " << job.jobName << " with " << job.transactions.size() << " transactions: queued "
+                  << duration_cast<microseconds>(queued).count() << " us, decoded "
+                  << duration_cast<microseconds>(decoding).count() << " us, prepared "
+                  << duration_cast<microseconds>(preparing).count() << " us, published "
+                  << duration_cast<microseconds>(publishing).count() << " us";
+        }
+    }
+}
+
+void JobPipeline::help()
+{
+    setThreadName("stratum");
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_taskMutex);
+            m_taskReady.wait(lock, [&]() { return m_stop.load(std::memory_order_relaxed) || !m_tasks.empty(); });
+            if (m_tasks.empty()) {
+                return;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+        {
+            std::lock_guard<std::mutex> lock(m_taskMutex);
+            if (--m_tasksLeft == 0) {
+                m_tasksDone.notify_all();
+            }
+        }
+    }
+}
+
+bool JobPipeline::decode(Work& work, const StratumJob& job, uint64_t generation)
+{
+    std::size_t const count = job.transactions.size();
+    std::size_t const chunks = std::min<std::size_t>(m_helpers.size() + 1, count / c_minChunk);
+    if (chunks <= 1) {
+        work.decodeTransactions(job, 0, count);
+        return !superseded(generation);
+    }
+
+    // The first chunk is decoded on this thread, the others by the helpers
+    std::size_t const step = (count + chunks - 1) / chunks;
+    {
+        std::lock_guard<std::mutex> lock(m_taskMutex);
+        for (std::size_t begin = step; begin < count; begin += step) {
+            std::size_t const end = std::min(begin + step, count);
+            m_tasks.emplace_back([&work, &job, begin, end]() { work.decodeTransactions(job, begin, end); });
+            m_tasksLeft++;
+        }
+    }
+    m_taskReady.notify_all();
+    work.decodeTransactions(job, 0, step);
+
+    std::unique_lock<std::mutex> lock(m_taskMutex);
+    m_tasksDone.wait(lock, [&]() { return m_tasksLeft == 0; });
+    return !superseded(generation);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <primitives/arith_uint256.h>
+#include <primitives/work.h>
+
+/**
+ * @brief Turns mining.notify jobs into Work off the io_service thread.
+ *
+ * A job passes three stages on the pipeline thread: decode (coinbase and transactions, the
+ * latter split over a small pool of helper threads), prepare (coinbase merkle branch and
+ * root) and publish (the onPublish handler, which hands the work to the plant). Only the
+ * newest job is kept: submitting a job or cancelling supersedes the one in flight, which is
+ * dropped at the next stage boundary and never published. The latency of each stage is
+ * recorded in the Telemetry histograms.
+ */
+class JobPipeline
+{
+public:
+    using Publish = std::function<void(energi::Work const&)>;
+
+    /// Fewest transactions worth handing to a helper thread as one chunk
+    static const std::size_t c_minChunk = 16;
+    /// Upper bound of the threads decoding a job
+    static const unsigned c_maxThreads = 4;
+
+    JobPipeline();
+    ~JobPipeline();
+
+    JobPipeline(const JobPipeline&) = delete;
+    JobPipeline& operator=(const JobPipeline&) = delete;
+
+    void onPublish(const Publish& handler)
+    {
+        m_onPublish = handler;
+    }
+
+    /**
+     * @brief Queues a job superseding any job not yet published.
+     * The contents of job are taken over, it is left with the buffers of a superseded job
+     * so the caller can reuse their capacity.
+     */
+    void submit(energi::StratumJob& job, const std::string& extraNonce,
+                const arith_uint256& target, int exSizeBits);
+
+    /**
+     * @brief Drops the queued and in flight jobs. It does not wait for a publication already
+     * under way, as the handler may need locks the caller holds.
+     */
+    void cancel();
+
+private:
+    void run();
+    void help();
+    bool decode(energi::Work& work, const energi::StratumJob& job, uint64_t generation);
+
+    bool superseded(uint64_t generation) const
+    {
+        return generation != m_generation.load(std::memory_order_relaxed);
+    }
+
+    Publish m_onPublish;
+
+    std::atomic<uint64_t> m_generation = {0};
+    std::atomic<bool> m_stop = {false};
+
+    // Job waiting for the pipeline thread
+    std::mutex m_mutex;
+    std::condition_variable m_queued;
+    bool m_hasPending = false;
+    energi::StratumJob m_pending;
+    std::string m_pendingExtraNonce;
+    arith_uint256 m_pendingTarget;
+    int m_pendingExSizeBits = -1;
+    uint64_t m_pendingGeneration = 0;
+    std::chrono::steady_clock::time_point m_pendingReceived;
+
+    // Decode chunks run by the helper threads
+    std::mutex m_taskMutex;
+    std::condition_variable m_taskReady;
+    std::condition_variable m_tasksDone;
+    std::deque<std::function<void()>> m_tasks;
+    unsigned m_tasksLeft = 0;
+
+    std::vector<std::thread> m_helpers;
+    std::thread m_thread;
+};
@@ -1,11 +1,11 @@
 #include "StratumClient.h"
+#include "EndpointCache.h"
+#include "TlsContext.h"
+#include "nrgcore/telemetry.h"
+#include "common/Trace.h"
 
 #include <energiminer/buildinfo.h>
 
-#ifdef _WIN32
-#include <wincrypt.h>
-#endif
-
 #define BOOST_ASIO_ENABLE_CANCELIO
 
 namespace {
@@ -31,6 +31,9 @@ void diffToTarget(uint32_t *target, double diff)
         ((uint8_t*)target)[i] = ((uint8_t*)target2)[i];
 }
 
+// Upper bounds in milliseconds of the share round trip histogram buckets, the last one is open
+const unsigned c_submitLatencyBounds[] = {25, 50, 100, 250, 500, 1000, 2500};
+
 }
 
 using boost::asio::ip::tcp;
@@ -46,7 +49,6 @@ StratumClient::StratumClient(boost::asio::io_service & io_service,
     , m_io_strand(io_service)
     , m_socket(nullptr)
     , m_workloop_timer(io_service)
-    , m_response_plea_times(64)
     , m_resolver(io_service)
     , m_endpoints()
     , m_submit_hashrate(submitHashrate)
@@ -55,7 +57,12 @@ StratumClient::StratumClient(boost::asio::io_service & io_service,
     m_workloop_timer.expires_at(boost::posix_time::pos_infin);
     m_workloop_timer.async_wait(m_io_strand.wrap(boost::bind(
                     &StratumClient::workloop_timer_elapsed, this, boost::asio::placeholders::error)));
-    clear_response_pleas();
+
+    m_pipeline.onPublish([this](const energi::Work& work) {
+        if (m_onWorkReceived) {
+            m_onWorkReceived(work);
+        }
+    });
 }
 
 StratumClient::~StratumClient()
@@ -68,52 +75,14 @@ void StratumClient::init_socket()
 {
     // Prepare Socket
     if (m_conn->SecLevel() != SecureLevel::NONE) {
-        boost::asio::ssl::context::method method = boost::asio::ssl::context::tls_client;
-        if (m_conn->SecLevel() == SecureLevel::TLS12) {
-            method = boost::asio::ssl::context::tlsv12;
-        }
-
-        boost::asio::ssl::context ctx(method);
+        // The context outlives the connection, it carries the session to resume
+        TlsContextCache& tls = TlsContextCache::instance();
         m_securesocket = std::make_shared<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>>(
-            m_io_service, ctx);
+            m_io_service, tls.context(*m_conn));
         m_socket = &m_securesocket->next_layer();
 
-
         m_securesocket->set_verify_mode(boost::asio::ssl::verify_peer);
-
-#ifdef _WIN32
-        HCERTSTORE hStore = CertOpenSystemStore(0, "ROOT");
-        if (hStore == nullptr) {
-            return;
-        }
-
-        X509_STORE* store = X509_STORE_new();
-        PCCERT_CONTEXT pContext = nullptr;
-        while ((pContext = CertEnumCertificatesInStore(hStore, pContext)) != nullptr) {
-            X509* x509 = d2i_X509(
-                nullptr, (const unsigned char**)&pContext->pbCertEncoded, pContext->cbCertEncoded);
-            if (x509 != nullptr) {
-                X509_STORE_add_cert(store, x509);
-                X509_free(x509);
-            }
-        }
-
-        CertFreeCertificateContext(pContext);
-        CertCloseStore(hStore, 0);
-
-        SSL_CTX_set_cert_store(ctx.native_handle(), store);
-#else
-        char* certPath = getenv("SSL_CERT_FILE");
-        try {
-            ctx.load_verify_file(certPath ? certPath : "/etc/ssl/certs/ca-certificates.crt");
-        } catch (...) {
-            cwarn << "Failed to load ca certificates. Either the file "
-                     "'/etc/ssl/certs/ca-certificates.crt' does not exist";
-            cwarn << "or the environment variable SSL_CERT_FILE is set to an invalid or "
-                     "inaccessible file.";
-            cwarn << "It is possible that certificate verification can fail.";
-        }
-#endif
+        tls.prepare(m_securesocket->native_handle(), *m_conn);
     } else {
         m_nonsecuresocket = std::make_shared<boost::asio::ip::tcp::socket>(m_io_service);
         m_socket = m_nonsecuresocket.get();
@@ -167,12 +136,15 @@ void StratumClient::connect()
     if (!m_socket)
         init_socket();
 
-    // Begin resolve all ips associated to hostname
-    // empty queue from any previous listed ip
-    // calling the resolver each time is useful as most
-    // load balancer will give Ips in different order
-    m_endpoints = std::queue<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>>();
+    // Reuse the addresses resolved recently, the one connected to last comes first
+    m_endpoints.clear();
     m_endpoint = boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>();
+    if (EndpointCache::instance().lookup(m_conn->Host(), m_conn->Port(), m_endpoints)) {
+        m_io_service.post(m_io_strand.wrap(boost::bind(&StratumClient::start_connect, this)));
+        return;
+    }
+
+    // Begin resolve all ips associated to hostname
     m_resolver = tcp::resolver(m_io_service);
     tcp::resolver::query q(m_conn->Host(), toString(m_conn->Port()));
 
@@ -202,7 +174,7 @@ void StratumClient::disconnect()
                 // As there may be a connection issue we also endorse a timeout
                 m_securesocket->async_shutdown(m_io_strand.wrap(boost::bind(&StratumClient::onSSLShutdownCompleted, this, boost::asio::placeholders::error)));
 
-                enqueue_response_plea();
+                m_shutdownStarted = std::chrono::steady_clock::now();
                 // Rest of disconnection is performed asynchronously
                 return;
             } else {
@@ -260,9 +232,10 @@ void StratumClient::disconnect_finalize()
             }
         }
     }
-    // Clear plea queue and stop timing
-    std::chrono::steady_clock::time_point m_response_plea_time;
-    clear_response_pleas();
+    // Jobs of this connection still being decoded are void
+    m_pipeline.cancel();
+    logSubmitLatency();
+    clearRequests();
     // Put the actor back to sleep
     m_workloop_timer.expires_at(boost::posix_time::pos_infin);
     m_workloop_timer.async_wait(m_io_strand.wrap(boost::bind(
@@ -279,11 +252,16 @@ void StratumClient::resolve_handler(const boost::system::error_code& ec, tcp::re
     setThreadName("stratum");
     if (!ec) {
         // Start Connection Process and set timeout timer
+        std::vector<tcp::endpoint> endpoints;
         while (i != tcp::resolver::iterator()) {
-            m_endpoints.push(i->endpoint());
+            endpoints.push_back(i->endpoint());
             ++i;
         }
         m_resolver.cancel();
+        EndpointCache::instance().store(m_conn->Host(), m_conn->Port(), endpoints);
+        if (!EndpointCache::instance().lookup(m_conn->Host(), m_conn->Port(), m_endpoints)) {
+            m_endpoints = endpoints;
+        }
         // Resolver has finished so invoke connection asynchronously
         m_io_service.post(m_io_strand.wrap(boost::bind(&StratumClient::start_connect, this)));
     } else {
@@ -305,34 +283,25 @@ void StratumClient::start_connect()
     m_connecting.store(true, std::memory_order::memory_order_relaxed);
 
     if (!m_endpoints.empty()) {
-        // Pick the first endpoint in list.
-        // Eventually endpoints get discarded on connection errors
-        m_endpoint = m_endpoints.front();
-
         // Re-init socket if we need to
         if (m_socket == nullptr)
             init_socket();
 
         setThreadName("stratum");
         if (g_logVerbosity >= 6)
-            cnote << ("Trying " + toString(m_endpoint) + " ...");
-
-        clear_response_pleas();
-//        m_conntimer.expires_from_now(boost::posix_time::seconds(m_responsetimeout));
-//        m_conntimer.async_wait(m_io_strand.wrap(boost::bind(
-//                        &StratumClient::check_connect_timeout, this, boost::asio::placeholders::error)));
+            cnote << "Connecting to " << m_endpoints.size() << " addresses of " << m_conn->Host();
 
-        m_connecting.store(true, std::memory_order::memory_order_relaxed);
-        enqueue_response_plea();
+        clearRequests();
 
-        // Start connecting async
-        if (m_conn->SecLevel() != SecureLevel::NONE) {
-            m_securesocket->lowest_layer().async_connect(m_endpoint,
-                    m_io_strand.wrap(boost::bind(&StratumClient::connect_handler, this, _1)));
-        } else {
-            m_socket->async_connect(m_endpoint,
-                    m_io_strand.wrap(boost::bind(&StratumClient::connect_handler, this, _1)));
+        // Race the addresses, the first one to accept the connection wins.
+        // The race enforces the connection timeout itself
+        if (m_race) {
+            m_race->cancel();
         }
+        m_connectStarted = std::chrono::steady_clock::now();
+        m_race = std::make_shared<ConnectRace>(m_io_service, m_io_strand, m_endpoints,
+                std::chrono::milliseconds(m_responsetimeout * 1000));
+        m_race->start(boost::bind(&StratumClient::connect_handler, this, _1, _2, _3));
     } else {
         setThreadName("stratum");
         m_connecting.store(false, std::memory_order_relaxed);
@@ -350,76 +319,31 @@ void StratumClient::workloop_timer_elapsed(const boost::system::error_code& ec)
     // On timer cancelled or nothing to check for then early exit
     if (ec == boost::asio::error::operation_aborted)
         return;
-    // Check whether the deadline has passed. We compare the deadline against
-    // the current time since a new asynchronous operation may have moved the
-    // deadline before this actor had a chance to run.
-    if (m_response_pleas_count.load(std::memory_order_relaxed)) {
-        milliseconds response_delay_ms(0);
-        steady_clock::time_point m_response_plea_time(m_response_plea_older.load(std::memory_order_relaxed));
-
-        // Check responses while in connection/disconnection phase
-        if (isPendingState()) {
-            response_delay_ms =
-                duration_cast<milliseconds>(steady_clock::now() - m_response_plea_time);
-            if ((m_responsetimeout * 1000) >= response_delay_ms.count()) {
-                if (m_connecting.load(std::memory_order_relaxed)) {
-                    // The socket is closed so that any outstanding
-                    // asynchronous connection operations are cancelled.
-                    m_socket->close();
-                    return;
-                }
-                // This is set for SSL disconnection
-                if (m_disconnecting.load(std::memory_order_relaxed) &&
-                        (m_conn->SecLevel() != SecureLevel::NONE)) {
-                    if (m_securesocket->lowest_layer().is_open()) {
-                        m_securesocket->lowest_layer().close();
-                        return;
-                    }
-                }
-            }
-		}
-        if (isConnected()) {
-            response_delay_ms =
-                duration_cast<milliseconds>(steady_clock::now() - m_response_plea_time);
-
-            if (response_delay_ms.count() >= (m_responsetimeout * 1000)) {
-                if (m_conn->StratumModeConfirmed() == false && m_conn->IsUnrecoverable() == false) {
-                    // Waiting for a response from pool to a login request
-                    // Async self send a fake error response
-                    Json::Value jRes;
-                    jRes["id"] = unsigned(1);
-                    jRes["result"] = Json::nullValue;
-                    jRes["error"] = true;
-                    clear_response_pleas();
-                    m_io_service.post(m_io_strand.wrap(
-                                boost::bind(&StratumClient::processResponse, this, jRes)));
-                } else {
-                    // Waiting for a response to solution submission
-                    setThreadName("stratum");
-                    cwarn << "No response received in " << m_responsetimeout << " seconds.";
-                    m_endpoints.pop();
-                    m_subscribed.store(false, std::memory_order_relaxed);
-                    m_authorized.store(false, std::memory_order_relaxed);
-                    clear_response_pleas();
-                    m_io_service.post(
-                            m_io_strand.wrap(boost::bind(&StratumClient::disconnect, this)));
-                }
 
-            }
-             // Check how old is last job received
-            if (duration_cast<seconds>(steady_clock::now() - m_current_timestamp).count() >
-                m_worktimeout) {
-                setThreadName("stratum");
-                cwarn << "No new work received in " << m_worktimeout << " seconds.";
-                m_endpoints.pop();
-                m_subscribed.store(false, std::memory_order_relaxed);
-                m_authorized.store(false, std::memory_order_relaxed);
-                clear_response_pleas();
-                m_io_service.post(
-                    m_io_strand.wrap(boost::bind(&StratumClient::disconnect, this)));
-            }
+    // A pool not answering the close_notify does not hold the disconnection up
+    if (m_disconnecting.load(std::memory_order_relaxed) && m_conn->SecLevel() != SecureLevel::NONE &&
+            duration_cast<seconds>(steady_clock::now() - m_shutdownStarted).count() >= m_responsetimeout) {
+        if (m_securesocket && m_securesocket->lowest_layer().is_open()) {
+            m_securesocket->lowest_layer().close();
+            return;
         }
-	}
+    }
+
+    // Requests time out one by one
+    if (isConnected() && expireRequests()) {
+        // Check how old is last job received, while the pool owes us an answer
+        if (duration_cast<seconds>(steady_clock::now() - m_current_timestamp).count() > m_worktimeout) {
+            setThreadName("stratum");
+            cwarn << "No new work received in " << m_worktimeout << " seconds.";
+            EndpointCache::instance().failed(m_conn->Host(), m_conn->Port(), m_endpoint);
+            m_subscribed.store(false, std::memory_order_relaxed);
+            m_authorized.store(false, std::memory_order_relaxed);
+            clearRequests();
+            m_io_service.post(
+                m_io_strand.wrap(boost::bind(&StratumClient::disconnect, this)));
+        }
+    }
+
     // Resubmit timing operations
     m_workloop_timer.expires_from_now(boost::posix_time::milliseconds(m_workloop_interval));
     m_workloop_timer.async_wait(m_io_strand.wrap(boost::bind(
@@ -427,83 +351,113 @@ void StratumClient::workloop_timer_elapsed(const boost::system::error_code& ec)
 
 }
 
-void StratumClient::connect_handler(const boost::system::error_code& ec)
+void StratumClient::connect_handler(const boost::system::error_code& ec, std::shared_ptr<tcp::socket> socket,
+                                    const tcp::endpoint& endpoint)
 {
     setThreadName("stratum");
-    // Set status completion
-    m_connecting.store(false, std::memory_order_relaxed);
-
-    // Timeout has run before or we got error
-    if (ec || !m_socket->is_open()) {
-        cwarn << ("Error  " + toString(m_endpoint) + " [ " + (ec ? ec.message() : "Timeout") +
-                  " ]");
-
-        // We need to close the socket used in the previous connection attempt
-        // before starting a new one.
-        // In case of error, in fact, boost does not close the socket
-        // If socket is not opened it means we got timed out
-        if (m_socket->is_open()) {
-            m_socket->close();
-        }
+    m_race.reset();
 
-        // Discard this endpoint and try the next available.
-        // Eventually is start_connect which will check for an
-        // empty list.
-        m_endpoints.pop();
+    // Every address failed or timed out
+    if (ec || !socket) {
+        m_connecting.store(false, std::memory_order_relaxed);
         m_canconnect.store(false, std::memory_order_relaxed);
-        m_io_service.post(m_io_strand.wrap(boost::bind(&StratumClient::start_connect, this)));
-
+        cwarn << "No more Ip addresses to try for host: " << m_conn->Host();
+        // Resolve again on the next attempt, the addresses may have moved
+        EndpointCache::instance().invalidate(m_conn->Host(), m_conn->Port());
+        // Trigger handlers
+        if (m_onDisconnected) {
+            m_onDisconnected();
+        }
         return;
     }
 
+    // Take over the winning connection
+    if (m_socket == nullptr)
+        init_socket();
+    *m_socket = std::move(*socket);
+    m_endpoint = endpoint;
+    EndpointCache::instance().succeeded(m_conn->Host(), m_conn->Port(), endpoint);
+
     // We got a socket connection established
+    using namespace std::chrono;
     m_canconnect.store(true, std::memory_order_relaxed);
-    cnote << "Socket connected to: " << ActiveEndPoint();
+    cnote << "Socket connected to: " << ActiveEndPoint() << " in "
+          << duration_cast<milliseconds>(steady_clock::now() - m_connectStarted).count() << " ms";
     if (m_conn->SecLevel() != SecureLevel::NONE) {
-        boost::system::error_code hec;
         m_securesocket->lowest_layer().set_option(boost::asio::socket_base::keep_alive(true));
         m_securesocket->lowest_layer().set_option(tcp::no_delay(true));
 
-        m_securesocket->handshake(boost::asio::ssl::stream_base::client, hec);
-
-        if (hec) {
-            cwarn << "SSL/TLS Handshake failed: " << hec.message();
-            if (hec.value() == 337047686) {  // certificate verification failed
-                cwarn << "This can have multiple reasons:";
-                cwarn << "* Root certs are either not installed or not found";
-                cwarn << "* Pool uses a self-signed certificate";
-                cwarn << "Possible fixes:";
-                cwarn << "* Make sure the file '/etc/ssl/certs/ca-certificates.crt' exists and "
-                         "is accessible";
-                cwarn << "* Export the correct path via 'export "
-                         "SSL_CERT_FILE=/etc/ssl/certs/ca-certificates.crt' to the correct "
-                         "file";
-                cwarn << "  On most systems you can install the 'ca-certificates' package";
-                cwarn << "  You can also get the latest file here: "
-                         "https://curl.haxx.se/docs/caextract.html";
-                cwarn << "* Disable certificate verification all-together via command-line "
-                         "option.";
-            }
+        // Stays in connecting state until the handshake is done
+        m_handshakeStarted = steady_clock::now();
+        m_securesocket->async_handshake(boost::asio::ssl::stream_base::client,
+                m_io_strand.wrap(boost::bind(&StratumClient::handshake_handler, this, boost::asio::placeholders::error)));
+        return;
+    }
+    m_nonsecuresocket->set_option(boost::asio::socket_base::keep_alive(true));
+    m_nonsecuresocket->set_option(tcp::no_delay(true));
 
-            // This is a fatal error
-            // No need to try other IPs as the certificate is based on host-name
-            // not ip address. Trying other IPs would end up with the very same error.
-            m_canconnect.store(false, std::memory_order_relaxed);
-            m_conn->MarkUnrecoverable();
-            m_io_service.post(m_io_strand.wrap(boost::bind(&StratumClient::disconnect, this)));
-            return;
+    // Set status completion
+    m_connecting.store(false, std::memory_order_relaxed);
+    start_session();
+}
+
+void StratumClient::handshake_handler(const boost::system::error_code& hec)
+{
+    using namespace std::chrono;
+    setThreadName("stratum");
+    m_connecting.store(false, std::memory_order_relaxed);
+
+    if (hec) {
+        cwarn << "SSL/TLS Handshake failed: " << hec.message();
+        if (hec.value() == 337047686) {  // certificate verification failed
+            cwarn << "This can have multiple reasons:";
+            cwarn << "* Root certs are either not installed or not found";
+            cwarn << "* Pool uses a self-signed certificate";
+            cwarn << "Possible fixes:";
+            cwarn << "* Make sure the file '/etc/ssl/certs/ca-certificates.crt' exists and "
+                     "is accessible";
+            cwarn << "* Export the correct path via 'export "
+                     "SSL_CERT_FILE=/etc/ssl/certs/ca-certificates.crt' to the correct "
+                     "file";
+            cwarn << "  On most systems you can install the 'ca-certificates' package";
+            cwarn << "  You can also get the latest file here: "
+                     "https://curl.haxx.se/docs/caextract.html";
+            cwarn << "* Disable certificate verification all-together via command-line "
+                     "option.";
         }
-    } else {
-        m_nonsecuresocket->set_option(boost::asio::socket_base::keep_alive(true));
-        m_nonsecuresocket->set_option(tcp::no_delay(true));
+
+        // This is a fatal error
+        // No need to try other IPs as the certificate is based on host-name
+        // not ip address. Trying other IPs would end up with the very same error.
+        m_canconnect.store(false, std::memory_order_relaxed);
+        m_conn->MarkUnrecoverable();
+        TlsContextCache::instance().forget(*m_conn);
+        // The stream can't be used for another handshake
+        boost::system::error_code ec;
+        m_securesocket->lowest_layer().close(ec);
+        m_securesocket = nullptr;
+        m_socket = nullptr;
+        if (m_onDisconnected) {
+            m_onDisconnected();
+        }
+        return;
     }
 
+    bool const resumed = SSL_session_reused(m_securesocket->native_handle());
+    cnote << "TLS handshake " << (resumed ? "resumed session" : "completed") << " in "
+          << duration_cast<milliseconds>(steady_clock::now() - m_handshakeStarted).count() << " ms";
+    start_session();
+}
+
+void StratumClient::start_session()
+{
     // Here is where we're properly connected
     m_connected.store(true, std::memory_order_relaxed);
 
     // Clean buffer from any previous stale data
     m_sendBuffer.consume(4096);
-    clear_response_pleas();
+    clearRequests();
+    m_lastReceived = std::chrono::steady_clock::now();
 
     // Trigger event handlers and begin counting for the next job
     //reset_work_timeout();
@@ -576,6 +530,7 @@ void StratumClient::connect_handler(const boost::system::error_code& ec)
        +        if no response within that time consider the tentative login failed
        +        and switch to next stratum mode test
        +        */
+    expectResponse(1);
     sendSocketData(jReq);
 }
 
@@ -617,6 +572,189 @@ void StratumClient::processExtranonce(std::string& enonce)
     m_extraNonce = enonce;
 }
 
+void StratumClient::processNotify(energi::StratumJob& job)
+{
+    if (job.coinbase1.empty() || job.coinbase2.empty()) {
+        return;
+    }
+
+    bool resetJob = !job.cleanJobs;
+
+    // Work compares by previous block and height, both are known before decoding the job
+    uint256 const prevHash = uint256S(job.prevHash);
+    if (resetJob || m_current.hashPrevBlock != prevHash || m_current.nHeight != job.height) {
+        if (resetJob) {
+            // Jobs queued before the reset are dropped
+            m_pipeline.cancel();
+            if (m_onResetWork) {
+                m_onResetWork();
+            }
+        }
+        m_current.reset();
+        m_current.hashPrevBlock = prevHash;
+        m_current.nHeight = job.height;
+        m_current_timestamp = std::chrono::steady_clock::now();
+        Trace::complete(Trace::c_notify, m_lastReceived, m_current_timestamp, job.jobName);
+        m_pipeline.submit(job, m_extraNonce, m_nextWorkTarget, m_extraNonceHexSize * 4);
+    }
+}
+
+void StratumClient::processDifficulty(double difficulty)
+{
+    double nextWorkDifficulty = std::max(difficulty, 0.0001);
+    cnote << "Difficulty set to: "  << nextWorkDifficulty;
+    diffToTarget((uint32_t*)m_nextWorkTarget.data(), nextWorkDifficulty);
+    m_current.reset();
+}
+
+void StratumClient::processSubmitResult(unsigned id, bool isSuccess, const std::string& errReason)
+{
+    using namespace std::chrono;
+    Request submission;
+    milliseconds response_delay_ms(0);
+    {
+        std::lock_guard<std::mutex> lock(m_requestsMutex);
+        auto found = m_requests.find(id);
+        if (found == m_requests.end()) {
+            cnote << "Got response for unknown or expired share [" << id << "] Discarding ...";
+            return;
+        }
+        submission = std::move(found->second);
+        m_requests.erase(found);
+        response_delay_ms = duration_cast<milliseconds>(steady_clock::now() - submission.sent);
+        unsigned bucket = 0;
+        while (bucket < 7 && unsigned(response_delay_ms.count()) > c_submitLatencyBounds[bucket]) {
+            ++bucket;
+        }
+        m_submitLatency[bucket]++;
+    }
+    if (DeviceTelemetry* device = Telemetry::instance().find(submission.miner)) {
+        device->submitRtt.record(response_delay_ms);
+        if (isSuccess) {
+            device->shareAccepted(false);
+        } else {
+            device->shareRejected();
+        }
+    }
+    if (g_logVerbosity >= 6) {
+        cnote << "Share [" << id << "] of " << submission.miner << " job " << submission.job << " nonce "
+              << submission.nonce << " sent "
+              << duration_cast<microseconds>(submission.sent - submission.found).count()
+              << " us after it was found," << (isSuccess ? " accepted" : " rejected") << " after "
+              << response_delay_ms.count() << " ms";
+    }
+
+    if (isSuccess) {
+        if (m_onSolutionAccepted) {
+            m_onSolutionAccepted(false, response_delay_ms);
+        }
+    } else {
+        if (m_onSolutionRejected) {
+            if (!errReason.empty()) {
+                cwarn << "Reject reason: " << (errReason.empty() ? "Unspecified" : errReason);
+            }
+            m_onSolutionRejected(true, response_delay_ms);
+        }
+    }
+}
+
+void StratumClient::expectResponse(unsigned id)
+{
+    std::lock_guard<std::mutex> lock(m_requestsMutex);
+    m_requests[id].sent = std::chrono::steady_clock::now();
+}
+
+void StratumClient::answered(unsigned id)
+{
+    std::lock_guard<std::mutex> lock(m_requestsMutex);
+    m_requests.erase(id);
+}
+
+void StratumClient::clearRequests()
+{
+    std::lock_guard<std::mutex> lock(m_requestsMutex);
+    m_requests.clear();
+}
+
+bool StratumClient::expireRequests()
+{
+    using namespace std::chrono;
+    steady_clock::time_point const now = steady_clock::now();
+    steady_clock::time_point oldest = now;
+    bool handshakeExpired = false;
+    bool waiting = false;
+    {
+        std::lock_guard<std::mutex> lock(m_requestsMutex);
+        for (auto it = m_requests.begin(); it != m_requests.end();) {
+            if (duration_cast<seconds>(now - it->second.sent).count() < m_responsetimeout) {
+                ++it;
+                continue;
+            }
+            if (it->first < c_firstSubmitId) {
+                handshakeExpired = true;
+            } else {
+                cwarn << "No response to share [" << it->first << "] of " << it->second.miner
+                      << " nonce " << it->second.nonce << " in " << m_responsetimeout << " seconds.";
+                oldest = std::min(oldest, it->second.sent);
+            }
+            it = m_requests.erase(it);
+        }
+        waiting = !m_requests.empty();
+    }
+
+    if (handshakeExpired && !m_conn->StratumModeConfirmed() && !m_conn->IsUnrecoverable()) {
+        // Waiting for a response from pool to a login request
+        // Async self send a fake error response
+        Json::Value jRes;
+        jRes["id"] = unsigned(1);
+        jRes["result"] = Json::nullValue;
+        jRes["error"] = true;
+        clearRequests();
+        m_io_service.post(m_io_strand.wrap(boost::bind(&StratumClient::processResponse, this, jRes)));
+        return false;
+    }
+    // Single lost answers to shares are tolerated, a pool which went silent altogether is not
+    if (handshakeExpired || (oldest < now && m_lastReceived < oldest)) {
+        setThreadName("stratum");
+        if (handshakeExpired) {
+            cwarn << "No response received in " << m_responsetimeout << " seconds.";
+        } else {
+            cwarn << "Pool silent for " << duration_cast<seconds>(now - m_lastReceived).count() << " seconds.";
+        }
+        EndpointCache::instance().failed(m_conn->Host(), m_conn->Port(), m_endpoint);
+        m_subscribed.store(false, std::memory_order_relaxed);
+        m_authorized.store(false, std::memory_order_relaxed);
+        clearRequests();
+        m_io_service.post(m_io_strand.wrap(boost::bind(&StratumClient::disconnect, this)));
+        return false;
+    }
+    return waiting;
+}
+
+void StratumClient::logSubmitLatency()
+{
+    std::stringstream ss;
+    uint64_t total = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_requestsMutex);
+        for (unsigned i = 0; i < m_submitLatency.size(); ++i) {
+            total += m_submitLatency[i];
+            if (i < 7) {
+                ss << " <=" << c_submitLatencyBounds[i] << "ms:" << m_submitLatency[i];
+            } else {
+                ss << " >" << c_submitLatencyBounds[6] << "ms:" << m_submitLatency[i];
+            }
+        }
+        auto const shares = m_requests.lower_bound(c_firstSubmitId);
+        if (shares != m_requests.end()) {
+            cnote << std::distance(shares, m_requests.end()) << " shares left unanswered";
+        }
+    }
+    if (total) {
+        cnote << "Share round trips:" << ss.str();
+    }
+}
+
 void StratumClient::processResponse(Json::Value& responseObject)
 {
     setThreadName("stratum");
@@ -663,11 +801,10 @@ void StratumClient::processResponse(Json::Value& responseObject)
     if (!_isNotification) {
         Json::Value jReq;
         Json::Value jResult = responseObject.get("result", Json::Value::null);
-        std::chrono::milliseconds response_delay_ms(0);
 
         switch (_id) {
         case 1:
-            response_delay_ms = dequeue_response_plea();
+            answered(1);
             /*
                This is the response to very first message after connection.
                I wish I could manage to have different Ids but apparently ethermine.org always replies
@@ -727,7 +864,7 @@ void StratumClient::processResponse(Json::Value& responseObject)
                     jReq["params"] = Json::Value(Json::arrayValue);
                     jReq["params"].append(m_conn->User() + m_conn->Path());
                     jReq["params"].append(m_conn->Pass());
-                    enqueue_response_plea();
+                    expectResponse(3);
                 }
                 break;
             case StratumClient::NRGPROXY:
@@ -760,7 +897,7 @@ void StratumClient::processResponse(Json::Value& responseObject)
                     jReq["params"] = Json::Value(Json::arrayValue);
                     jReq["params"].append(m_conn->User() + m_conn->Path());
                     jReq["params"].append(m_conn->Pass());
-                    enqueue_response_plea();
+                    expectResponse(3);
                 }
                 break;
             case StratumClient::ENERGISTRATUM:
@@ -788,7 +925,7 @@ void StratumClient::processResponse(Json::Value& responseObject)
                     jReq["method"] = "mining.authorize";
                     jReq["params"].append(m_conn->User() + m_conn->Path());
                     jReq["params"].append(m_conn->Pass());
-                    enqueue_response_plea();
+                    expectResponse(3);
                 }
                 break;
             }
@@ -804,7 +941,7 @@ void StratumClient::processResponse(Json::Value& responseObject)
             // Nothing to do here.
             break;
         case 3:
-            response_delay_ms = dequeue_response_plea();
+            answered(3);
             // Response to "mining.authorize" (https://en.bitcoin.it/wiki/Stratum_mining_protocol#mining.authorize)
             // Result should be boolean, some pools also throw an error, so _isSuccess can be false
             // Due to this reevaluate _isSuccess
@@ -830,30 +967,6 @@ void StratumClient::processResponse(Json::Value& responseObject)
 
             }
             break;
-        case 4:
-            response_delay_ms = dequeue_response_plea();
-            // Response to solution submission mining.submit  (https://en.bitcoin.it/wiki/Stratum_mining_protocol#mining.submit)
-            // Result should be boolean, some pools also throw an error, so _isSuccess can be false
-            // Due to this reevaluate _isSucess
-            if (_isSuccess && jResult.isBool()) {
-                _isSuccess = jResult.asBool();
-            }
-            {
-                dequeue_response_plea();
-                if (_isSuccess) {
-                    if (m_onSolutionAccepted) {
-                        m_onSolutionAccepted(false, response_delay_ms);
-                    }
-                } else {
-                    if (m_onSolutionRejected) {
-                        if (!_errReason.empty()) {
-                            cwarn << "Reject reason: " << (_errReason.empty() ? "Unspecified" : _errReason);
-                        }
-                        m_onSolutionRejected(true, response_delay_ms);
-                    }
-                }
-            }
-            break;
         case 5:
 
             // This is the response we get on first get_work request issued
@@ -878,7 +991,7 @@ void StratumClient::processResponse(Json::Value& responseObject)
             // However it has been tested that ethermine.org responds with this id when error replying to
             // either mining.subscribe (1) or mining.authorize requests (3)
             // To properly handle this situation we need to rely on Subscribed/Authorized states
-            response_delay_ms = dequeue_response_plea();
+            answered(m_subscribed ? 3 : 1);
             if (!_isSuccess) {
                 if (!m_subscribed) {
                     // Subscription pending
@@ -894,6 +1007,16 @@ void StratumClient::processResponse(Json::Value& responseObject)
             };
             break;
         default:
+            if (unsigned(_id) >= c_firstSubmitId) {
+                // Response to solution submission mining.submit  (https://en.bitcoin.it/wiki/Stratum_mining_protocol#mining.submit)
+                // Result should be boolean, some pools also throw an error, so _isSuccess can be false
+                // Due to this reevaluate _isSucess
+                if (_isSuccess && jResult.isBool()) {
+                    _isSuccess = jResult.asBool();
+                }
+                processSubmitResult(unsigned(_id), _isSuccess, _errReason);
+                break;
+            }
             // Never sent message with such an Id. What is it ?
             cnote << "Got response for unknown message id [" << _id << "] Discarding ...";
             break;
@@ -909,31 +1032,14 @@ void StratumClient::processResponse(Json::Value& responseObject)
             if (jPrm.isArray()) {
                 if (!jPrm.get((Json::Value::ArrayIndex)2, "").asString().empty() &&
                     !jPrm.get((Json::Value::ArrayIndex)3, "").asString().empty()) {
-
-                    bool resetJob = !jPrm.get((Json::Value::ArrayIndex)8, "").asBool();
-
-                    auto work = energi::Work(jPrm, m_extraNonce, true);
-                    if (resetJob || m_current != work) {
-                        if (resetJob && m_onResetWork) {
-                            m_onResetWork();
-                        }
-                        m_current = work;
-                        m_current.hashTarget = m_nextWorkTarget;
-                        m_current.exSizeBits = m_extraNonceHexSize * 4;
-                        m_current_timestamp = std::chrono::steady_clock::now();
-                        if (m_onWorkReceived) {
-                            m_onWorkReceived(m_current);
-                        }
-                    }
+                    energi::StratumJob job(jPrm);
+                    processNotify(job);
                 }
             }
         } else if (_method == "mining.set_difficulty") {
             jPrm = responseObject.get("params", Json::Value::null);
             if (jPrm.isArray()) {
-                double nextWorkDifficulty = std::max(jPrm.get((Json::Value::ArrayIndex)0, 1).asDouble(), 0.0001);
-                cnote << "Difficulty set to: "  << nextWorkDifficulty;
-                diffToTarget((uint32_t*)m_nextWorkTarget.data(), nextWorkDifficulty);
-                m_current.reset();
+                processDifficulty(jPrm.get((Json::Value::ArrayIndex)0, 1).asDouble());
             }
         } else if (_method == "mining.set_extranonce") {
             jPrm = responseObject.get("params", Json::Value::null);
@@ -988,24 +1094,22 @@ void StratumClient::submitSolution(const Solution& solution)
         return;
     }
 
-    Json::Value jReq;
-    jReq["id"] = unsigned(4);
-    jReq["method"] = "mining.submit";
-    jReq["params"] = Json::Value(Json::arrayValue);
-
-    jReq["jsonrpc"] = "2.0";
-    jReq["params"].append(m_conn->User());
-    jReq["params"].append(solution.getJobName());
-    jReq["params"].append(solution.getExtraNonce());
-    jReq["params"].append(solution.getTime());
-    jReq["params"].append(std::to_string(solution.getNonce()));
-    jReq["params"].append(solution.getHashMix().GetHex());
-    jReq["params"].append(solution.getBlockTransaction());
-    if (m_worker.length()) {
-        jReq["worker"] = m_worker;
+    // Every share gets its own id, so answers can come in any order and many shares
+    // may be in flight at once
+    std::lock_guard<std::mutex> lock(m_requestsMutex);
+    unsigned const id = m_nextSubmitId++;
+    if (m_nextSubmitId < c_firstSubmitId) {
+        m_nextSubmitId = c_firstSubmitId;
     }
-    enqueue_response_plea();
-    sendSocketData(jReq);
+    Request& submission = m_requests[id];
+    submission.miner = solution.getMiner();
+    submission.job = solution.getJobName();
+    submission.nonce = solution.getNonce();
+    submission.found = solution.getFound();
+    TraceSpan span(Trace::c_submit, solution.getJobName());
+    m_codec.formatSubmit(m_submitLine, id, m_conn->User(), m_worker, solution);
+    sendSocketData(m_submitLine);
+    submission.sent = std::chrono::steady_clock::now();
 }
 
 void StratumClient::recvSocketData()
@@ -1026,23 +1130,20 @@ void StratumClient::onRecvSocketDataCompleted(const boost::system::error_code& e
     // late after clean disconnection. Check status of connection
     // before triggering all stack of calls
     setThreadName("stratum");
+    TraceSpan span(Trace::c_recv);
     if (!ec && bytes_transferred > 0) {
-        // Extract received message
-        std::istream is(&m_recvBuffer);
-        std::string message;
-        getline(is, message);
+        m_lastReceived = std::chrono::steady_clock::now();
+        // Received line is parsed in place and consumed afterwards
+        const char* line = &*boost::asio::buffers_begin(m_recvBuffer.data());
+        std::size_t size = bytes_transferred;
+        while (size > 0 && (line[size - 1] == '\n' || line[size - 1] == '\r')) {
+            --size;
+        }
+        if (isConnected() && size > 0) {
+            processLine(line, size);
+        }
+        m_recvBuffer.consume(bytes_transferred);
         if (isConnected()) {
-            if (!message.empty()) {
-                // Test validity of chunk and process
-                Json::Value jMsg;
-                Json::Reader jRdr;
-                if (jRdr.parse(message, jMsg)) {
-                    m_io_service.post(boost::bind(&StratumClient::processResponse, this, jMsg));
-                } else {
-                    if (g_logVerbosity >= 6)
-                        cwarn << "Got invalid Json message: " + jRdr.getFormattedErrorMessages();
-                }
-            }
             // Eventually keep reading from socket
             recvSocketData();
         }
@@ -1068,13 +1169,79 @@ void StratumClient::onRecvSocketDataCompleted(const boost::system::error_code& e
     }
 }
 
+void StratumClient::processLine(const char* line, std::size_t size)
+{
+    bool const parsed = m_codec.parse(line, size, m_message);
+    if (parsed && processMessage(m_message)) {
+        return;
+    }
+
+    // Handshake, errors and anything else the codec does not type go through JsonCpp
+    Json::Value jMsg;
+    Json::Reader jRdr;
+    if (jRdr.parse(line, line + size, jMsg)) {
+        processResponse(jMsg);
+    } else {
+        if (g_logVerbosity >= 6)
+            cwarn << "Got invalid Json message: " + jRdr.getFormattedErrorMessages();
+    }
+}
+
+bool StratumClient::processMessage(const StratumCodec::Message& msg)
+{
+    setThreadName("stratum");
+    switch (msg.kind) {
+    case StratumCodec::Message::Response:
+        // Only the responses which do not need the result members
+        switch (msg.id) {
+        case 2:
+        case 9:
+            return true;
+        default:
+            if (msg.id >= c_firstSubmitId) {
+                processSubmitResult(msg.id, !msg.resultIsBool || msg.result, "");
+                return true;
+            }
+            return false;
+        }
+    case StratumCodec::Message::Notify:
+        if (!m_conn->StratumModeConfirmed()) {
+            return false;
+        }
+        StratumCodec::toJob(msg, m_job);
+        processNotify(m_job);
+        return true;
+    case StratumCodec::Message::SetDifficulty:
+        if (!m_conn->StratumModeConfirmed()) {
+            return false;
+        }
+        processDifficulty(msg.difficulty);
+        return true;
+    case StratumCodec::Message::SetExtranonce:
+        if (!m_conn->StratumModeConfirmed()) {
+            return false;
+        }
+        {
+            std::string enonce(msg.extraNonce.data, msg.extraNonce.size);
+            processExtranonce(enonce);
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
 void StratumClient::sendSocketData(Json::Value const & jReq)
+{
+    sendSocketData(m_jWriter.write(jReq));		// Do not add lf. It's added by writer.
+}
+
+void StratumClient::sendSocketData(const std::string& line)
 {
     if (!isConnected()) {
         return;
     }
-    std::ostream os(&m_sendBuffer);
-    os << m_jWriter.write(jReq);		// Do not add lf. It's added by writer.
+    m_sendBuffer.sputn(line.data(), line.size());
     if (m_conn->SecLevel() != SecureLevel::NONE) {
         async_write(*m_securesocket, m_sendBuffer,
                 m_io_strand.wrap(boost::bind(&StratumClient::onSendSocketDataCompleted, this, boost::asio::placeholders::error)));
@@ -1104,44 +1271,3 @@ void StratumClient::onSSLShutdownCompleted(const boost::system::error_code& ec)
     // cnote << "onSSLShutdownCompleted Error code is : " << ec.message();
     m_io_service.post(m_io_strand.wrap(boost::bind(&StratumClient::disconnect_finalize, this)));
 }
-
-void StratumClient::enqueue_response_plea()
-{
-    using namespace std::chrono;
-    steady_clock::time_point response_plea_time = steady_clock::now();
-    if (m_response_pleas_count++ == 0) {
-        m_response_plea_older.store(
-                response_plea_time.time_since_epoch(), std::memory_order_relaxed);
-    }
-    m_response_plea_times.push(response_plea_time);
-}
-
-std::chrono::milliseconds StratumClient::dequeue_response_plea()
-{
-    using namespace std::chrono;
-    steady_clock::time_point response_plea_time(m_response_plea_older.load(std::memory_order_relaxed));
-    milliseconds response_delay_ms =
-        duration_cast<milliseconds>(steady_clock::now() - response_plea_time);
-    if (m_response_plea_times.pop(response_plea_time)) {
-        m_response_plea_older.store(
-                response_plea_time.time_since_epoch(), std::memory_order_relaxed);
-    }
-    if (m_response_pleas_count.load(std::memory_order_relaxed) > 0) {
-        m_response_pleas_count--;
-        return response_delay_ms;
-    } else {
-        return milliseconds(0);
-    }
-}
-
-void StratumClient::clear_response_pleas()
-{
-    using namespace std::chrono;
-    steady_clock::time_point response_plea_time;
-    m_response_pleas_count.store(0, std::memory_order_relaxed);
-    while (m_response_plea_times.pop(response_plea_time))
-    {
-    };
-    m_response_plea_older.store(((steady_clock::time_point)steady_clock::now()).time_since_epoch(),
-            std::memory_order_relaxed);
-}
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <array>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
@@ -10,7 +13,9 @@
 #include <nrgcore/mineplant.h>
 #include <nrgcore/miner.h>
 #include "../PoolClient.h"
-#include <boost/lockfree/queue.hpp>
+#include "StratumCodec.h"
+#include "JobPipeline.h"
+#include "ConnectRace.h"
 
 using namespace energi;
 
@@ -20,6 +25,9 @@ public:
 
 	typedef enum { STRATUM = 0, NRGPROXY, ENERGISTRATUM } StratumProtocol;
 
+    /// Ids of mining.submit requests count up from here, the handshake uses fixed ids below
+    static const unsigned c_firstSubmitId = 1000;
+
 	StratumClient(boost::asio::io_service& io_service, int worktimeout, int responsetimeout, bool submitHashrate);
 	~StratumClient();
 
@@ -45,22 +53,36 @@ public:
 private:
     void disconnect_finalize();
 
-    void enqueue_response_plea();
-    std::chrono::milliseconds dequeue_response_plea();
-    void clear_response_pleas();
+    /// Waits for the answer to the request with the given id, it times out like a share
+    void expectResponse(unsigned id);
+    /// Takes the request answered with id off the table
+    void answered(unsigned id);
+    void clearRequests();
+    /// Drops the requests not answered in time, returns whether any is left in flight
+    bool expireRequests();
 
     void resolve_handler(const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator i);
     void start_connect();
-    void connect_handler(const boost::system::error_code& ec);
+    void connect_handler(const boost::system::error_code& ec, std::shared_ptr<boost::asio::ip::tcp::socket> socket,
+                         const boost::asio::ip::tcp::endpoint& endpoint);
+    void handshake_handler(const boost::system::error_code& ec);
+    void start_session();
     void workloop_timer_elapsed(const boost::system::error_code& ec);
 
     void processResponse(Json::Value& responseObject);
     std::string processError(Json::Value& erroresponseObject);
     void processExtranonce(std::string& enonce);
+    void processNotify(energi::StratumJob& job);
+    void processDifficulty(double difficulty);
+    void processSubmitResult(unsigned id, bool isSuccess, const std::string& errReason);
+    void logSubmitLatency();
+    void processLine(const char* line, std::size_t size);
+    bool processMessage(const StratumCodec::Message& msg);
 
     void recvSocketData();
     void onRecvSocketDataCompleted(const boost::system::error_code& ec, std::size_t bytes_transferred);
     void sendSocketData(Json::Value const & jReq);
+    void sendSocketData(const std::string& line);
     void onSendSocketDataCompleted(const boost::system::error_code& ec);
 
     void onSSLShutdownCompleted(const boost::system::error_code& ec);
@@ -99,14 +121,24 @@ private:
     boost::asio::streambuf m_recvBuffer;
     Json::FastWriter m_jWriter;
 
-    boost::asio::deadline_timer m_workloop_timer;
+    // In place parsing of received lines and formatting of submits, the members are
+    // reused from message to message to keep allocations off the notify path
+    StratumCodec m_codec;
+    StratumCodec::Message m_message;
+    energi::StratumJob m_job;
+    std::string m_submitLine;
 
-    std::atomic<int> m_response_pleas_count = {0};
-    std::atomic<std::chrono::steady_clock::duration> m_response_plea_older;
-    boost::lockfree::queue<std::chrono::steady_clock::time_point> m_response_plea_times;
+    boost::asio::deadline_timer m_workloop_timer;
+    // The TLS close_notify exchange is given up after the response timeout
+    std::chrono::steady_clock::time_point m_shutdownStarted;
 
     boost::asio::ip::tcp::resolver m_resolver;
-    std::queue<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>> m_endpoints;
+    // Addresses of the host in the order they are raced, see EndpointCache
+    std::vector<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>> m_endpoints;
+    std::shared_ptr<ConnectRace> m_race;
+    // TCP connect and TLS handshake are timed separately
+    std::chrono::steady_clock::time_point m_connectStarted;
+    std::chrono::steady_clock::time_point m_handshakeStarted;
 
     arith_uint256 m_nextWorkTarget = arith_uint256("0xffff000000000000000000000000000000000000000000000000000000000000");
 
@@ -115,4 +147,28 @@ private:
 
     bool m_submit_hashrate;
     std::string m_submit_hashrate_id;
+
+    // A request sent to the pool and not answered yet. The handshake uses its fixed ids, shares
+    // count up from c_firstSubmitId and carry what identifies them
+    struct Request
+    {
+        std::chrono::steady_clock::time_point sent;
+        std::string miner;
+        std::string job;
+        uint64_t nonce = 0;
+        std::chrono::steady_clock::time_point found;
+    };
+
+    // Guards the requests in flight, shares are submitted from the submit queue of the plant
+    std::mutex m_requestsMutex;
+    unsigned m_nextSubmitId = c_firstSubmitId;
+    std::map<unsigned, Request> m_requests;
+    // Round trip times of the answered shares, see c_submitLatencyBounds
+    std::array<uint64_t, 8> m_submitLatency = {};
+
+    // Last time anything was received from the pool
+    std::chrono::steady_clock::time_point m_lastReceived;
+
+    // Decodes notified jobs off the io_service thread, declared last so it is stopped first
+    JobPipeline m_pipeline;
 };
@@ -0,0 +1,501 @@
+#include "StratumCodec.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <common/HexCodec.h>
+
+namespace {
+
+/// Nesting accepted before a line is handed to the generic path
+const unsigned c_maxDepth = 32;
+
+enum class Type { Null, True, False, Number, String, Array, Object };
+
+struct Value
+{
+    Type type = Type::Null;
+    bool present = false;
+    // Whole value text, strings without their quotes
+    StratumCodec::Slice raw;
+    // Set if a string contains escapes and can not be used in place
+    bool escaped = false;
+};
+
+inline void skipSpace(const char*& p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+        ++p;
+    }
+}
+
+bool scanValue(const char*& p, const char* end, unsigned depth, Value& value);
+
+bool scanString(const char*& p, const char* end, Value& value)
+{
+    const char* begin = ++p;
+    value.escaped = false;
+    while (p < end) {
+        char const c = *p;
+        if (c == '"') {
+            value.type = Type::String;
+            value.raw.data = begin;
+            value.raw.size = p - begin;
+            ++p;
+            return true;
+        }
+        if (c == '\\') {
+            value.escaped = true;
+            if (++p == end) {
+                return false;
+            }
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            return false;
+        }
+        ++p;
+    }
+    return false;
+}
+
+bool scanLiteral(const char*& p, const char* end, const char* literal, Type type, Value& value)
+{
+    std::size_t const length = std::strlen(literal);
+    if (static_cast<std::size_t>(end - p) < length || std::memcmp(p, literal, length) != 0) {
+        return false;
+    }
+    value.type = type;
+    value.raw.data = p;
+    value.raw.size = length;
+    p += length;
+    return true;
+}
+
+bool scanNumber(const char*& p, const char* end, Value& value)
+{
+    const char* begin = p;
+    while (p < end && *p != '\0' && std::strchr("0123456789+-.eE", *p) != nullptr) {
+        ++p;
+    }
+    if (p == begin) {
+        return false;
+    }
+    value.type = Type::Number;
+    value.raw.data = begin;
+    value.raw.size = p - begin;
+    return true;
+}
+
+/// Scans the object at p calling member(key, value) for each of its members
+template <typename F>
+bool scanObject(const char*& p, const char* end, unsigned depth, F member)
+{
+    if (depth > c_maxDepth) {
+        return false;
+    }
+    ++p;
+    skipSpace(p, end);
+    if (p < end && *p == '}') {
+        ++p;
+        return true;
+    }
+    while (true) {
+        skipSpace(p, end);
+        Value key;
+        if (p == end || *p != '"' || !scanString(p, end, key)) {
+            return false;
+        }
+        skipSpace(p, end);
+        if (p == end || *p != ':') {
+            return false;
+        }
+        ++p;
+        Value value;
+        if (!scanValue(p, end, depth + 1, value)) {
+            return false;
+        }
+        member(key, value);
+        skipSpace(p, end);
+        if (p == end) {
+            return false;
+        }
+        if (*p == ',') {
+            ++p;
+        } else if (*p == '}') {
+            ++p;
+            return true;
+        } else {
+            return false;
+        }
+    }
+}
+
+/// Scans the array at p calling element(index, value) for each of its elements
+template <typename F>
+bool scanArray(const char*& p, const char* end, unsigned depth, F element)
+{
+    if (depth > c_maxDepth) {
+        return false;
+    }
+    ++p;
+    skipSpace(p, end);
+    if (p < end && *p == ']') {
+        ++p;
+        return true;
+    }
+    for (unsigned index = 0;; ++index) {
+        Value value;
+        if (!scanValue(p, end, depth + 1, value)) {
+            return false;
+        }
+        element(index, value);
+        skipSpace(p, end);
+        if (p == end) {
+            return false;
+        }
+        if (*p == ',') {
+            ++p;
+        } else if (*p == ']') {
+            ++p;
+            return true;
+        } else {
+            return false;
+        }
+    }
+}
+
+bool scanValue(const char*& p, const char* end, unsigned depth, Value& value)
+{
+    skipSpace(p, end);
+    if (p == end) {
+        return false;
+    }
+    value.present = true;
+    const char* begin = p;
+    bool ok = false;
+    switch (*p) {
+    case '"':
+        return scanString(p, end, value);
+    case '{':
+        ok = scanObject(p, end, depth, [](const Value&, const Value&) {});
+        value.type = Type::Object;
+        break;
+    case '[':
+        ok = scanArray(p, end, depth, [](unsigned, const Value&) {});
+        value.type = Type::Array;
+        break;
+    case 't':
+        return scanLiteral(p, end, "true", Type::True, value);
+    case 'f':
+        return scanLiteral(p, end, "false", Type::False, value);
+    case 'n':
+        return scanLiteral(p, end, "null", Type::Null, value);
+    default:
+        return scanNumber(p, end, value);
+    }
+    value.raw.data = begin;
+    value.raw.size = p - begin;
+    return ok;
+}
+
+/// Rescans a container value found by scanValue
+template <typename F>
+bool forEachElement(const Value& array, F element)
+{
+    const char* p = array.raw.data;
+    return array.type == Type::Array && scanArray(p, p + array.raw.size, 1, element);
+}
+
+template <typename F>
+bool forEachMember(const Value& object, F member)
+{
+    const char* p = object.raw.data;
+    return object.type == Type::Object && scanObject(p, p + object.raw.size, 1, member);
+}
+
+bool toUnsigned(const Value& value, unsigned& out)
+{
+    if (value.type != Type::Number || value.raw.size > 10) {
+        return false;
+    }
+    uint64_t result = 0;
+    for (std::size_t i = 0; i < value.raw.size; ++i) {
+        char const c = value.raw.data[i];
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        result = result * 10 + (c - '0');
+    }
+    if (result > 0xffffffffull) {
+        return false;
+    }
+    out = static_cast<unsigned>(result);
+    return true;
+}
+
+bool toDouble(const Value& value, double& out)
+{
+    char buffer[64];
+    if (value.type != Type::Number || value.raw.size >= sizeof(buffer)) {
+        return false;
+    }
+    std::memcpy(buffer, value.raw.data, value.raw.size);
+    buffer[value.raw.size] = '\0';
+    char* last = nullptr;
+    out = std::strtod(buffer, &last);
+    return last == buffer + value.raw.size;
+}
+
+/// Plain string usable in place
+inline bool isText(const Value& value)
+{
+    return value.type == Type::String && !value.escaped;
+}
+
+bool parseNotify(const Value& params, StratumCodec::Message& msg)
+{
+    Value values[10];
+    bool ok = forEachElement(params, [&](unsigned index, const Value& value) {
+        if (index < 10) {
+            values[index] = value;
+        }
+    });
+    if (!ok) {
+        return false;
+    }
+    StratumCodec::Slice* const text[] = {
+        &msg.jobName, &msg.prevHash, &msg.coinbase1, &msg.coinbase2, nullptr,
+        &msg.version, &msg.bits, &msg.time };
+    for (unsigned i = 0; i < 8; ++i) {
+        if (text[i] == nullptr) {
+            continue;
+        }
+        if (!isText(values[i])) {
+            return false;
+        }
+        *text[i] = values[i].raw;
+    }
+
+    // The transactions are objects carrying their raw hex in "data" and possibly their "txid"
+    if (values[4].type != Type::Array) {
+        return false;
+    }
+    ok = forEachElement(values[4], [&](unsigned, const Value& branch) {
+        StratumCodec::Slice data;
+        StratumCodec::Slice txid;
+        bool const object = forEachMember(branch, [&](const Value& key, const Value& member) {
+            if (key.raw == "data") {
+                ok = ok && isText(member);
+                data = member.raw;
+            } else if (key.raw == "txid" && isText(member)) {
+                txid = member.raw;
+            }
+        });
+        ok = ok && object;
+        msg.transactions.push_back(data);
+        msg.txids.push_back(txid);
+    }) && ok;
+    if (!ok) {
+        return false;
+    }
+
+    if (values[8].type == Type::True) {
+        msg.cleanJobs = true;
+    } else if (values[8].type == Type::False || values[8].type == Type::Null) {
+        msg.cleanJobs = false;
+    } else {
+        return false;
+    }
+    return toUnsigned(values[9], msg.height);
+}
+
+} // namespace
+
+bool StratumCodec::Slice::operator==(const char* text) const
+{
+    std::size_t const length = std::strlen(text);
+    return length == size && std::memcmp(data, text, length) == 0;
+}
+
+void StratumCodec::Message::clear()
+{
+    kind = Unknown;
+    id = 0;
+    method = Slice();
+    resultIsBool = false;
+    result = false;
+    jobName = prevHash = coinbase1 = coinbase2 = Slice();
+    transactions.clear();
+    txids.clear();
+    version = bits = time = Slice();
+    cleanJobs = false;
+    height = 0;
+    difficulty = 1.0;
+    extraNonce = Slice();
+}
+
+bool StratumCodec::parse(const char* data, std::size_t size, Message& msg) const
+{
+    msg.clear();
+    const char* p = data;
+    const char* end = data + size;
+    skipSpace(p, end);
+    if (p == end || *p != '{') {
+        return false;
+    }
+
+    Value id, method, params, result, error, jsonrpc;
+    bool ok = scanObject(p, end, 0, [&](const Value& key, const Value& value) {
+        if (key.raw == "id") {
+            id = value;
+        } else if (key.raw == "method") {
+            method = value;
+        } else if (key.raw == "params") {
+            params = value;
+        } else if (key.raw == "result") {
+            result = value;
+        } else if (key.raw == "error") {
+            error = value;
+        } else if (key.raw == "jsonrpc") {
+            jsonrpc = value;
+        }
+    });
+    skipSpace(p, end);
+    if (!ok || p != end) {
+        return false;
+    }
+
+    // Anything not strictly shaped like the hot messages is left to the generic path
+    if (jsonrpc.present && !(isText(jsonrpc) && jsonrpc.raw == "2.0")) {
+        return true;
+    }
+    if (id.type != Type::Null && !toUnsigned(id, msg.id)) {
+        return true;
+    }
+    if (method.type != Type::Null) {
+        if (!isText(method)) {
+            return true;
+        }
+        msg.method = method.raw;
+    }
+
+    if (msg.method.empty()) {
+        if (msg.id == 0 || error.type != Type::Null || !result.present) {
+            return true;
+        }
+        msg.resultIsBool = result.type == Type::True || result.type == Type::False;
+        msg.result = result.type == Type::True;
+        msg.kind = Message::Response;
+        return true;
+    }
+
+    if (params.type != Type::Array || params.raw.size <= 2) {
+        return true;
+    }
+    if (msg.method == "mining.notify") {
+        if (parseNotify(params, msg)) {
+            msg.kind = Message::Notify;
+        }
+    } else if (msg.method == "mining.set_difficulty") {
+        Value first;
+        forEachElement(params, [&](unsigned index, const Value& value) {
+            if (index == 0) {
+                first = value;
+            }
+        });
+        if (toDouble(first, msg.difficulty)) {
+            msg.kind = Message::SetDifficulty;
+        }
+    } else if (msg.method == "mining.set_extranonce") {
+        Value first;
+        forEachElement(params, [&](unsigned index, const Value& value) {
+            if (index == 0) {
+                first = value;
+            }
+        });
+        if (isText(first)) {
+            msg.extraNonce = first.raw;
+            msg.kind = Message::SetExtranonce;
+        }
+    }
+    return true;
+}
+
+void StratumCodec::toJob(const Message& msg, energi::StratumJob& job)
+{
+    msg.jobName.assignTo(job.jobName);
+    msg.prevHash.assignTo(job.prevHash);
+    msg.coinbase1.assignTo(job.coinbase1);
+    msg.coinbase2.assignTo(job.coinbase2);
+    job.transactions.resize(msg.transactions.size());
+    job.txids.resize(msg.txids.size());
+    for (std::size_t i = 0; i < msg.transactions.size(); ++i) {
+        msg.transactions[i].assignTo(job.transactions[i]);
+        msg.txids[i].assignTo(job.txids[i]);
+    }
+    msg.version.assignTo(job.version);
+    msg.bits.assignTo(job.bits);
+    msg.time.assignTo(job.time);
+    job.cleanJobs = msg.cleanJobs;
+    job.height = msg.height;
+}
+
+void StratumCodec::appendString(std::string& out, const std::string& text)
+{
+    out.push_back('"');
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned>(c));
+            out.append(escape);
+        } else {
+            out.push_back(c);
+        }
+    }
+    out.push_back('"');
+}
+
+void StratumCodec::formatSubmit(std::string& out, unsigned id, const std::string& user, const std::string& worker,
+                                const energi::Solution& solution)
+{
+    // Same member order as Json::FastWriter
+    if (m_submitPrefix.empty() || user != m_submitUser || worker != m_submitWorker) {
+        m_submitUser = user;
+        m_submitWorker = worker;
+        m_submitPrefix = ",\"jsonrpc\":\"2.0\",\"method\":\"mining.submit\",\"params\":[";
+        appendString(m_submitPrefix, user);
+        m_submitSuffix = "]";
+        if (!worker.empty()) {
+            m_submitSuffix += ",\"worker\":";
+            appendString(m_submitSuffix, worker);
+        }
+        m_submitSuffix += "}\n";
+    }
+
+    char number[24];
+    std::snprintf(number, sizeof(number), "{\"id\":%u", id);
+    out.assign(number);
+    out.append(m_submitPrefix);
+    out.push_back(',');
+    appendString(out, solution.getJobName());
+    char word[] = ",\"00000000\"";
+    hex::encodeUint32(solution.m_extraNonce, word + 2);
+    out.append(word, sizeof(word) - 1);
+    hex::encodeUint32(solution.getWork().nTime, word + 2);
+    out.append(word, sizeof(word) - 1);
+    std::snprintf(number, sizeof(number), ",\"%" PRIu64 "\"", solution.getNonce());
+    out.append(number);
+    out.append(",\"");
+    uint256 const& mix = solution.getHashMix();
+    std::size_t const offset = out.size();
+    out.resize(offset + mix.size() * 2);
+    hex::encodeReversed(mix.begin(), mix.size(), &out[offset]);
+    out.append("\",\"");
+    out.append(solution.getBlockTransaction());
+    out.push_back('"');
+    out.append(m_submitSuffix);
+}
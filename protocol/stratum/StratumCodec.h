@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <primitives/block.h>
+#include <primitives/solution.h>
+
+/**
+ * @brief Stratum line codec working in place on the receive buffer.
+ *
+ * parse() scans one JSON line without building a DOM. The members and params needed by the
+ * hot messages (mining.notify, mining.set_difficulty, mining.set_extranonce and successful
+ * responses) are returned as slices pointing into the line, so they stay valid only until the
+ * line is consumed from the buffer. Everything else, as well as strings carrying escapes, is
+ * reported as Unknown and left to the JsonCpp path.
+ */
+class StratumCodec
+{
+public:
+    struct Slice
+    {
+        const char* data = nullptr;
+        std::size_t size = 0;
+
+        bool empty() const
+        {
+            return size == 0;
+        }
+
+        bool operator==(const char* text) const;
+
+        void assignTo(std::string& out) const
+        {
+            out.assign(data, size);
+        }
+    };
+
+    struct Message
+    {
+        enum Kind { Unknown, Notify, SetDifficulty, SetExtranonce, Response };
+
+        Kind kind = Unknown;
+        unsigned id = 0;
+        Slice method;
+
+        // Response
+        bool resultIsBool = false;
+        bool result = false;
+
+        // mining.notify params
+        Slice jobName;
+        Slice prevHash;
+        Slice coinbase1;
+        Slice coinbase2;
+        std::vector<Slice> transactions;
+        std::vector<Slice> txids;
+        Slice version;
+        Slice bits;
+        Slice time;
+        bool cleanJobs = false;
+        unsigned height = 0;
+
+        // mining.set_difficulty
+        double difficulty = 1.0;
+
+        // mining.set_extranonce
+        Slice extraNonce;
+
+        void clear();
+    };
+
+    /**
+     * @brief Parses the line [data, data + size) into msg, reusing its storage.
+     * @return false if the line is not valid JSON, msg.kind is Unknown if it is valid
+     *         but needs the generic path.
+     */
+    bool parse(const char* data, std::size_t size, Message& msg) const;
+
+    /// Copies the notify params of msg into job, reusing the capacity of its strings
+    static void toJob(const Message& msg, energi::StratumJob& job);
+
+    /**
+     * @brief Formats a mining.submit request (terminated by a line feed) into out.
+     * The parts which only depend on the login are preformatted once and reused.
+     */
+    void formatSubmit(std::string& out, unsigned id, const std::string& user, const std::string& worker,
+                      const energi::Solution& solution);
+
+    /// Appends text as a quoted JSON string
+    static void appendString(std::string& out, const std::string& text);
+
+private:
+    std::string m_submitUser;
+    std::string m_submitWorker;
+    std::string m_submitPrefix;
+    std::string m_submitSuffix;
+};
@@ -0,0 +1,128 @@
+#include "TlsContext.h"
+
+#include <cstdlib>
+
+#include <common/Log.h>
+
+#ifdef _WIN32
+#include <wincrypt.h>
+#endif
+
+TlsContextCache& TlsContextCache::instance()
+{
+    // Never destroyed, OpenSSL cleans up at exit before the static destructors run
+    static TlsContextCache* cache = new TlsContextCache();
+    return *cache;
+}
+
+TlsContextCache::Entry::~Entry()
+{
+    if (session) {
+        SSL_SESSION_free(session);
+    }
+}
+
+std::string TlsContextCache::key(URI& conn)
+{
+    return conn.Host() + ":" + std::to_string(conn.Port()) + ":" + std::to_string(unsigned(conn.SecLevel()));
+}
+
+TlsContextCache::Entry& TlsContextCache::entry(URI& conn)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::unique_ptr<Entry>& entry = m_entries[key(conn)];
+    if (entry) {
+        return *entry;
+    }
+
+    boost::asio::ssl::context::method method = boost::asio::ssl::context::tls_client;
+    if (conn.SecLevel() == SecureLevel::TLS12) {
+        method = boost::asio::ssl::context::tlsv12;
+    }
+    entry.reset(new Entry(method));
+    loadVerifyPaths(entry->context);
+
+    // Sessions are handed to onNewSession, the internal cache only serves servers
+    SSL_CTX* ctx = entry->context.native_handle();
+    SSL_CTX_set_app_data(ctx, entry.get());
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, &TlsContextCache::onNewSession);
+    return *entry;
+}
+
+boost::asio::ssl::context& TlsContextCache::context(URI& conn)
+{
+    return entry(conn).context;
+}
+
+void TlsContextCache::prepare(SSL* ssl, URI& conn)
+{
+    Entry& cached = entry(conn);
+    SSL_set_tlsext_host_name(ssl, conn.Host().c_str());
+    std::lock_guard<std::mutex> lock(cached.mutex);
+    if (cached.session) {
+        SSL_set_session(ssl, cached.session);
+    }
+}
+
+void TlsContextCache::forget(URI& conn)
+{
+    Entry& cached = entry(conn);
+    std::lock_guard<std::mutex> lock(cached.mutex);
+    if (cached.session) {
+        SSL_SESSION_free(cached.session);
+        cached.session = nullptr;
+    }
+}
+
+int TlsContextCache::onNewSession(SSL* ssl, SSL_SESSION* session)
+{
+    Entry* cached = static_cast<Entry*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+    if (!cached) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(cached->mutex);
+    if (cached->session) {
+        SSL_SESSION_free(cached->session);
+    }
+    // Keeping the reference handed over
+    cached->session = session;
+    return 1;
+}
+
+void TlsContextCache::loadVerifyPaths(boost::asio::ssl::context& ctx)
+{
+#ifdef _WIN32
+    HCERTSTORE hStore = CertOpenSystemStore(0, "ROOT");
+    if (hStore == nullptr) {
+        return;
+    }
+
+    X509_STORE* store = X509_STORE_new();
+    PCCERT_CONTEXT pContext = nullptr;
+    while ((pContext = CertEnumCertificatesInStore(hStore, pContext)) != nullptr) {
+        X509* x509 = d2i_X509(
+            nullptr, (const unsigned char**)&pContext->pbCertEncoded, pContext->cbCertEncoded);
+        if (x509 != nullptr) {
+            X509_STORE_add_cert(store, x509);
+            X509_free(x509);
+        }
+    }
+
+    CertFreeCertificateContext(pContext);
+    CertCloseStore(hStore, 0);
+
+    SSL_CTX_set_cert_store(ctx.native_handle(), store);
+#else
+    char* certPath = getenv("SSL_CERT_FILE");
+    try {
+        ctx.load_verify_file(certPath ? certPath : "/etc/ssl/certs/ca-certificates.crt");
+    } catch (...) {
+        cwarn << "Failed to load ca certificates. Either the file "
+                 "'/etc/ssl/certs/ca-certificates.crt' does not exist";
+        cwarn << "or the environment variable SSL_CERT_FILE is set to an invalid or "
+                 "inaccessible file.";
+        cwarn << "It is possible that certificate verification can fail.";
+    }
+#endif
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <boost/asio/ssl.hpp>
+
+#include "../PoolURI.h"
+
+/**
+ * @brief Long lived TLS client contexts, one per pool, shared by all clients.
+ *
+ * Building a context loads the CA certificates, which is kept out of the reconnect path. Each
+ * context remembers the last session the pool handed out (session id or ticket, TLS 1.3 tickets
+ * arrive after the handshake), prepare() offers it on the next connection so the pool can resume
+ * it with an abbreviated handshake.
+ */
+class TlsContextCache
+{
+public:
+    static TlsContextCache& instance();
+
+    boost::asio::ssl::context& context(URI& conn);
+
+    /// Sets the server name and offers the remembered session on a connection to conn
+    void prepare(SSL* ssl, URI& conn);
+
+    /// Drops the remembered session of conn, e.g. after a failed handshake
+    void forget(URI& conn);
+
+private:
+    TlsContextCache() = default;
+
+    struct Entry
+    {
+        explicit Entry(boost::asio::ssl::context::method method)
+            : context(method)
+        {}
+        ~Entry();
+
+        boost::asio::ssl::context context;
+        std::mutex mutex;
+        SSL_SESSION* session = nullptr;
+    };
+
+    static std::string key(URI& conn);
+    static int onNewSession(SSL* ssl, SSL_SESSION* session);
+    static void loadVerifyPaths(boost::asio::ssl::context& ctx);
+
+    Entry& entry(URI& conn);
+
+    std::mutex m_mutex;
+    std::map<std::string, std::unique_ptr<Entry>> m_entries;
+};
@@ -50,7 +50,9 @@ void SimulateClient::submitSolution(const Solution& solution)
     cnote << "Difficulty: " << m_difficulty;
 
     const auto& work = solution.getWork();
-    auto hash = Miner::GetPOWHash(work);
+    BlockHeader header(work);
+    header.nNonce = solution.getNonce();
+    auto hash = Miner::GetPOWHash(header);
     if(UintToArith256 <= work.hashTarget) {
         if (m_onSolutionAccepted) {
             m_onSolutionAccepted(false);